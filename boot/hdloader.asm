@@ -133,6 +133,12 @@ LABEL_START:			; <--- 从这里开始 *************
 	add	bx, [fs:SB_DIR_ENT_INODE_OFF]
 	mov	eax, [es:bx]		; eax <- inode nr of kernel
 	call	get_inode		; eax <- start sector nr of kernel
+	cmp	ecx, KERNEL_VALID_SPACE - SECT_BUF_SIZE	; ecx <- its size;
+	jbe	.size_ok		; the last read may be a whole buffer more
+	mov	dh, 4			; "Too Large"
+	call	real_mode_disp_str
+	jmp	$
+.size_ok:
 	mov	dword [disk_address_packet +  8], eax
 load_kernel:
 	call	read_sector
@@ -335,6 +341,13 @@ LABEL_PM_START:
 	shl	eax, 4
 	add	eax, KERNEL_FILE_OFF
 	mov	[BOOT_PARAM_ADDR + 8], eax			; BootParam[2] = KernelFilePhyAddr;
+	mov	eax, [dwMCRNumber]				;
+	mov	[BOOT_PARAM_ADDR + 12], eax			; BootParam[3] = MCRNumber;
+	mov	esi, MemChkBuf					;
+	mov	edi, BOOT_PARAM_ADDR + 16			; BootParam[4..] = MemChkBuf;
+	mov	ecx, 256 / 4					;
+	cld							;
+	rep	movsd						;
 
 	;***************************************************************
 	jmp	SelectorFlatC:KRNL_ENT_PT_PHY_ADDR	; 正式进入内核 *
@@ -694,12 +707,35 @@ SetupPaging:
 
 	; 为简化处理, 所有线性地址对应相等的物理地址. 并且不考虑内存空洞.
 
+	; CPU 支持 PSE 时用 4MB 的页, 不需要页表 (窗口的页表由内核按需建立)
+	call	CheckPSE
+	test	eax, eax
+	jz	.4k_pages
+
+	pop	ecx			; PDE 个数
+	mov	ax, SelectorFlatRW
+	mov	es, ax
+	mov	edi, PAGE_DIR_BASE
+	mov	eax, PG_P  | PG_USU | PG_RWW | PG_PS
+.4m:
+	stosd
+	add	eax, 400000h		; 每个 PDE 映射 4M
+	loop	.4m
+
+	mov	eax, cr4
+	or	eax, 10h		; CR4.PSE
+	mov	cr4, eax
+	jmp	.enable
+
+.4k_pages:
 	; 首先初始化页目录
 	mov	ax, SelectorFlatRW
 	mov	es, ax
 	mov	edi, PAGE_DIR_BASE	; 此段首地址为 PAGE_DIR_BASE
 	xor	eax, eax
 	mov	eax, PAGE_TBL_BASE | PG_P  | PG_USU | PG_RWW
+	pop	ecx
+	push	ecx
 .1:
 	stosd
 	add	eax, 4096		; 为了简化, 所有页表在内存中是连续的.
@@ -718,6 +754,7 @@ SetupPaging:
 	add	eax, 4096		; 每一页指向 4K 的空间
 	loop	.2
 
+.enable:
 	mov	eax, PAGE_DIR_BASE
 	mov	cr3, eax
 	mov	eax, cr0
@@ -730,6 +767,34 @@ SetupPaging:
 	ret
 ; 分页机制启动完毕 ----------------------------------------------------------
 
+; CheckPSE -----------------------------------------------------------------
+; 返回 eax = CPUID.1:EDX.PSE (CPU 是否支持 4M 的页). 破坏 ebx, ecx, edx
+; --------------------------------------------------------------------------
+CheckPSE:
+	pushfd				; 先看有没有 CPUID: EFLAGS.ID 能否改变
+	pop	eax
+	mov	ebx, eax
+	xor	eax, 200000h
+	push	eax
+	popfd
+	pushfd
+	pop	eax
+	push	ebx
+	popfd
+	cmp	eax, ebx
+	je	.no
+
+	mov	eax, 1
+	cpuid
+	mov	eax, edx
+	shr	eax, 3			; PSE
+	and	eax, 1
+	ret
+.no:
+	xor	eax, eax
+	ret
+; CheckPSE 结束 ------------------------------------------------------------
+
 
 
 ; InitKernel ---------------------------------------------------------------------------------
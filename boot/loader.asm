@@ -433,6 +433,13 @@ LABEL_PM_START:
 	shl	eax, 4
 	add	eax, KERNEL_FILE_OFF
 	mov	[BOOT_PARAM_ADDR + 8], eax ; phy-addr of kernel.bin
+	mov	eax, [dwMCRNumber]
+	mov	[BOOT_PARAM_ADDR + 12], eax ; nr of ARDS
+	mov	esi, MemChkBuf
+	mov	edi, BOOT_PARAM_ADDR + 16 ; the ARDS themselves (E820 map)
+	mov	ecx, 256 / 4
+	cld
+	rep	movsd
 
 	;***************************************************************
 	jmp	SelectorFlatC:KRNL_ENT_PT_PHY_ADDR	; 正式进入内核 *
@@ -445,6 +452,7 @@ LABEL_PM_START:
 	;      501000h ┃                                    ┃
 	;              ┣━━━━━━━━━━━━━━━━━━┫
 	;      500FFFh ┃■■■■■■■■■■■■■■■■■■┃  4GB ram needs 4MB  for page tables: [101000h, 501000h)
+	;              ┃■■■■■■■■■■■■■■■■■■┃  (none if the CPU has PSE: 4MB pages, the kernel frees the room)
 	;              ┃■■■■■■■■■■■■■■■■■■┃
 	;              ┃■■■■■■■■■■■■■■■■■■┃
 	;              ┃■■■■■■■■■■■■■■■■■■┃
@@ -807,12 +815,35 @@ SetupPaging:
 
 	; 为简化处理, 所有线性地址对应相等的物理地址. 并且不考虑内存空洞.
 
+	; CPU 支持 PSE 时用 4MB 的页, 不需要页表 (窗口的页表由内核按需建立)
+	call	CheckPSE
+	test	eax, eax
+	jz	.4k_pages
+
+	pop	ecx			; PDE 个数
+	mov	ax, SelectorFlatRW
+	mov	es, ax
+	mov	edi, PAGE_DIR_BASE
+	mov	eax, PG_P  | PG_USU | PG_RWW | PG_PS
+.4m:
+	stosd
+	add	eax, 400000h		; 每个 PDE 映射 4M
+	loop	.4m
+
+	mov	eax, cr4
+	or	eax, 10h		; CR4.PSE
+	mov	cr4, eax
+	jmp	.enable
+
+.4k_pages:
 	; 首先初始化页目录
 	mov	ax, SelectorFlatRW
 	mov	es, ax
 	mov	edi, PAGE_DIR_BASE	; 此段首地址为 PAGE_DIR_BASE
 	xor	eax, eax
 	mov	eax, PAGE_TBL_BASE | PG_P  | PG_USU | PG_RWW
+	pop	ecx
+	push	ecx
 .1:
 	stosd
 	add	eax, 4096		; 为了简化, 所有页表在内存中是连续的.
@@ -831,6 +862,7 @@ SetupPaging:
 	add	eax, 4096		; 每一页指向 4K 的空间
 	loop	.2
 
+.enable:
 	mov	eax, PAGE_DIR_BASE
 	mov	cr3, eax
 	mov	eax, cr0
@@ -843,6 +875,34 @@ SetupPaging:
 	ret
 ; 分页机制启动完毕 ----------------------------------------------------------
 
+; CheckPSE -----------------------------------------------------------------
+; 返回 eax = CPUID.1:EDX.PSE (CPU 是否支持 4M 的页). 破坏 ebx, ecx, edx
+; --------------------------------------------------------------------------
+CheckPSE:
+	pushfd				; 先看有没有 CPUID: EFLAGS.ID 能否改变
+	pop	eax
+	mov	ebx, eax
+	xor	eax, 200000h
+	push	eax
+	popfd
+	pushfd
+	pop	eax
+	push	ebx
+	popfd
+	cmp	eax, ebx
+	je	.no
+
+	mov	eax, 1
+	cpuid
+	mov	eax, edx
+	shr	eax, 3			; PSE
+	and	eax, 1
+	ret
+.no:
+	xor	eax, eax
+	ret
+; CheckPSE 结束 ------------------------------------------------------------
+
 
 
 ; InitKernel ---------------------------------------------------------------------------------
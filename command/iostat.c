@@ -0,0 +1,49 @@
+#include "type.h"
+#include "stdio.h"
+#include "sys/const.h"
+
+/* whole disks and volumes worth looking at */
+int devs[] = {
+	MAKE_DEV(DEV_HD, 0),  MAKE_DEV(DEV_HD, 5),
+	MAKE_DEV(DEV_HD2, 0), MAKE_DEV(DEV_HD2, 5),
+	MAKE_DEV(DEV_VBLK, 0),
+	MAKE_DEV(DEV_RAID, 0),
+	MAKE_DEV(DEV_RD, 0)
+};
+
+void print_hist(char * name, u32 * hist)
+{
+	int i;
+	printf("    %s:", name);
+	for (i = 0; i < NR_IO_BUCKETS; i++)
+		if (hist[i])
+			printf(" 2^%d:%d", i, hist[i]);
+	printf("\n");
+}
+
+void print_dir(char * name, struct io_dir_stat * d)
+{
+	printf("  %s reqs:%d sects:%d merges:%d errors:%d\n",
+	       name, d->reqs, d->sects, d->merges, d->errors);
+	print_hist("wait", d->wait_hist);
+	print_hist("svc ", d->svc_hist);
+}
+
+int main(int argc, char * argv[])
+{
+	int i;
+	struct io_stat st;
+
+	for (i = 0; i < sizeof(devs) / sizeof(devs[0]); i++) {
+		if (iostat(devs[i], &st) != 0)
+			continue;
+		if (st.rd.reqs == 0 && st.wt.reqs == 0)
+			continue;
+
+		printf("dev 0x%x (times in TSC cycles)\n", devs[i]);
+		print_dir("read ", &st.rd);
+		print_dir("write", &st.wt);
+	}
+
+	return 0;
+}
@@ -0,0 +1,16 @@
+#include "type.h"
+#include "stdio.h"
+
+int main(int argc, char * argv[])
+{
+	u32 eip;
+	int us = irqoff_time(&eip);
+
+	if (us < 0) {
+		printf("the TSC rate is not known\n");
+		return 1;
+	}
+
+	printf("interrupts off for %d us at most, until 0x%x\n", us, eip);
+	return 0;
+}
@@ -13,6 +13,7 @@
 #include "proto.h"
 #include "hd.h"
 #include "fs.h"
+#include "slab.h"
 
 #define LOG_PROCS			        1
 #define LOG_FD_TABLE			    1
@@ -122,10 +123,7 @@ PUBLIC int disklog(char * logstr)
 	}
 
 	struct time t;
-	MESSAGE msg;
-	msg.BUF= &t;
-	msg.type = GET_RTC_TIME;
-	send_recv(BOTH, TASK_SYS, &msg);
+	get_time(&t);
 	DISKLOG_RD_SECT(device, nr_log_blk0_nr);
 	sprintf((char*)logdiskbuf, "%8d\n", pos);
 	memset(logdiskbuf+9, ' ', 22);
@@ -203,15 +201,15 @@ PUBLIC void dump_fd_graph(const char * fmt, ...)
 	struct proc_fdesc_map {
 		int pid;	/* PID */
 		int filp;	/* idx of proc_table[pid].filp[] */
-		int desc;	/* idx of f_desc_table[] */
+		u32 desc;	/* addr of the file_desc */
 	} pfm[256];
 	int pfm_idx = 0;
 #endif
 
 #if (LOG_FD_TABLE == 1 || LOG_ARROW_FD_INODE == 1)
 	struct fdesc_inode_map {
-		int desc;	/* idx of f_desc_table[] */
-		int inode;	/* idx of inode_table[] */
+		u32 desc;	/* addr of the file_desc */
+		u32 inode;	/* addr of the inode */
 	} fim[256];
 	int fim_idx = 0;
 #endif
@@ -270,14 +268,14 @@ PUBLIC void dump_fd_graph(const char * fmt, ...)
 				     p_proc->p_parent == NO_TASK ? "(NO_TASK)" : "", p_proc->regs.eip);
 
 		int fnr = 3;
-		for (k = 0; k < NR_FILES; k++) {
+		for (k = 0; p_proc->filp && k < NR_FILES; k++) {
 			if (p_proc->filp[k] == 0) continue;
 
-			int fdesc_tbl_idx = p_proc->filp[k] - f_desc_table;
-			logbufpos += sprintf(logbuf + logbufpos, "\t|<f%d> filp[%d]: %d", fnr, k, fdesc_tbl_idx);
+			u32 fdesc_addr = (u32)p_proc->filp[k];
+			logbufpos += sprintf(logbuf + logbufpos, "\t|<f%d> filp[%d]: 0x%x", fnr, k, fdesc_addr);
 			pfm[pfm_idx].pid = i;
 			pfm[pfm_idx].filp = fnr;
-			pfm[pfm_idx].desc = fdesc_tbl_idx;
+			pfm[pfm_idx].desc = fdesc_addr;
 			fnr++;
 			pfm_idx++;
 		}
@@ -297,20 +295,18 @@ PUBLIC void dump_fd_graph(const char * fmt, ...)
 	logbufpos += sprintf(logbuf + logbufpos, "\t}\n");
 #endif
 
+	enable_int();	/* the rest is FS's own */
 	printl("0");
 
 #if (LOG_FD_TABLE == 1)
 	logbufpos += sprintf(logbuf + logbufpos, "\n\tsubgraph cluster_1 {\n");
-	for (i = 0; i < NR_FILE_DESC; i++) {
-		if (f_desc_table[i].fd_inode == 0)
-			continue;
-
-		int inode_tbl_idx = f_desc_table[i].fd_inode - inode_table;
-		logbufpos += sprintf(logbuf + logbufpos, "\t\t\"filedesc%d\" [\n", i);
-		logbufpos += sprintf(logbuf + logbufpos, "\t\t\tlabel = \"<f0>filedesc %d|<f1> fd_mode:%d|<f2> fd_pos:%d|<f3> fd_cnt:%d|<f4> fd_inode:%d",
-				     i, f_desc_table[i].fd_mode, f_desc_table[i].fd_pos, f_desc_table[i].fd_cnt, inode_tbl_idx);
-		fim[fim_idx].desc = i;
-		fim[fim_idx].inode = inode_tbl_idx;
+	struct file_desc * fd;
+	for (fd = kmem_first(&fdesc_cache); fd; fd = kmem_next(&fdesc_cache, fd)) {
+		logbufpos += sprintf(logbuf + logbufpos, "\t\t\"filedesc%x\" [\n", fd);
+		logbufpos += sprintf(logbuf + logbufpos, "\t\t\tlabel = \"<f0>filedesc 0x%x|<f1> fd_mode:%d|<f2> fd_pos:%d|<f3> fd_cnt:%d|<f4> fd_inode:0x%x",
+				     fd, fd->fd_mode, fd->fd_pos, fd->fd_cnt, fd->fd_inode);
+		fim[fim_idx].desc = (u32)fd;
+		fim[fim_idx].inode = (u32)fd->fd_inode;
 		fim_idx++;
 		logbufpos += sprintf(logbuf + logbufpos, "\t\"\n");
 		logbufpos += sprintf(logbuf + logbufpos, "\t\t\tshape = \"record\"\n");
@@ -324,14 +320,13 @@ PUBLIC void dump_fd_graph(const char * fmt, ...)
 
 #if (LOG_INODE_TABLE == 1)
 	logbufpos += sprintf(logbuf + logbufpos, "\n\tsubgraph cluster_2 {\n");
-	for (i = 0; i < NR_INODE; i++) {
-		if (inode_table[i].i_cnt == 0) continue;
-
-		logbufpos += sprintf(logbuf + logbufpos, "\t\t\"inode%d\" [\n", i);
-		logbufpos += sprintf(logbuf + logbufpos, "\t\t\tlabel = \"<f0>inode %d|<f1> i_mode:0x%x|<f2> i_size:0x%x"
+	struct inode * pin;
+	for (pin = inode_list; pin; pin = pin->i_next) {
+		logbufpos += sprintf(logbuf + logbufpos, "\t\t\"inode%x\" [\n", pin);
+		logbufpos += sprintf(logbuf + logbufpos, "\t\t\tlabel = \"<f0>inode 0x%x|<f1> i_mode:0x%x|<f2> i_size:0x%x"
 				     "|<f3> i_start_sect:0x%x|<f4> i_nr_sects:0x%x|<f5> i_dev:0x%x|<f6> i_cnt:%d|<f7> i_num:%d",
-				     i, inode_table[i].i_mode, inode_table[i].i_size, inode_table[i].i_start_sect,
-				     inode_table[i].i_nr_sects, inode_table[i].i_dev, inode_table[i].i_cnt, inode_table[i].i_num);
+				     pin, pin->i_mode, pin->i_size, pin->i_start_sect,
+				     pin->i_nr_sects, pin->i_dev, pin->i_cnt, pin->i_num);
 		logbufpos += sprintf(logbuf + logbufpos, "\t\"\n");
 		logbufpos += sprintf(logbuf + logbufpos, "\t\t\tshape = \"record\"\n");
 		logbufpos += sprintf(logbuf + logbufpos, "\t\t];\n");
@@ -341,7 +336,6 @@ PUBLIC void dump_fd_graph(const char * fmt, ...)
 #endif
 
 	printl("2");
-	enable_int();
 
 #if (LOG_SMAP == 1)
 	logbufpos += sprintf(logbuf + logbufpos, "\n\tsubgraph cluster_3 {\n");
@@ -420,7 +414,7 @@ PUBLIC void dump_fd_graph(const char * fmt, ...)
 	memcpy(_buf, logdiskbuf, SECTOR_SIZE);
 
 	char * p = _buf;
-	for (i = 0; i < SECTOR_SIZE / sizeof(struct inode); i++,p+=INODE_SIZE) {
+	for (i = 0; i < SECTOR_SIZE / INODE_SIZE; i++,p+=INODE_SIZE) {
 		struct inode * pinode = (struct inode*)p;
 		if (pinode->i_start_sect == 0)
 			continue;
@@ -511,21 +505,20 @@ PUBLIC void dump_fd_graph(const char * fmt, ...)
 
 #if (LOG_ARROW_PROC_FD == 1)
 	for (i = 0; i < pfm_idx; i++) {
-		logbufpos += sprintf(logbuf + logbufpos, "\t\"proc%d\":f%d -> \"filedesc%d\":f3;\n", pfm[i].pid, pfm[i].filp, pfm[i].desc);
+		logbufpos += sprintf(logbuf + logbufpos, "\t\"proc%d\":f%d -> \"filedesc%x\":f3;\n", pfm[i].pid, pfm[i].filp, pfm[i].desc);
 	}
 #endif
 
 #if (LOG_ARROW_FD_INODE == 1)
 	for (i = 0; i < fim_idx; i++) {
-		logbufpos += sprintf(logbuf + logbufpos, "\t\"filedesc%d\":f4 -> \"inode%d\":f6;\n", fim[i].desc, fim[i].inode);
+		logbufpos += sprintf(logbuf + logbufpos, "\t\"filedesc%x\":f4 -> \"inode%x\":f6;\n", fim[i].desc, fim[i].inode);
 	}
 #endif
 
 #if (LOG_ARROW_INODE_INODEARRAY == 1)
-	for (i = 0; i < NR_INODE; i++) {
-		if (inode_table[i].i_cnt != 0)
-			logbufpos += sprintf(logbuf + logbufpos, "\t\"inode%d\":f7 -> \"inodearray%d\":f0;\n", i, inode_table[i].i_num);
-	}
+	struct inode * q;
+	for (q = inode_list; q; q = q->i_next)
+		logbufpos += sprintf(logbuf + logbufpos, "\t\"inode%x\":f7 -> \"inodearray%d\":f0;\n", q, q->i_num);
 #endif
 
 	logbufpos += sprintf(logbuf + logbufpos, "\tlabel = \"%s\";\n", title);
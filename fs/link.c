@@ -40,14 +40,18 @@ PUBLIC int do_unlink()
 
 	if (pin->i_mode != I_REGULAR) {
 		printl("{FS} cannot remove file %s, because it is not a regular file.\n", pathname);
+		put_inode(pin);
 		return -1;
 	}
 
 	if (pin->i_cnt > 1) {
 		printl("{FS} cannot remove file %s, because pin->i_cnt is %d.\n", pathname, pin->i_cnt);
+		put_inode(pin);
 		return -1;
 	}
 
+	inval_image(pin->i_dev, pin->i_num);
+
 	int byte_idx = inode_nr / 8;
 	int bit_idx = inode_nr % 8;
 	struct super_block * sb = get_super_block(pin->i_dev);
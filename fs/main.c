@@ -12,6 +12,7 @@
 #include "proto.h"
 
 #include "hd.h"
+#include "slab.h"
 
 PUBLIC struct super_block * get_super_block(int dev)
 {
@@ -28,21 +29,17 @@ PUBLIC struct inode * get_inode(int dev, int num)
 	if (num == 0) return 0;
 
 	struct inode * p;
-	struct inode * q = 0;
-	for (p = &inode_table[0]; p < &inode_table[NR_INODE]; p++) {
-		if (p->i_cnt) {
-			if ((p->i_dev == dev) && (p->i_num == num)) { p->i_cnt++; return p;}
-		}
-		else {
-			if (!q) q = p;
-		}
-	}
+	for (p = inode_list; p; p = p->i_next)
+		if ((p->i_dev == dev) && (p->i_num == num)) { p->i_cnt++; return p;}
 
-	if (!q) panic("the inode table is full");
+	struct inode * q = kmem_alloc(&inode_cache);
+	if (!q) panic("no memory for inodes");
 
 	q->i_cnt = 1;
 	q->i_dev = dev;
 	q->i_num = num;
+	q->i_next = inode_list;
+	inode_list = q;
 
 	struct super_block * sb = get_super_block(dev);
 	int blk_nr = 1 + 1 + sb->nr_imap_sects + sb->nr_smap_sects + ((num - 1) / (SECTOR_SIZE / INODE_SIZE));
@@ -56,19 +53,66 @@ PUBLIC struct inode * get_inode(int dev, int num)
 	return q;
 }
 
-PRIVATE void mkfs()
+/*****************************************************************************
+ *                                reserve_install_sects
+ *****************************************************************************/
+/**
+ * Mark the sectors holding `cmd.tar' (written by the installer) as used
+ * in the sector-map of the root device.
+ * 
+ * @param dev  The root device.
+ * @param psb  Its (new) super block.
+ *****************************************************************************/
+PRIVATE void reserve_install_sects(int dev, struct super_block * psb)
+{
+	struct super_block sb = *psb;
+
+	assert(INSTALL_START_SECT + INSTALL_NR_SECTS < sb.nr_sects - NR_SECTS_FOR_LOG);
+	int bit_offset = INSTALL_START_SECT - sb.n_1st_sect + 1;
+	int bit_off_in_sect = bit_offset % (SECTOR_SIZE * 8);
+	int bit_left = INSTALL_NR_SECTS;
+	int cur_sect = bit_offset / (SECTOR_SIZE * 8);
+	RD_SECT(dev, 2 + sb.nr_imap_sects + cur_sect);
+	while (bit_left) {
+		int byte_off = bit_off_in_sect / 8;
+		fsbuf[byte_off] |= 1 << (bit_off_in_sect % 8);
+		bit_left--;
+		bit_off_in_sect++;
+		if (bit_off_in_sect == (SECTOR_SIZE * 8)) {
+			WR_SECT(dev, 2 + sb.nr_imap_sects + cur_sect);
+			cur_sect++;
+			RD_SECT(dev, 2 + sb.nr_imap_sects + cur_sect);
+			bit_off_in_sect = 0;
+		}
+	}
+	WR_SECT(dev, 2 + sb.nr_imap_sects + cur_sect);
+}
+
+/*****************************************************************************
+ *                                mkfs
+ *****************************************************************************/
+/**
+ * Make a fresh file system on a device. Only the root device gets the
+ * tty special files, `cmd.tar' and the reserved install/log sectors;
+ * any other device starts with an empty root directory.
+ * 
+ * @param dev  The device.
+ *****************************************************************************/
+PUBLIC void mkfs(int dev)
 {
 	MESSAGE driver_msg;
 	int i, j;
+	int is_root = (dev == ROOT_DEV);
+	int nr_root_files = is_root ? NR_CONSOLES + 2 : 1; /* incl. `.' */
 
 	struct part_info geo;
 	driver_msg.BUF = &geo;
 	driver_msg.type = DEV_IOCTL;
 	driver_msg.PROC_NR = TASK_FS;
-	driver_msg.DEVICE = MINOR(ROOT_DEV);
+	driver_msg.DEVICE = MINOR(dev);
 	driver_msg.REQUEST = DIOCTL_GET_GEO;
-	assert(dd_map[MAJOR(ROOT_DEV)].driver_nr != INVALID_DRIVER);
-	send_recv(BOTH, dd_map[MAJOR(ROOT_DEV)].driver_nr, &driver_msg);
+	assert(dd_map[MAJOR(dev)].driver_nr != INVALID_DRIVER);
+	send_recv(BOTH, dd_map[MAJOR(dev)].driver_nr, &driver_msg);
 
 	printl("{FS} dev size: 0x%x sectors\n", geo.size);
 
@@ -93,7 +137,7 @@ PRIVATE void mkfs()
 
 	memset(fsbuf, 0x90, SECTOR_SIZE);
 	memcpy(fsbuf, &sb, SUPER_BLOCK_SIZE);
-	WR_SECT(ROOT_DEV, 1);
+	WR_SECT(dev, 1);
 
 	printl("{FS} devbase:0x%x00, sb:0x%x00, imap:0x%x00, smap:0x%x00\n"
 	       "        inodes:0x%x00, 1st_sector:0x%x00\n",
@@ -104,76 +148,65 @@ PRIVATE void mkfs()
 	       (geo.base + 1 + 1 + sb.nr_imap_sects + sb.nr_smap_sects) * 2,
 	       (geo.base + sb.n_1st_sect) * 2);
 
+	/* bit 0 is reserved, then the root dir and the files in it */
 	memset(fsbuf, 0, SECTOR_SIZE);
-	for (i = 0; i < (NR_CONSOLES + 3); i++)
+	for (i = 0; i < nr_root_files + 1; i++)
 		fsbuf[0] |= 1 << i;
 
-	assert(fsbuf[0] == 0x3F);
-	WR_SECT(ROOT_DEV, 2);
+	assert(fsbuf[0] == (is_root ? 0x3F : 0x03));
+	WR_SECT(dev, 2);
 
 	memset(fsbuf, 0, SECTOR_SIZE);
 	int nr_sects = NR_DEFAULT_FILE_SECTS + 1;
 	for (i = 0; i < nr_sects / 8; i++) fsbuf[i] = 0xFF;
 	for (j = 0; j < nr_sects % 8; j++) fsbuf[i] |= (1 << j);
 
-	WR_SECT(ROOT_DEV, 2 + sb.nr_imap_sects);
+	WR_SECT(dev, 2 + sb.nr_imap_sects);
 	memset(fsbuf, 0, SECTOR_SIZE);
-	for (i = 1; i < sb.nr_smap_sects; i++) WR_SECT(ROOT_DEV, 2 + sb.nr_imap_sects + i);
-	assert(INSTALL_START_SECT + INSTALL_NR_SECTS < sb.nr_sects - NR_SECTS_FOR_LOG);
-	int bit_offset = INSTALL_START_SECT - sb.n_1st_sect + 1;
-	int bit_off_in_sect = bit_offset % (SECTOR_SIZE * 8);
-	int bit_left = INSTALL_NR_SECTS;
-	int cur_sect = bit_offset / (SECTOR_SIZE * 8);
-	RD_SECT(ROOT_DEV, 2 + sb.nr_imap_sects + cur_sect);
-	while (bit_left) {
-		int byte_off = bit_off_in_sect / 8;
-		fsbuf[byte_off] |= 1 << (bit_off_in_sect % 8);
-		bit_left--;
-		bit_off_in_sect++;
-		if (bit_off_in_sect == (SECTOR_SIZE * 8)) {
-			WR_SECT(ROOT_DEV, 2 + sb.nr_imap_sects + cur_sect);
-			cur_sect++;
-			RD_SECT(ROOT_DEV, 2 + sb.nr_imap_sects + cur_sect);
-			bit_off_in_sect = 0;
-		}
-	}
-	WR_SECT(ROOT_DEV, 2 + sb.nr_imap_sects + cur_sect);
+	for (i = 1; i < sb.nr_smap_sects; i++) WR_SECT(dev, 2 + sb.nr_imap_sects + i);
+	if (is_root)
+		reserve_install_sects(dev, &sb);
+
 	memset(fsbuf, 0, SECTOR_SIZE);
 	struct inode * pi = (struct inode*)fsbuf;
 	/*initialize pi*/
 	pi->i_mode = I_DIRECTORY;
-	pi->i_size = DIR_ENTRY_SIZE * 5;
+	pi->i_size = DIR_ENTRY_SIZE * nr_root_files;
 	pi->i_start_sect = sb.n_1st_sect;
 	pi->i_nr_sects = NR_DEFAULT_FILE_SECTS;
-	for (i = 0; i < NR_CONSOLES; i++) {
+	for (i = 0; is_root && i < NR_CONSOLES; i++) {
 		pi = (struct inode*)(fsbuf + (INODE_SIZE * (i + 1)));
 		pi->i_mode = I_CHAR_SPECIAL;
 		pi->i_size = 0;
 		pi->i_start_sect = MAKE_DEV(DEV_CHAR_TTY, i);
 		pi->i_nr_sects = 0;
 	}
-	pi = (struct inode*)(fsbuf + (INODE_SIZE * (NR_CONSOLES + 1)));
-	pi->i_mode = I_REGULAR;
-	pi->i_size = INSTALL_NR_SECTS * SECTOR_SIZE;
-	pi->i_start_sect = INSTALL_START_SECT;
-	pi->i_nr_sects = INSTALL_NR_SECTS;
-	WR_SECT(ROOT_DEV, 2 + sb.nr_imap_sects + sb.nr_smap_sects);
+	if (is_root) {
+		pi = (struct inode*)(fsbuf + (INODE_SIZE * (NR_CONSOLES + 1)));
+		pi->i_mode = I_REGULAR;
+		pi->i_size = INSTALL_NR_SECTS * SECTOR_SIZE;
+		pi->i_start_sect = INSTALL_START_SECT;
+		pi->i_nr_sects = INSTALL_NR_SECTS;
+	}
+	WR_SECT(dev, 2 + sb.nr_imap_sects + sb.nr_smap_sects);
 	memset(fsbuf, 0, SECTOR_SIZE);
 	struct dir_entry * pde = (struct dir_entry *)fsbuf;
 	pde->inode_nr = 1;
 	strcpy(pde->name, ".");
 
-	for (i = 0; i < NR_CONSOLES; i++) {
-		pde++;
-		pde->inode_nr = i + 2; /* dev_tty0's inode_nr is 2 */
-		sprintf(pde->name, "dev_tty%d", i);
+	if (is_root) {
+		for (i = 0; i < NR_CONSOLES; i++) {
+			pde++;
+			pde->inode_nr = i + 2; /* dev_tty0's inode_nr is 2 */
+			sprintf(pde->name, "dev_tty%d", i);
+		}
+		(++pde)->inode_nr = NR_CONSOLES + 2;
+		sprintf(pde->name, "cmd.tar", i);
 	}
-	(++pde)->inode_nr = NR_CONSOLES + 2;
-	sprintf(pde->name, "cmd.tar", i);
-	WR_SECT(ROOT_DEV, sb.n_1st_sect);
+	WR_SECT(dev, sb.n_1st_sect);
 }
 
-PRIVATE void read_super_block(int dev)
+PUBLIC void read_super_block(int dev)
 {
 	int i;
 	MESSAGE driver_msg;
@@ -192,44 +225,98 @@ PRIVATE void read_super_block(int dev)
 	if (i == NR_SUPER_BLOCK)
 		panic("super_block slots used up");
 
-	assert(i == 0); /* currently we use only the 1st slot */
-
 	struct super_block * psb = (struct super_block *)fsbuf;
 
 	super_block[i] = *psb;
 	super_block[i].sb_dev = dev;
+	super_block[i].sb_root = 0;
+	super_block[i].sb_mnt[0] = 0;
 }
 
-PRIVATE void init_fs()
+/*****************************************************************************
+ *                                open_dev
+ *****************************************************************************/
+/**
+ * Send DEV_OPEN to the driver of a block device.
+ * 
+ * @param dev  The device.
+ * 
+ * @return Zero on success, otherwise the driver's error code.
+ *****************************************************************************/
+PUBLIC int open_dev(int dev)
 {
-	int i;
+	MESSAGE driver_msg;
+
+	if (MAJOR(dev) >= NR_MAJORS ||
+	    dd_map[MAJOR(dev)].driver_nr == INVALID_DRIVER)
+		return -1;
 
-	for (i = 0; i < NR_FILE_DESC; i++) memset(&f_desc_table[i], 0, sizeof(struct file_desc));
-	for (i = 0; i < NR_INODE; i++) memset(&inode_table[i], 0, sizeof(struct inode));
+	driver_msg.type = DEV_OPEN;
+	driver_msg.DEVICE = MINOR(dev);
+	driver_msg.RETVAL = 0;
+	send_recv(BOTH, dd_map[MAJOR(dev)].driver_nr, &driver_msg);
+
+	return driver_msg.RETVAL;
+}
+
+/*****************************************************************************
+ *                                close_dev
+ *****************************************************************************/
+/**
+ * Send DEV_CLOSE to the driver of a block device opened by open_dev().
+ * 
+ * @param dev  The device.
+ *****************************************************************************/
+PUBLIC void close_dev(int dev)
+{
+	MESSAGE driver_msg;
+
+	driver_msg.type = DEV_CLOSE;
+	driver_msg.DEVICE = MINOR(dev);
+	send_recv(BOTH, dd_map[MAJOR(dev)].driver_nr, &driver_msg);
+}
+
+PRIVATE void init_fs()
+{
 	struct super_block * sb = super_block;
 	for (; sb < &super_block[NR_SUPER_BLOCK]; sb++) sb->sb_dev = NO_DEV;
 
-	MESSAGE driver_msg;
-	driver_msg.type = DEV_OPEN;
-	driver_msg.DEVICE = MINOR(ROOT_DEV);
-	assert(dd_map[MAJOR(ROOT_DEV)].driver_nr != INVALID_DRIVER);
-	send_recv(BOTH, dd_map[MAJOR(ROOT_DEV)].driver_nr, &driver_msg);
+	if (open_dev(ROOT_DEV) != 0)
+		panic("cannot open the root device");
 
 	RD_SECT(ROOT_DEV, 1);
 	sb = (struct super_block *)fsbuf;
-	if (sb->magic != MAGIC_V1) { printl("{FS} mkfs\n"); mkfs();}
+	if (sb->magic != MAGIC_V1) { printl("{FS} mkfs\n"); mkfs(ROOT_DEV);}
 
 	read_super_block(ROOT_DEV);
 	sb = get_super_block(ROOT_DEV);
 	assert(sb->magic == MAGIC_V1);
 	root_inode = get_inode(ROOT_DEV, ROOT_INODE);
+	sb->sb_root = root_inode;
+
+#ifdef RAMDISK_MNT
+	/* blank at boot, mount_dev() makes no file system */
+	if (open_dev(MAKE_DEV(DEV_RD, 0)) == 0) {
+		mkfs(MAKE_DEV(DEV_RD, 0));
+		close_dev(MAKE_DEV(DEV_RD, 0));
+	}
+	if (mount_dev(MAKE_DEV(DEV_RD, 0), RAMDISK_MNT) != 0)
+		printl("{FS} /%s is not mounted\n", RAMDISK_MNT);
+#endif
 }
 
 PRIVATE int fs_fork()
 {
 	int i;
 	struct proc* child = &proc_table[fs_msg.PID];
+	struct file_desc ** parent_filp = child->filp; /* copied by MM */
+
+	child->filp = 0;
+	if (!parent_filp) return 0;
+	if (!(child->filp = kmem_alloc(&filp_cache))) return -1;
+
 	for (i = 0; i < NR_FILES; i++) {
+		child->filp[i] = parent_filp[i];
 		if (child->filp[i]) {
 			child->filp[i]->fd_cnt++;
 			child->filp[i]->fd_inode->i_cnt++;
@@ -243,16 +330,43 @@ PRIVATE int fs_exit()
 {
 	int i;
 	struct proc* p = &proc_table[fs_msg.PID];
-	for (i = 0; i < NR_FILES; i++) {
-		if (p->filp[i]) {
-			p->filp[i]->fd_inode->i_cnt--;
-			if (--p->filp[i]->fd_cnt == 0) p->filp[i]->fd_inode = 0;
-			p->filp[i] = 0;
-		}
-	}
+	if (!p->filp) return 0;
+	for (i = 0; i < NR_FILES; i++)
+		if (p->filp[i]) close_fd(p, i);
+	kmem_free(&filp_cache, p->filp);
+	p->filp = 0;
 	return 0;
 }
 
+/*****************************************************************************
+ *                                fs_iostat
+ *****************************************************************************/
+/**
+ * Ask the driver of a block device for its I/O statistics. The driver
+ * copies them straight into the caller's buffer, after checking the minor.
+ * 
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PRIVATE int fs_iostat()
+{
+	MESSAGE driver_msg;
+	int dev = fs_msg.DEVICE;
+
+	if (MAJOR(dev) >= NR_MAJORS || MAJOR(dev) == DEV_CHAR_TTY ||
+	    dd_map[MAJOR(dev)].driver_nr == INVALID_DRIVER)
+		return -1;
+
+	driver_msg.type = DEV_IOCTL;
+	driver_msg.DEVICE = MINOR(dev);
+	driver_msg.REQUEST = DIOCTL_GET_STAT;
+	driver_msg.PROC_NR = fs_msg.source;
+	driver_msg.BUF = fs_msg.BUF;
+	driver_msg.RETVAL = 0;
+	send_recv(BOTH, dd_map[MAJOR(dev)].driver_nr, &driver_msg);
+
+	return driver_msg.RETVAL;
+}
+
 PUBLIC void task_fs()
 {
 	printl("{FS} Task FS begins.\n");
@@ -275,6 +389,9 @@ PUBLIC void task_fs()
 		case READ: case WRITE: fs_msg.CNT = do_rdwt(); break;
 		case RESUME_PROC: src = fs_msg.PROC_NR; break;
 		case UNLINK: fs_msg.RETVAL = do_unlink(); break;
+		case MOUNT: fs_msg.RETVAL = do_mount(); break;
+		case IOSTAT: fs_msg.RETVAL = fs_iostat(); break;
+		case DUP_FD: fs_msg.FD = do_dup_fd(); break;
 		default: dump_msg("FS::unknown message:", &fs_msg); assert(0); break;
 		}
 
@@ -289,11 +406,15 @@ PUBLIC void task_fs()
 		msg_name[FORK]   = "FORK";
 		msg_name[EXIT]   = "EXIT";
 		msg_name[STAT]   = "STAT";
+		msg_name[MOUNT]  = "MOUNT";
+		msg_name[IOSTAT] = "IOSTAT";
+		msg_name[DUP_FD] = "DUP_FD";
 
 		switch (msgtype) {
 		case UNLINK: dump_fd_graph("%s just finished. (pid:%d)", msg_name[msgtype], src);
 		case OPEN: case CLOSE: case READ: case WRITE:
-		case FORK: case EXIT: case LSEEK: case STAT: case RESUME_PROC: break;
+		case FORK: case EXIT: case LSEEK: case STAT: case RESUME_PROC:
+		case MOUNT: case IOSTAT: case DUP_FD: break;
 		default:
 			assert(0);
 		}
@@ -309,7 +430,12 @@ PUBLIC void task_fs()
 PUBLIC void put_inode(struct inode * pinode)
 {
 	assert(pinode->i_cnt > 0);
-	pinode->i_cnt--;
+	if (--pinode->i_cnt) return;
+
+	struct inode ** pp = &inode_list;
+	while (*pp != pinode) pp = &(*pp)->i_next;
+	*pp = pinode->i_next;
+	kmem_free(&inode_cache, pinode);
 }
 
 PUBLIC int rw_sector(int io_type, int dev, u64 pos, int bytes, int proc_nr,
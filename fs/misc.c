@@ -13,21 +13,48 @@
 #include "hd.h"
 #include "fs.h"
 
+/*****************************************************************************
+ *                                strip_path
+ *****************************************************************************/
+/**
+ * Get the basename and the dir inode of a path. Directories are flat,
+ * except that "/mnt/file" names `file' on the device mounted at "mnt".
+ * 
+ * @param[out] filename  The basename.
+ * @param[in]  pathname  The full path.
+ * @param[out] ppinode   The dir inode.
+ * 
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
 PUBLIC int strip_path(char * filename, const char * pathname, struct inode** ppinode)
 {
 	char * t = filename;
 	const char * s = pathname;
+	struct inode * dir_inode = root_inode;
 
 	if (s == 0) return -1;
 	if (*s == '/') s++;
 
 	while (*s) {
-		if (*s == '/') return -1;
+		if (*s == '/') {
+			struct super_block * sb;
+			*t = 0;
+			if (dir_inode != root_inode) return -1;
+			for (sb = super_block; sb < &super_block[NR_SUPER_BLOCK]; sb++)
+				if (sb->sb_dev != NO_DEV && sb->sb_mnt[0] &&
+				    strcmp(sb->sb_mnt, filename) == 0) break;
+			if (sb == &super_block[NR_SUPER_BLOCK]) return -1;
+			dir_inode = sb->sb_root;
+			t = filename;
+			memset(filename, 0, MAX_FILENAME_LEN);
+			s++;
+			continue;
+		}
 		*t++ = *s++;
 		if (t - filename >= MAX_FILENAME_LEN) break;
 	}
 	*t = 0;
-	*ppinode = root_inode;
+	*ppinode = dir_inode;
 
 	return 0;
 }
@@ -89,8 +116,8 @@ PUBLIC int do_stat()
 	if (strip_path(filename, pathname, &dir_inode) != 0) assert(0);
 	pin = get_inode(dir_inode->i_dev, inode_nr);
 
-	put_inode(pin);
 	struct stat s = fs_misc_init_stat(pin);
+	put_inode(pin);
 	phys_copy((void*)va2la(src, fs_msg.BUF), (void*)va2la(TASK_FS, &s), sizeof(struct stat));
 
 	return 0;
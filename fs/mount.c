@@ -0,0 +1,139 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   fs/mount.c
+ * @brief  Mounting other block devices.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "keyboard.h"
+#include "proto.h"
+#include "hd.h"
+
+/*****************************************************************************
+ *                                do_mount
+ *****************************************************************************/
+/**
+ * Perform the mount() syscall.
+ * 
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int do_mount()
+{
+	char name[MAX_PATH];
+	int name_len = fs_msg.NAME_LEN;
+	int src = fs_msg.source;
+
+	if (name_len <= 0 || name_len >= MAX_FILENAME_LEN)
+		return -1;
+	phys_copy((void*)va2la(TASK_FS, name),
+		  (void*)va2la(src, fs_msg.PATHNAME),
+		  name_len);
+	name[name_len] = 0;
+	if (name[0] == '/')
+		return -1;
+
+	return mount_dev(fs_msg.DEVICE, name);
+}
+
+/* where a block device is on its drive, see mkfs() */
+PRIVATE void get_geo(int dev, struct part_info * geo)
+{
+	MESSAGE driver_msg;
+
+	driver_msg.BUF = geo;
+	driver_msg.type = DEV_IOCTL;
+	driver_msg.PROC_NR = TASK_FS;
+	driver_msg.DEVICE = MINOR(dev);
+	driver_msg.REQUEST = DIOCTL_GET_GEO;
+	send_recv(BOTH, dd_map[MAJOR(dev)].driver_nr, &driver_msg);
+}
+
+/* nonzero if an open device shares sectors with a RAID-0 member */
+PRIVATE int raid_overlap(int dev)
+{
+	int members[RAID0_NR_MEMBERS] = RAID0_MEMBERS;
+	struct part_info g, mg;
+	int i;
+
+	if (MAJOR(dev) == DEV_RAID || MAJOR(dev) == DEV_RD)
+		return 0;
+
+	get_geo(dev, &g);
+	for (i = 0; i < RAID0_NR_MEMBERS; i++) {
+		if (MAJOR(members[i]) != MAJOR(dev) ||
+		    DRV_OF_DEV(MINOR(members[i])) != DRV_OF_DEV(MINOR(dev)))
+			continue;
+		get_geo(members[i], &mg);
+		if (g.base < mg.base + mg.size && mg.base < g.base + g.size)
+			return 1;
+	}
+	return 0;
+}
+
+/*****************************************************************************
+ *                                mount_dev
+ *****************************************************************************/
+/**
+ * Mount a device at /name. It must have a file system already, see mkfs().
+ * 
+ * @param dev   The device.
+ * @param name  Mount point, a name in the root directory.
+ * 
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int mount_dev(int dev, const char * name)
+{
+	struct super_block * sb;
+
+	for (sb = super_block; sb < &super_block[NR_SUPER_BLOCK]; sb++) {
+		if (sb->sb_dev == dev ||
+		    (sb->sb_dev != NO_DEV && strcmp(sb->sb_mnt, name) == 0)) {
+			printl("{FS} %s or device 0x%x already mounted\n",
+			       name, dev);
+			return -1;
+		}
+	}
+
+	if (open_dev(dev) != 0) {
+		printl("{FS} cannot open device 0x%x\n", dev);
+		return -1;
+	}
+
+	/* the volume and the file systems on its disks keep apart */
+	for (sb = super_block; sb < &super_block[NR_SUPER_BLOCK]; sb++)
+		if (sb->sb_dev != NO_DEV &&
+		    (MAJOR(dev) == DEV_RAID ? raid_overlap(sb->sb_dev) :
+		     MAJOR(sb->sb_dev) == DEV_RAID && raid_overlap(dev))) {
+			printl("{FS} device 0x%x overlaps the RAID-0 members\n",
+			       dev);
+			close_dev(dev);
+			return -1;
+		}
+
+	RD_SECT(dev, 1);
+	sb = (struct super_block *)fsbuf;
+	if (sb->magic != MAGIC_V1) {
+		printl("{FS} no file system on device 0x%x\n", dev);
+		close_dev(dev);
+		return -1;
+	}
+
+	read_super_block(dev);
+	sb = get_super_block(dev);
+	assert(sb->magic == MAGIC_V1);
+	sb->sb_root = get_inode(dev, ROOT_INODE);
+	strcpy(sb->sb_mnt, name);
+
+	return 0;
+}
@@ -10,6 +10,7 @@
 #include "global.h"
 #include "keyboard.h"
 #include "proto.h"
+#include "slab.h"
 
 PRIVATE int alloc_imap_bit(int dev)
 {
@@ -139,12 +140,24 @@ PRIVATE void fs_open_init_imode(int imode,struct inode * pin)
 		}
 }
 
+PUBLIC int valid_fd(struct proc * p, int fd)
+{
+	return fd >= 0 && fd < NR_FILES && p->filp && p->filp[fd];
+}
+
+PUBLIC void close_fd(struct proc * p, int fd)
+{
+	struct file_desc * f = p->filp[fd];
+	put_inode(f->fd_inode);
+	if (--f->fd_cnt == 0) kmem_free(&fdesc_cache, f);
+	p->filp[fd] = 0;
+}
+
 PUBLIC int do_close()
 {
 	int fd = fs_msg.FD;
-	put_inode(pcaller->filp[fd]->fd_inode);
-	if (--pcaller->filp[fd]->fd_cnt == 0) pcaller->filp[fd]->fd_inode = 0;
-	pcaller->filp[fd] = 0;
+	if (!valid_fd(pcaller, fd)) return -1;
+	close_fd(pcaller, fd);
 	return 0;
 }
 
@@ -163,11 +176,10 @@ PUBLIC int do_open()
 		  name_len);
 	pathname[name_len] = 0;
 
+	if (!pcaller->filp && !(pcaller->filp = kmem_alloc(&filp_cache))) return -1;
 	int i;
 	for (i = 0; i < NR_FILES; i++) { if (pcaller->filp[i] == 0) { fd = i; break;}}
 	if ((fd < 0) || (fd >= NR_FILES)) panic("filp[] is full (PID:%d)", proc2pid(pcaller));
-	for (i = 0; i < NR_FILE_DESC; i++) if (f_desc_table[i].fd_inode == 0) break;
-	if (i >= NR_FILE_DESC) panic("f_desc_table[] is full (PID:%d)", proc2pid(pcaller));
 
 	struct inode * pin = 0;
 	int inode_nr = search_file(pathname);
@@ -200,11 +212,13 @@ PUBLIC int do_open()
 	}
 
 	if (pin) {
-		pcaller->filp[fd] = &f_desc_table[i];
-		f_desc_table[i].fd_pos = 0;
-		f_desc_table[i].fd_cnt = 1;
-		f_desc_table[i].fd_inode = pin;
-		f_desc_table[i].fd_mode = flags;
+		struct file_desc * f = kmem_alloc(&fdesc_cache);
+		if (!f) { put_inode(pin); return -1;}
+		pcaller->filp[fd] = f;
+		f->fd_pos = 0;
+		f->fd_cnt = 1;
+		f->fd_inode = pin;
+		f->fd_mode = flags;
 
 		/*initialize imode*/
 		int imode = pin->i_mode & I_TYPE_MASK;
@@ -234,11 +248,51 @@ PUBLIC int do_open()
 }
 
 
+/*****************************************************************************
+ *                                do_dup_fd
+ *****************************************************************************/
+/**
+ * <Ring 1> Give MM a descriptor of its own for a regular file another proc
+ * has open, see do_mmap(). The position is not shared.
+ *
+ * @return The new fd of the caller, -1 if error. The device, inode nr. and
+ *         size of the file go back in DEVICE, INODE_NR and POSITION.
+ *****************************************************************************/
+PUBLIC int do_dup_fd()
+{
+	struct proc * p = &proc_table[fs_msg.PROC_NR];
+	int fd = fs_msg.FD;
+	int i;
+
+	if (!valid_fd(p, fd)) return -1;
+	struct inode * pin = p->filp[fd]->fd_inode;
+	if (pin->i_mode != I_REGULAR) return -1;
+
+	if (!pcaller->filp && !(pcaller->filp = kmem_alloc(&filp_cache))) return -1;
+	for (i = 0; i < NR_FILES; i++) if (pcaller->filp[i] == 0) break;
+	if (i == NR_FILES) return -1;
+
+	struct file_desc * f = kmem_alloc(&fdesc_cache);
+	if (!f) return -1;
+	pin->i_cnt++;
+	f->fd_pos = 0;
+	f->fd_cnt = 1;
+	f->fd_inode = pin;
+	f->fd_mode = O_RDWR;
+	pcaller->filp[i] = f;
+
+	fs_msg.DEVICE = pin->i_dev;
+	fs_msg.INODE_NR = pin->i_num;
+	fs_msg.POSITION = pin->i_size;
+	return i;
+}
+
 PUBLIC int do_lseek()
 {
 	int fd = fs_msg.FD;
 	int off = fs_msg.OFFSET;
 	int whence = fs_msg.WHENCE;
+	if (!valid_fd(pcaller, fd)) return -1;
 
 	int pos = pcaller->filp[fd]->fd_pos;
 	int f_size = pcaller->filp[fd]->fd_inode->i_size;
@@ -18,12 +18,12 @@ PUBLIC int do_rdwt()
 	int len = fs_msg.CNT; /**< r/w bytes */
 	int src = fs_msg.source; /* caller proc nr. */
 	void * buf = fs_msg.BUF; /**< r/w buffer */
-	assert((pcaller->filp[fd] >= &f_desc_table[0]) && (pcaller->filp[fd] < &f_desc_table[NR_FILE_DESC]));
+	if (!valid_fd(pcaller, fd)) return -1;
 	if (!(pcaller->filp[fd]->fd_mode & O_RDWR)) return 0;
 
 	int pos = pcaller->filp[fd]->fd_pos;
 	struct inode * pin = pcaller->filp[fd]->fd_inode;
-	assert(pin >= &inode_table[0] && pin < &inode_table[NR_INODE]);
+	assert(pin && pin->i_cnt > 0);
 	int imode = pin->i_mode & I_TYPE_MASK;
 
 	if (imode == I_CHAR_SPECIAL) {
@@ -54,6 +54,8 @@ PUBLIC int do_rdwt()
 		else {
 			bytes_left = len;
 			pos_end = min(pos + len, pin->i_nr_sects * SECTOR_SIZE);
+			if (pcaller != &proc_table[TASK_MM]) /* not a write-back */
+				inval_image(pin->i_dev, pin->i_num);
 		}
 
 		/*initialize*/
@@ -32,6 +32,10 @@ void assertion_failure(char *exp, char *file, char *base_file, int line);
 #define SEEK_CUR	2
 #define SEEK_END	3
 
+/* mmap() */
+#define	MAP_SHARED	1	/* writes go to the file */
+#define	MAP_PRIVATE	2	/* writes stay in the proc */
+
 #define	MAX_PATH	128
 
 
@@ -53,6 +57,36 @@ struct time {
 	u32 second;
 };
 
+#define	CLOCK_REALTIME	0	/* wall clock, since 1970 */
+#define	CLOCK_MONOTONIC	1	/* since boot */
+
+struct timespec {
+	u32 tv_sec;
+	u32 tv_nsec;
+};
+
+struct timeval {
+	u32 tv_sec;
+	u32 tv_usec;
+};
+
+/* per-device I/O statistics, see iostat() */
+#define	NR_IO_BUCKETS	32	/* bucket i: [2^i, 2^(i+1)) TSC cycles */
+
+struct io_dir_stat {
+	u32 reqs;		/* requests served */
+	u32 sects;		/* sectors transferred */
+	u32 merges;		/* requests folded into a neighbour */
+	u32 errors;		/* requests which failed */
+	u32 wait_hist[NR_IO_BUCKETS];	/* time queued before the driver */
+	u32 svc_hist[NR_IO_BUCKETS];	/* time in the driver */
+};
+
+struct io_stat {
+	struct io_dir_stat rd;
+	struct io_dir_stat wt;
+};
+
 #define  BCD_TO_DEC(x)      ( (x >> 4) * 10 + (x & 0x0f) )
 
 
@@ -93,6 +127,12 @@ PUBLIC	int	unlink		(const char *pathname);
 /* lib/getpid.c */
 PUBLIC int	getpid		();
 
+/* lib/time.c */
+PUBLIC int	clock_gettime	(int clock, struct timespec * ts);
+PUBLIC int	gettimeofday	(struct timeval * tv);
+PUBLIC void	get_time	(struct time * t);
+PUBLIC int	irqoff_time	(u32 * eip);
+
 /* lib/fork.c */
 PUBLIC int	fork		();
 
@@ -106,10 +146,39 @@ PUBLIC int	wait		(int * status);
 PUBLIC int	exec		(const char * path);
 PUBLIC int	execl		(const char * path, const char *arg, ...);
 PUBLIC int	execv		(const char * path, char * argv[]);
+PUBLIC int	spawn		(const char * path, char * argv[]);
+
+/* lib/brk.c */
+PUBLIC int	brk		(void * addr);
+PUBLIC void *	sbrk		(int incr);
+
+/* lib/malloc.c */
+PUBLIC void *	malloc		(int size);
+PUBLIC void	free		(void * ptr);
+PUBLIC void *	calloc		(int nmemb, int size);
+PUBLIC void *	realloc		(void * ptr, int size);
+
+/* lib/shm.c */
+PUBLIC int	shmget		(int key, int size);
+PUBLIC void *	shmat		(int id, void * addr);
+PUBLIC int	shmdt		(void * addr);
+PUBLIC int	shmrm		(int id);
+
+/* lib/mmap.c */
+PUBLIC void *	mmap		(void * addr, int len, int flags, int fd,
+				 int offset);
+PUBLIC int	munmap		(void * addr);
+PUBLIC int	msync		(void * addr);
 
 /* lib/stat.c */
 PUBLIC int	stat		(const char *path, struct stat *buf);
 
+/* lib/mount.c */
+PUBLIC int	mount		(int dev, const char * dir);
+
+/* lib/iostat.c */
+PUBLIC int	iostat		(int dev, struct io_stat * buf);
+
 /* lib/syslog.c */
 PUBLIC	int	syslog		(const char *fmt, ...);
 
@@ -13,8 +13,29 @@
 #define	BI_MAG				0
 #define	BI_MEM_SIZE			1
 #define	BI_KERNEL_FILE			2
+#define	BI_NR_ARDS			3
+#define	BI_ARDS				4	/* the E820 map itself */
 
 #define	MINOR_BOOT			MINOR_hd2a
+/* DEV_HD: root fs on the IDE disk, DEV_VBLK: on the virtio-blk disk */
+#define	ROOT_MAJOR			DEV_HD
+
+/* RAID-0 volume (DEV_RAID): members should sit on different drivers.
+ * They are partitions of their own, FS mounts nothing overlapping them:
+ * the first primary one of the HD slave and of the HD2 master. */
+#define	RAID0_STRIPE_SECTS		128	/* 64KB per stripe unit */
+#define	RAID0_NR_MEMBERS		2
+#define	RAID0_MEMBERS			{MAKE_DEV(DEV_HD, NR_PRIM_PER_DRIVE + 1), \
+					 MAKE_DEV(DEV_HD2, 1)}
+
+/* RAM disk (DEV_RD) at the top of memory, mounted by FS at /tmp */
+#define	RAMDISK_SIZE(mem_size)		(((mem_size) / 4) & ~0xFFFFF)
+#define	RAMDISK_MNT			"tmp"
+
+/* swap partition of TASK_SWAP, its contents are lost (NO_DEV: no swap) */
+#define	SWAP_DEV			MAKE_DEV(DEV_HD, MINOR_hd2a + 1)
+/* pages are written out when fewer frames than this are free */
+#define	SWAP_LOW_FRAMES			32
 
 #define ENABLE_DISK_LOG
 #define SET_LOG_SECT_SMAP_AT_STARTUP
@@ -48,10 +48,15 @@
 #define FREE_SLOT 0x20	/* set when proc table entry is not used
 			 * (ok to allocated to a new process)
 			 */
+#define PAGING    0x40	/* set when proc waits for MM to read in a page */
+#define SWAPPING  0x80	/* set when proc waits for TASK_SWAP (a page or memory) */
 
-#define ALLPROC 9
+#define ALLPROC 14
 #define USERPROC 4
-#define SYSPROC 5
+#define SYSPROC 10
+
+/* CPUs used at most, see kernel/smp.c; also in sconst.inc */
+#define	NR_CPUS		4
 
 /* TTY */
 #define NR_CONSOLES	3	/* consoles */
@@ -64,12 +69,27 @@
 
 /* 8253/8254 PIT (Programmable Interval Timer) */
 #define TIMER0         0x40 /* I/O port for timer channel 0 */
+#define TIMER2         0x42 /* I/O port for timer channel 2 */
 #define TIMER_MODE     0x43 /* I/O port for timer mode control */
 #define RATE_GENERATOR 0x34 /* 00-11-010-0 :
 			     * Counter0 - LSB then MSB - rate generator - binary
 			     */
+#define TIMER2_ONESHOT 0xB0 /* 10-11-000-0 :
+			     * Counter2 - LSB then MSB - one-shot - binary
+			     */
+#define TIMER0_ONESHOT 0x30 /* 00-11-000-0 :
+			     * Counter0 - LSB then MSB - interrupt on
+			     * terminal count - binary
+			     */
 #define TIMER_FREQ     1193182L/* clock frequency for timer in PC and AT */
 #define HZ             100  /* clock freq (software settable on IBM-PC) */
+#define CALIBRATE_MS   10   /* the TSC is timed against the PIT this long */
+
+/* port B of the 8255: gate and output of timer channel 2, the speaker */
+#define PORT_B         0x61
+#define PORT_B_GATE2   0x01
+#define PORT_B_SPKR    0x02
+#define PORT_B_OUT2    0x20
 
 /* AT keyboard */
 /* 8042 ports */
@@ -107,6 +127,7 @@
 #define  HOUR             4
 #define  MINUTE           2
 #define  SECOND           0
+#define  CLK_UPDATE    0x0A	/* Status register A: bit 7 = update in progress */
 #define  CLK_STATUS    0x0B	/* Status register B: RTC configuration	*/
 #define  CLK_HEALTH    0x0E	/* Diagnostic status: (should be set by Power
 				 * On Self-Test [POST])
@@ -131,6 +152,7 @@
 #define	FLOPPY_IRQ	6	/* floppy disk */
 #define	PRINTER_IRQ	7
 #define	AT_WINI_IRQ	14	/* at winchester */
+#define	AT_WINI2_IRQ	15	/* at winchester, secondary channel */
 
 /* tasks */
 /* 注意 TASK_XXX 的定义要与 global.c 中对应 */
@@ -141,14 +163,19 @@
 #define TASK_HD		2
 #define TASK_FS		3
 #define TASK_MM		4
-#define INIT		5
+#define TASK_VBLK	5
+#define TASK_HD2	6
+#define TASK_RAID	7
+#define TASK_RD		8
+#define TASK_SWAP	9
+#define INIT		10
 #define ANY		(NR_TASKS + NR_PROCS + 10)
 #define NO_TASK		(NR_TASKS + NR_PROCS + 20)
 
 #define	MAX_TICKS	0x7FFFABCD
 
 /* system call */
-#define NR_SYS_CALL	3
+#define NR_SYS_CALL	4
 
 /* ipc */
 #define SEND		1
@@ -171,20 +198,25 @@ enum msgtype {
 	HARD_INT = 1,
 
 	/* SYS task */
-	GET_TICKS, GET_PID, GET_RTC_TIME,
+	GET_TICKS, GET_PID, GET_RTC_TIME, SLEEP,
 
 	/* FS */
-	OPEN, CLOSE, READ, WRITE, LSEEK, STAT, UNLINK,
+	OPEN, CLOSE, READ, WRITE, LSEEK, STAT, UNLINK, MOUNT, IOSTAT,
+	DUP_FD,
 
 	/* FS & TTY */
 	SUSPEND_PROC, RESUME_PROC,
 
 	/* MM */
-	EXEC, WAIT,
+	EXEC, WAIT, SPAWN, BRK, SHMGET, SHMAT, SHMDT, SHMRM, MMAP, MUNMAP,
+	MSYNC,
 
 	/* FS & MM */
 	FORK, EXIT,
 
+	/* SWAP */
+	SWAP_OUT,
+
 	/* TTY, SYS, FS, MM, etc */
 	SYSCALL_RET,
 
@@ -214,6 +246,11 @@ enum msgtype {
 #define	PID		u.m3.m3i2
 #define	RETVAL		u.m3.m3i1
 #define	STATUS		u.m3.m3i1
+#define	SHM_KEY		u.m3.m3i3
+#define	SHM_ID		u.m3.m3i4
+#define	MAP_FLAGS	u.m3.m3i3
+#define	USECS		u.m3.m3i2
+#define	INODE_NR	u.m3.m3i2
 
 
 
@@ -224,6 +261,7 @@ enum msgtype {
 
 
 #define	DIOCTL_GET_GEO	1
+#define	DIOCTL_GET_STAT	2	/* struct io_stat of the device */
 
 /* Hard Drive */
 #define SECTOR_SIZE		512
@@ -237,9 +275,14 @@ enum msgtype {
 #define	DEV_HD			3
 #define	DEV_CHAR_TTY		4
 #define	DEV_SCSI		5
+#define	DEV_VBLK		6
+#define	DEV_HD2			7	/* secondary ATA channel */
+#define	DEV_RAID		8	/* RAID-0 volume */
+#define	DEV_RD			9	/* RAM disk */
+#define	NR_MAJORS		10	/* entries in dd_map[] */
 /* make device number from major and minor numbers */
 #define	MAJOR_SHIFT		8
-#define	MAKE_DEV(a,b)		((a << MAJOR_SHIFT) | b)
+#define	MAKE_DEV(a,b)		(((a) << MAJOR_SHIFT) | (b))
 /* separate major and minor numbers from device number */
 #define	MAJOR(x)		((x >> MAJOR_SHIFT) & 0xFF)
 #define	MINOR(x)		(x & 0xFF)
@@ -267,7 +310,7 @@ enum msgtype {
 #define	MINOR_hd1a		0x10
 #define	MINOR_hd2a		(MINOR_hd1a+NR_SUB_PER_PART)
 
-#define	ROOT_DEV		MAKE_DEV(DEV_HD, MINOR_BOOT)
+#define	ROOT_DEV		MAKE_DEV(ROOT_MAJOR, MINOR_BOOT)
 
 #define	P_PRIMARY	0
 #define	P_EXTENDED	1
@@ -277,8 +320,6 @@ enum msgtype {
 #define EXT_PART	0x05	/* extended partition */
 
 #define	NR_FILES	64
-#define	NR_FILE_DESC	64	/* FIXME */
-#define	NR_INODE	64	/* FIXME */
 #define	NR_SUPER_BLOCK	8
 
 
@@ -12,6 +12,8 @@ struct dev_drv_map {
 
 #define	MAGIC_V1	0x111
 
+#define	MAX_FILENAME_LEN	12
+
 struct super_block {
 	u32	magic;		  /**< Magic number */
 	u32	nr_inodes;	  /**< How many inodes */
@@ -28,7 +30,10 @@ struct super_block {
 	u32	dir_ent_inode_off;/**< Offset of `struct dir_entry::inode_nr' */
 	u32	dir_ent_fname_off;/**< Offset of `struct dir_entry::name' */
 
+	/* the following items are only present in memory */
 	int	sb_dev; 	/**< the super block's home device */
+	struct inode *	sb_root;	/**< root dir of the device */
+	char	sb_mnt[MAX_FILENAME_LEN]; /**< mounted at "/sb_mnt/", or "" */
 };
 
 #define	SUPER_BLOCK_SIZE	56
@@ -45,12 +50,11 @@ struct inode {
 	int	i_dev;
 	int	i_cnt;		/**< How many procs share this inode  */
 	int	i_num;		/**< inode nr.  */
+	struct inode *	i_next;	/**< Next in inode_list */
 };
 
 #define	INODE_SIZE	32
 
-#define	MAX_FILENAME_LEN	12
-
 struct dir_entry {
 	int	inode_nr;		/**< inode nr. */
 	char	name[MAX_FILENAME_LEN];	/**< Filename */
@@ -17,13 +17,22 @@ EXTERN	struct descriptor	gdt[GDT_SIZE];
 EXTERN	u8			idt_ptr[6];	/* 0~15:Limit  16~47:Base */
 EXTERN	struct gate		idt[IDT_SIZE];
 
-EXTERN	u32	k_reenter;
 EXTERN	int	current_console;
 
 EXTERN	int	key_pressed;
 
-EXTERN	struct tss	tss;
-EXTERN	struct proc*	p_proc_ready;
+EXTERN	struct tss	tss[NR_CPUS];
+EXTERN	int		apic_irqs;	/* IRQs come by the I/O APIC */
+
+/* SMP, see kernel/smp.c */
+EXTERN	struct cpu	cpus[NR_CPUS];
+EXTERN	int		nr_cpus;	/* started, numbered 0 up */
+EXTERN	struct proc	idle_proc[NR_CPUS];	/* when it has nothing to run */
+
+#define	this_cpu()	(&cpus[cpu_id()])
+#define	p_proc_ready	(this_cpu()->proc)
+#define	k_reenter	(this_cpu()->reenter)
+#define	fpu_owner	(this_cpu()->fpu)
 
 extern	char		task_stack[];
 extern	struct proc	proc_table[];
@@ -40,8 +49,11 @@ extern	const int		MMBUF_SIZE;
 EXTERN	int			memory_size;
 
 /* FS */
-EXTERN	struct file_desc	f_desc_table[NR_FILE_DESC];
-EXTERN	struct inode		inode_table[NR_INODE];
+EXTERN	struct inode *		inode_list;	/* inodes in use */
+extern	struct kmem_cache	inode_cache;
+extern	struct kmem_cache	fdesc_cache;
+extern	struct kmem_cache	filp_cache;
+/* one per mounted device, so it stays a small table scanned by dev */
 EXTERN	struct super_block	super_block[NR_SUPER_BLOCK];
 extern	u8 *			fsbuf;
 extern	const int		FSBUF_SIZE;
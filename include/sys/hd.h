@@ -22,15 +22,23 @@ struct part_ent {
 
 
 
-#define REG_DATA	0x1F0		
-#define REG_FEATURES	0x1F1		
+/* command block and control block of the two ATA channels */
+#define	ATA0_CMD_BASE	0x1F0
+#define	ATA0_CTL_BASE	0x3F6
+#define	ATA1_CMD_BASE	0x170
+#define	ATA1_CTL_BASE	0x376
+#define	NR_ATA_CHANNELS	2
+
+/* Command Block Registers, offsets from ATAx_CMD_BASE */
+#define REG_DATA	0		
+#define REG_FEATURES	1		
 #define REG_ERROR	REG_FEATURES
-#define REG_NSECTOR	0x1F2		
-#define REG_LBA_LOW	0x1F3	
-#define REG_LBA_MID	0x1F4		
-#define REG_LBA_HIGH	0x1F5	
-#define REG_DEVICE	0x1F6	
-#define REG_STATUS	0x1F7	
+#define REG_NSECTOR	2		
+#define REG_LBA_LOW	3	
+#define REG_LBA_MID	4		
+#define REG_LBA_HIGH	5	
+#define REG_DEVICE	6	
+#define REG_STATUS	7	
 #define	STATUS_BSY	0x80
 #define	STATUS_DRDY	0x40
 #define	STATUS_DFSE	0x20
@@ -41,10 +49,12 @@ struct part_ent {
 #define	STATUS_ERR	0x01
 
 #define REG_CMD		REG_STATUS	
-#define REG_DEV_CTRL	0x3F6		
+
+/* Control Block Registers, offsets from ATAx_CTL_BASE */
+#define REG_DEV_CTRL	0		
 #define REG_ALT_STATUS	REG_DEV_CTRL	
 
-#define REG_DRV_ADDR	0x3F7		
+#define REG_DRV_ADDR	1		
 
 #define MAX_IO_BYTES	256	
 
@@ -80,5 +90,18 @@ struct hd_info
 					      ((drv) << 4) |		\
 					      (lba_highest & 0xF) | 0xA0)
 
+#define	DRV_OF_DEV(dev) (dev <= MAX_PRIM ? \
+			 dev / NR_PRIM_PER_DRIVE : \
+			 (dev - MINOR_hd1a) / NR_SUB_PER_DRIVE)
+
+/* reads the partition table at `sect_nr' of `drive' */
+typedef	void	(*part_reader)(int drive, int sect_nr, struct part_ent * entry);
+
+/* kernel/part.c */
+PUBLIC void			partition(struct hd_info * hdi, int device,
+					  int style, part_reader get_part_table);
+PUBLIC int			valid_minor(int device);
+PUBLIC struct part_info *	get_part_info(struct hd_info * hdi, int device);
+
 
 #endif 
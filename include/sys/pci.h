@@ -0,0 +1,39 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   include/sys/pci.h
+ * @brief  PCI configuration space (mechanism #1)
+ *****************************************************************************
+ *****************************************************************************/
+
+#ifndef	_ORANGES_PCI_H_
+#define	_ORANGES_PCI_H_
+
+#define	PCI_CONFIG_ADDR		0xCF8
+#define	PCI_CONFIG_DATA		0xCFC
+
+#define	PCI_MAX_BUS		8	/* we never look further than this */
+#define	PCI_MAX_SLOT		32
+
+/* offsets in the configuration header */
+#define	PCI_VENDOR_ID		0x00	/* u16 */
+#define	PCI_DEVICE_ID		0x02	/* u16 */
+#define	PCI_COMMAND		0x04	/* u16 */
+#define	PCI_BAR0		0x10	/* u32 */
+#define	PCI_SUBSYS_ID		0x2E	/* u16 */
+#define	PCI_INTERRUPT_LINE	0x3C	/* u8  */
+
+#define	PCI_CMD_IO		0x1
+#define	PCI_CMD_MASTER		0x4
+
+#define	PCI_BAR_IO		0x1
+#define	PCI_BAR_IO_MASK		(~0x3)
+
+#define	PCI_NO_VENDOR		0xFFFF
+
+/**
+ * @def PCI_DEV
+ * A PCI function is identified by (bus, slot), function 0 only.
+ */
+#define	PCI_DEV(bus,slot)	(((bus) << 8) | ((slot) << 3))
+
+#endif /* _ORANGES_PCI_H_ */
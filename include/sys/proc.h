@@ -26,9 +26,40 @@ struct stackframe {	/* proc_ptr points here				↑ Low			*/
 };
 
 
+/* a PT_LOAD segment of the program a proc runs, paged in on demand */
+struct vm_area {
+	u32	vaddr;		/* where it starts in the proc */
+	u32	filesz;		/* bytes from the file, the rest is zeroed */
+	u32	memsz;
+	u32	offset;		/* where the bytes are in the file */
+};
+
+#define	NR_VM_AREAS	4
+
+/* a shared memory segment attached to a proc, see mm/shm.c */
+struct shm_attach {
+	u32	va;		/* where it is in the proc, 0 if unused */
+	int	id;
+};
+
+#define	NR_SHM_ATTACH	4
+
+/* a file range mapped into a proc, see mm/mmap.c */
+struct mmap_area {
+	u32	va;		/* where it is in the proc, 0 if unused */
+	u32	len;		/* page aligned */
+	u32	offset;		/* in the file, page aligned */
+	int	flags;		/* MAP_SHARED or MAP_PRIVATE */
+	int	file;		/* MM's handle of the file */
+};
+
+#define	NR_MMAP_AREAS	4
+
 struct proc {
 	struct stackframe regs;    /* process registers saved in stack frame */
 
+	u32 p_cr3;                 /* page directory, loaded by restart */
+
 	u16 ldt_sel;               /* gdt selector giving ldt base and limit */
 	struct descriptor ldts[LDT_SIZE]; /* local descs for code and data */
 
@@ -52,7 +83,61 @@ struct proc {
 
 	int exit_status; 
 
-	struct file_desc * filp[NR_FILES];
+	struct file_desc ** filp;  /* NR_FILES of them, 0 until the first open */
+
+	u32 p_send_tsc;		   /* when it was queued on the receiver */
+	u32 p_recv_wait;	   /* TSC cycles the last msg got was queued */
+
+	int p_image;		   /* MM's handle of the program file, or -1 */
+	struct vm_area p_vm[NR_VM_AREAS];
+	u32 p_fault_la;		   /* the page waited for if PAGING or SWAPPING */
+	u32 p_brk;		   /* end of the heap */
+	struct shm_attach p_shm[NR_SHM_ATTACH];
+	struct mmap_area p_mmap[NR_MMAP_AREAS];
+	u8 * p_fpu;		   /* FPU save area, 0 until the first use */
+	int p_cpu;		   /* the CPU it runs on; tasks stay on 0 */
+};
+
+/**
+ * What each CPU has of its own, cpus[cpu_id()]. The fields are reached from
+ * kernel.asm too: the CPU_* in sconst.inc must match, and the size must
+ * stay 1 << CPU_SHIFT.
+ */
+struct cpu {
+	struct proc *	proc;		/* running here, see p_proc_ready */
+	u32		reenter;	/* see k_reenter */
+	struct proc *	fpu;		/* whose state is in its FPU, fpu_owner */
+	u32		stack_top;	/* of its kernel stack */
+	u32 *		esp0;		/* in its TSS */
+	int		lock_depth;	/* kernel_lock taken again while held */
+	volatile int	flush;		/* a TLB shootdown waits for it */
+	u32		pf_err;		/* error code of the page fault */
+};
+
+#define	CPU_SHIFT	5
+
+/**
+ * Kept by the kernel in a page frame mapped at PROC_KDATA_VA, read-only in
+ * every window, and in the kernel page directory for the tasks and the
+ * native procs: every proc finds it at that address without a syscall.
+ */
+struct kdata {
+	int	ticks;		/* at the last clock event, see get_ticks() */
+	int	pid;		/* of the proc running, if one CPU */
+	u32	boot_time;	/* wall clock at boot_tsc, seconds since 1970 */
+	u64	boot_tsc;
+	u32	tsc_khz;	/* TSC cycles per ms, see init_time() */
+	int	nr_cpus;	/* pid is of no use if more than one */
+	u32	irqoff_max;	/* longest time interrupts were off, cycles */
+	u32	irqoff_eip;	/* where they went back on, see kernel/work.c */
+};
+
+#define	KDATA	((volatile struct kdata *)PROC_KDATA_VA)
+
+/* timestamps of a request being served by a block driver */
+struct io_stamp {
+	u32	wait;		/* cycles spent in the driver's queue */
+	u32	start;		/* TSC when the driver picked it up */
 };
 
 struct task {
@@ -64,16 +149,38 @@ struct task {
 #define proc2pid(x) (x - proc_table)
 
 /* Number of tasks & processes */
-#define NR_TASKS		5
+#define NR_TASKS		10
 #define NR_PROCS		32
 #define NR_NATIVE_PROCS		4
 #define FIRST_PROC		proc_table[0]
 #define LAST_PROC		proc_table[NR_TASKS + NR_PROCS - 1]
 
-#define	PROCS_BASE		0xA00000 /* 10 MB */
+#define	PROCS_BASE		0xA00000 /* 10 MB, page frames from here on */
 #define	PROC_IMAGE_SIZE_DEFAULT	0x100000 /*  1 MB */
 #define	PROC_ORIGIN_STACK	0x400    /*  1 KB */
 
+/**
+ * Every non-native proc owns a window of PROC_VM_SIZE bytes in the linear
+ * address space, its LDT segments start there. Frames are mapped on
+ * demand; the window is user accessible only in the proc's own page
+ * directory.
+ */
+#define	PROC_LINEAR_BASE	0xC0000000
+#define	PROC_VM_SIZE		0x1000000 /* 16 MB */
+#define	NR_VM_SLOTS		(NR_PROCS - NR_NATIVE_PROCS)
+#define	PROC_VM_BASE(pid)	(PROC_LINEAR_BASE + \
+				 ((pid) - (NR_TASKS + NR_NATIVE_PROCS)) * \
+				 PROC_VM_SIZE)
+#define	PROC_VM_END		(PROC_LINEAR_BASE + NR_VM_SLOTS * PROC_VM_SIZE)
+
+/* the heap: from above the image up to the break, see do_brk() */
+#define	PROC_HEAP_BASE		PROC_IMAGE_SIZE_DEFAULT
+/* shared memory is attached from here on, files are mapped above */
+#define	PROC_SHM_BASE		0x800000 /*  8 MB */
+#define	PROC_MMAP_BASE		0xC00000 /* 12 MB */
+/* the last page is the kernel data page, see struct kdata */
+#define	PROC_KDATA_VA		(PROC_VM_SIZE - PAGE_SIZE)
+
 /* stacks of tasks */
 #define	STACK_SIZE_DEFAULT	0x4000 /* 16 KB */
 #define STACK_SIZE_TTY		STACK_SIZE_DEFAULT
@@ -81,6 +188,11 @@ struct task {
 #define STACK_SIZE_HD		STACK_SIZE_DEFAULT
 #define STACK_SIZE_FS		STACK_SIZE_DEFAULT
 #define STACK_SIZE_MM		STACK_SIZE_DEFAULT
+#define STACK_SIZE_VBLK		STACK_SIZE_DEFAULT
+#define STACK_SIZE_HD2		STACK_SIZE_DEFAULT
+#define STACK_SIZE_RAID		STACK_SIZE_DEFAULT
+#define STACK_SIZE_RD		STACK_SIZE_DEFAULT
+#define STACK_SIZE_SWAP		STACK_SIZE_DEFAULT
 #define STACK_SIZE_INIT		STACK_SIZE_DEFAULT
 #define STACK_SIZE_TESTA	STACK_SIZE_DEFAULT
 #define STACK_SIZE_TESTB	STACK_SIZE_DEFAULT
@@ -91,6 +203,11 @@ struct task {
 				STACK_SIZE_HD + \
 				STACK_SIZE_FS + \
 				STACK_SIZE_MM + \
+				STACK_SIZE_VBLK + \
+				STACK_SIZE_HD2 + \
+				STACK_SIZE_RAID + \
+				STACK_SIZE_RD + \
+				STACK_SIZE_SWAP + \
 				STACK_SIZE_INIT + \
 				STACK_SIZE_TESTA + \
 				STACK_SIZE_TESTB + \
@@ -72,15 +72,19 @@ struct tss {
 #define	INDEX_FLAT_C		1	/* ┣ LOADER 里面已经确定了的. */
 #define	INDEX_FLAT_RW		2	/* ┃                          */
 #define	INDEX_VIDEO		3	/* ┛                          */
-#define	INDEX_TSS		4
-#define	INDEX_LDT_FIRST		5
+#define	INDEX_TSS		4	/* one TSS per CPU, see cpu_id() */
+#define	INDEX_LDT_FIRST		(INDEX_TSS + NR_CPUS)
+/* after the LDTs, in the order SYSENTER wants: flat code and data for ring 0,
+   then for ring 3 */
+#define	INDEX_SYSENTER		(INDEX_LDT_FIRST + NR_TASKS + NR_PROCS)
 /* 选择子 */
 #define	SELECTOR_DUMMY		   0		/* ┓                          */
 #define	SELECTOR_FLAT_C		0x08		/* ┣ LOADER 里面已经确定了的. */
 #define	SELECTOR_FLAT_RW	0x10		/* ┃                          */
 #define	SELECTOR_VIDEO		(0x18+3)	/* ┛<-- RPL=3                 */
 #define	SELECTOR_TSS		0x20		/* TSS. 从外层跳到内存时 SS 和 ESP 的值从里面获得. */
-#define SELECTOR_LDT_FIRST	0x28
+#define	SELECTOR_LDT_FIRST	(INDEX_LDT_FIRST << 3)
+#define	SELECTOR_SYSENTER	(INDEX_SYSENTER << 3)
 
 #define	SELECTOR_KERNEL_CS	SELECTOR_FLAT_C
 #define	SELECTOR_KERNEL_DS	SELECTOR_FLAT_RW
@@ -145,11 +149,20 @@ struct tss {
 #define	INT_VECTOR_PROTECTION		0xD
 #define	INT_VECTOR_PAGE_FAULT		0xE
 #define	INT_VECTOR_COPROC_ERR		0x10
+#define	INT_VECTOR_SIMD			0x13
 
 /* 中断向量 */
 #define	INT_VECTOR_IRQ0			0x20
 #define	INT_VECTOR_IRQ8			0x28
 
+/* local APIC, see kernel/apic.c */
+#define	INT_VECTOR_LAPIC_TIMER		0x30
+#define	INT_VECTOR_APIC_SPURIOUS	0x3F	/* low 4 bits must be 1s */
+
+/* IPIs, see kernel/smp.c; the shootdown is of a higher class */
+#define	INT_VECTOR_RESCHED		0x40
+#define	INT_VECTOR_TLB			0x50
+
 /* 系统调用 */
 #define INT_VECTOR_SYS_CALL             0x90
 
@@ -160,4 +173,28 @@ struct tss {
 /* seg:off -> linear addr */
 #define makelinear(seg,off) (u32)(((u32)(seg2linear(seg))) + (u32)(off))
 
+/* paging */
+#define	PAGE_SIZE		4096
+#define	PAGE_SHIFT		12
+#define	PAGE_DIR_BASE		0x100000	/* built by LOADER, used by tasks */
+#define	PG_P			1	/* present */
+#define	PG_RWW			2	/* writable */
+#define	PG_USU			4	/* user accessible */
+#define	PG_PWT			8	/* write-through */
+#define	PG_PCD			0x10	/* not cached */
+#define	PG_ACCESSED		0x20	/* used, set by the CPU */
+#define	PG_DIRTY		0x40	/* written, set by the CPU */
+#define	PG_PS			0x80	/* PDE maps a 4 MB page */
+#define	PG_COW			0x200	/* shared read-only until written */
+#define	PG_SHARED		0x400	/* shared memory, stays shared on fork */
+#define	PG_SWAP			0x800	/* not present: in the swap slot PTE >> 12 */
+#define	PG_FRAME(e)		((e) & ~0xFFF)
+#define	PDE_IDX(la)		((u32)(la) >> 22)
+#define	PTE_IDX(la)		(((u32)(la) >> 12) & 0x3FF)
+
+/* error code of #PF */
+#define	PF_PROT			1	/* 0: the page was not present */
+#define	PF_WRITE		2
+#define	PF_USER			4
+
 #endif /* _ORANGES_PROTECT_H_ */
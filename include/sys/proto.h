@@ -6,12 +6,18 @@
 /* kliba.asm */
 PUBLIC void	out_byte(u16 port, u8 value);
 PUBLIC u8	in_byte(u16 port);
+PUBLIC void	out_word(u16 port, u16 value);
+PUBLIC u16	in_word(u16 port);
+PUBLIC void	out_dword(u16 port, u32 value);
+PUBLIC u32	in_dword(u16 port);
+PUBLIC u64	read_tsc();
 PUBLIC void	disp_str(char * info);
 PUBLIC void	disp_color_str(char * info, int color);
-PUBLIC void	disable_irq(int irq);
-PUBLIC void	enable_irq(int irq);
 PUBLIC void	disable_int();
 PUBLIC void	enable_int();
+PUBLIC u32	save_int();
+PUBLIC void	restore_int(u32 eflags);
+PUBLIC int	cpu_id();
 PUBLIC void	port_read(u16 port, void* buf, int n);
 PUBLIC void	port_write(u16 port, void* buf, int n);
 PUBLIC void	glitter(int row, int col);
@@ -21,6 +27,7 @@ PUBLIC char*	strcpy(char* dst, const char* src);
 
 /* protect.c */
 PUBLIC void	init_prot();
+PUBLIC void	init_sysenter_cpu(int cpu);
 PUBLIC u32	seg2linear(u16 seg);
 PUBLIC void	init_desc(struct descriptor * p_desc,
 			  u32 base, u32 limit, u16 attribute);
@@ -46,17 +53,106 @@ PUBLIC void panic(const char *fmt, ...);
 /* i8259.c */
 PUBLIC void init_8259A();
 PUBLIC void put_irq_handler(int irq, irq_handler handler);
+PUBLIC void disable_irq(int irq);
+PUBLIC void enable_irq(int irq);
 PUBLIC void spurious_irq(int irq);
 
 /* clock.c */
 PUBLIC void clock_handler(int irq);
+PUBLIC void clock_account();
+PUBLIC void clock_rearm();
+PUBLIC void set_alarm(int pid, u32 us);
+PUBLIC int  get_expired_alarm();
 PUBLIC void init_clock();
+PUBLIC int  clock_per_cpu();
+PUBLIC void init_clock_cpu();
+PUBLIC void usleep(int usec);
 PUBLIC void milli_delay(int milli_sec);
 
+/* kernel/apic.c */
+PUBLIC void init_apic();
+PUBLIC void ioapic_mask(int irq, int masked);
+PUBLIC u32  init_lapic_timer(u32 tsc_khz);
+PUBLIC void lapic_timer_set(u32 count);
+PUBLIC void lapic_eoi();
+PUBLIC int  init_lapic_cpu();
+PUBLIC int  lapic_id();
+PUBLIC void send_ipi(int apic_id, int vector);
+PUBLIC void startup_ipis(u32 pa);
+
+/* kernel/smp.c */
+PUBLIC void lock_kernel();
+PUBLIC void unlock_kernel();
+PUBLIC void kick_cpu(int cpu);
+PUBLIC void resched_handler();
+PUBLIC void tlb_shootdown();
+PUBLIC void init_smp();
+PUBLIC void ap_main(int cpu);
+
+/* kernel/work.c */
+PUBLIC void defer_int(int task_nr);
+PUBLIC void run_work();
+PUBLIC void irqoff_begin();
+PUBLIC void irqoff_end(u32 eip);
+
 /* kernel/hd.c */
 PUBLIC void task_hd();
+PUBLIC void task_hd2();
 PUBLIC void hd_handler(int irq);
 
+/* kernel/vblk.c */
+PUBLIC void task_vblk();
+PUBLIC void vblk_handler(int irq);
+
+/* kernel/iostat.c */
+PUBLIC void io_begin(struct io_stamp * s);
+PUBLIC void io_end(struct io_stat * st, MESSAGE * p, struct io_stamp * s,
+		   int err);
+
+/* kernel/page.c */
+PUBLIC void	init_paging();
+PUBLIC void	map_io_page(u32 pa);
+PUBLIC u32	alloc_frame();
+PUBLIC void	free_frame(u32 pa);
+PUBLIC u32	alloc_pages(int order);
+PUBLIC void	free_pages(u32 pa, int order);
+PUBLIC int	free_frame_cnt();
+PUBLIC u32	get_page(u32 la);
+PUBLIC int	set_page(u32 la, u32 pte);
+PUBLIC void	ref_frame(u32 pa);
+PUBLIC int	share_page(u32 from, u32 to);
+PUBLIC void *	la2pa(void * la);
+PUBLIC int	new_pgdir(int pid);
+PUBLIC void	free_pgdir(int pid);
+PUBLIC void	drop_page(u32 la);
+PUBLIC int	init_swap(int nr_slots);
+PUBLIC u32	evict_page(u32 la, int * slot);
+PUBLIC int	unswap_page(u32 la, u32 old, u32 pa);
+PUBLIC int	swap_wait(u32 la, int len);
+PUBLIC int	pin_pages(u32 la, int len, int write);
+PUBLIC void	unpin_pages(u32 la, int len);
+PUBLIC int	pinned_copy(void * dst, void * src, int len);
+PUBLIC void	page_fault_handler(u32 la, u32 err_code);
+
+/* kernel/fpu.c */
+PUBLIC void	init_fpu();
+PUBLIC void	init_fpu_cpu();
+PUBLIC void	fpu_handler();
+PUBLIC void	fpu_release(struct proc * p);
+PUBLIC int	fpu_fork(int parent, int child);
+PUBLIC void	fpu_free(int pid);
+
+/* kernel/raid0.c */
+PUBLIC void task_raid();
+
+/* kernel/ramdisk.c */
+PUBLIC void task_rd();
+
+/* kernel/pci.c */
+PUBLIC u32  pci_read_config(int dev, int reg);
+PUBLIC void pci_write_config(int dev, int reg, u32 val);
+PUBLIC int  pci_find_device(int vendor, int device, int nth);
+
 /* keyboard.c */
 PUBLIC void init_keyboard();
 PUBLIC void keyboard_read(TTY* p_tty);
@@ -77,11 +173,18 @@ PUBLIC struct inode *		get_inode(int dev, int num);
 PUBLIC void			put_inode(struct inode * pinode);
 PUBLIC void			sync_inode(struct inode * p);
 PUBLIC struct super_block *	get_super_block(int dev);
+PUBLIC void			read_super_block(int dev);
+PUBLIC int			open_dev(int dev);
+PUBLIC void			close_dev(int dev);
+PUBLIC void			mkfs(int dev);
 
 /* fs/open.c */
 PUBLIC int		do_open();
 PUBLIC int		do_close();
+PUBLIC int		valid_fd(struct proc * p, int fd);
+PUBLIC void		close_fd(struct proc * p, int fd);
 PUBLIC int		do_lseek();
+PUBLIC int		do_dup_fd();
 
 /* fs/read_write.c */
 PUBLIC int		do_rdwt();
@@ -95,6 +198,10 @@ PUBLIC int		strip_path(char * filename, const char * pathname,
 				   struct inode** ppinode);
 PUBLIC int		search_file(char * path);
 
+/* fs/mount.c */
+PUBLIC int		do_mount();
+PUBLIC int		mount_dev(int dev, const char * name);
+
 /* fs/disklog.c */
 PUBLIC int		do_disklog();
 PUBLIC int		disklog(char * logstr); /* for debug */
@@ -102,16 +209,53 @@ PUBLIC void		dump_fd_graph(const char * fmt, ...);
 
 /* mm/main.c */
 PUBLIC void		task_mm();
-PUBLIC int		alloc_mem(int pid, int memsize);
-PUBLIC int		free_mem(int pid);
+
+/* mm/vm.c */
+PUBLIC int		new_vm(int pid);
+PUBLIC int		dup_vm(int parent, int child);
+PUBLIC void		clear_vm(int pid);
+PUBLIC void		free_vm(int pid);
+PUBLIC int		do_brk();
+
+/* mm/image.c */
+PUBLIC int		get_image(const char * pathname);
+PUBLIC void		dup_image(int i);
+PUBLIC void		put_image(int i);
+PUBLIC u32		map_image(int i, int pid);
+PUBLIC void		inval_image(int dev, int ino);
+PUBLIC void		apply_invals();
+PUBLIC void		do_page_in();
+
+/* mm/shm.c */
+PUBLIC int		do_shmget();
+PUBLIC int		do_shmat();
+PUBLIC int		do_shmdt();
+PUBLIC int		do_shmrm();
+PUBLIC void		dup_shm(int parent, int child);
+PUBLIC void		detach_all_shm(int pid);
+
+/* mm/mmap.c */
+PUBLIC int		do_mmap();
+PUBLIC int		do_munmap();
+PUBLIC int		do_msync();
+PUBLIC int		mmap_page_in(struct proc * p);
+PUBLIC void		inval_mfile(int dev, int ino);
+PUBLIC void		dup_mmap(int parent, int child);
+PUBLIC void		unmap_all_mmap(int pid);
+
+/* mm/swap.c */
+PUBLIC void		task_swap();
+PUBLIC int		reclaim_frames();
 
 /* mm/forkexit.c */
 PUBLIC int		do_fork();
+PUBLIC int		do_spawn();
 PUBLIC void		do_exit(int status);
 PUBLIC void		do_wait();
 
 /* mm/exec.c */
 PUBLIC int		do_exec();
+PUBLIC int		exec_proc(int caller, int src);
 
 /* console.c */
 PUBLIC void out_char(CONSOLE* p_con, char ch);
@@ -122,6 +266,7 @@ PUBLIC int  is_current_console(CONSOLE* p_con);
 
 /* proc.c */
 PUBLIC	void	schedule();
+PUBLIC	void	balance();
 PUBLIC	void*	va2la(int pid, void* va);
 PUBLIC	int	ldt_seg_linear(struct proc* p, int idx);
 PUBLIC	void	reset_msg(MESSAGE* p);
@@ -132,6 +277,7 @@ PUBLIC void	inform_int(int task_nr);
 
 /* lib/misc.c */
 PUBLIC void spin(char * func_name);
+PUBLIC void prefault(const void * buf, int len);
 
 
 
@@ -139,10 +285,17 @@ PUBLIC void spin(char * func_name);
 /* proc.c */
 PUBLIC	int	sys_sendrec(int function, int src_dest, MESSAGE* m, struct proc* p);
 PUBLIC	int	sys_printx(int _unused1, int _unused2, char* s, struct proc * p_proc);
+PUBLIC	int	sys_flush_tlb(int _unused1, int _unused2, int _unused3,
+			      struct proc * p);
+PUBLIC	int	sys_save_fpu(int _unused1, int _unused2, int _unused3,
+			     struct proc * p);
 
 /* syscall.asm */
 PUBLIC  void    sys_call();             /* int_handler */
+PUBLIC  void    sys_enter();            /* SYSENTER comes here */
 
 /* 系统调用 - 用户级 */
 PUBLIC	int	sendrec(int function, int src_dest, MESSAGE* p_msg);
 PUBLIC	int	printx(char* str);
+PUBLIC	void	flush_tlb();
+PUBLIC	void	save_fpu();
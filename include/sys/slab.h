@@ -0,0 +1,37 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   include/sys/slab.h
+ * @brief  Object caches for kernel tables, see kernel/slab.c.
+ *****************************************************************************
+ *****************************************************************************/
+
+#ifndef	_ORANGES_SLAB_H_
+#define	_ORANGES_SLAB_H_
+
+struct slab;
+
+/**
+ * @struct kmem_cache
+ * Objects of one size, carved out of page frames (slabs).
+ */
+struct kmem_cache {
+	const char *	name;
+	int		size;		/**< Of an object, in bytes */
+
+	/* the following items are set up by the first kmem_alloc() */
+	int		per_slab;	/**< How many objects a slab holds */
+	struct slab *	partial;	/**< Slabs with free objects */
+	struct slab *	full;		/**< Slabs without */
+	struct slab *	empty;		/**< At most one, kept for reuse */
+	int		nr_slabs;
+	int		nr_objs;	/**< Objects in use */
+};
+
+#define	KMEM_CACHE(name, size)	{ name, size }
+
+PUBLIC void *	kmem_alloc(struct kmem_cache * c);
+PUBLIC void	kmem_free(struct kmem_cache * c, void * obj);
+PUBLIC void *	kmem_first(struct kmem_cache * c);
+PUBLIC void *	kmem_next(struct kmem_cache * c, void * obj);
+
+#endif /* _ORANGES_SLAB_H_ */
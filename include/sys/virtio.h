@@ -0,0 +1,95 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   include/sys/virtio.h
+ * @brief  Legacy virtio-pci transport, split virtqueues and virtio-blk.
+ *****************************************************************************
+ *****************************************************************************/
+
+#ifndef	_ORANGES_VIRTIO_H_
+#define	_ORANGES_VIRTIO_H_
+
+#define	VIRTIO_VENDOR_ID		0x1AF4
+#define	VIRTIO_BLK_DEVICE_ID		0x1001	/* transitional virtio-blk */
+
+/* registers in the I/O BAR (legacy interface, no MSI-X) */
+#define	VIRTIO_PCI_HOST_FEATURES	0x00	/* u32 */
+#define	VIRTIO_PCI_GUEST_FEATURES	0x04	/* u32 */
+#define	VIRTIO_PCI_QUEUE_PFN		0x08	/* u32 */
+#define	VIRTIO_PCI_QUEUE_NUM		0x0C	/* u16 */
+#define	VIRTIO_PCI_QUEUE_SEL		0x0E	/* u16 */
+#define	VIRTIO_PCI_QUEUE_NOTIFY		0x10	/* u16 */
+#define	VIRTIO_PCI_STATUS		0x12	/* u8  */
+#define	VIRTIO_PCI_ISR			0x13	/* u8  */
+#define	VIRTIO_PCI_CONFIG		0x14	/* device specific */
+
+/* VIRTIO_PCI_STATUS */
+#define	VIRTIO_STATUS_ACK		0x01
+#define	VIRTIO_STATUS_DRIVER		0x02
+#define	VIRTIO_STATUS_DRIVER_OK		0x04
+#define	VIRTIO_STATUS_FAILED		0x80
+
+/* VIRTIO_PCI_ISR */
+#define	VIRTIO_ISR_QUEUE		0x01
+
+/* feature bits */
+#define	VIRTIO_RING_F_INDIRECT_DESC	28
+
+/* vring_desc::flags */
+#define	VRING_DESC_F_NEXT		1
+#define	VRING_DESC_F_WRITE		2	/* device writes the buffer */
+#define	VRING_DESC_F_INDIRECT		4	/* buffer is a desc table */
+
+/* vring_used::flags */
+#define	VRING_USED_F_NO_NOTIFY		1
+
+#define	VRING_ALIGN			4096	/* legacy interface */
+
+struct vring_desc {
+	u64	addr;	/* physical address */
+	u32	len;
+	u16	flags;
+	u16	next;
+};
+
+struct vring_avail {
+	u16	flags;
+	u16	idx;
+	u16	ring[];
+};
+
+struct vring_used_elem {
+	u32	id;	/* head of the desc chain */
+	u32	len;
+};
+
+struct vring_used {
+	u16			flags;
+	u16			idx;
+	struct vring_used_elem	ring[];
+};
+
+#define	VRING_ALIGN_UP(x)	(((x) + VRING_ALIGN - 1) & ~(VRING_ALIGN - 1))
+#define	VRING_AVAIL_OFF(num)	(sizeof(struct vring_desc) * (num))
+#define	VRING_USED_OFF(num)	VRING_ALIGN_UP(VRING_AVAIL_OFF(num) + \
+					       sizeof(u16) * (3 + (num)))
+#define	VRING_SIZE(num)		(VRING_USED_OFF(num) + \
+				 VRING_ALIGN_UP(sizeof(u16) * 3 + \
+						sizeof(struct vring_used_elem) * (num)))
+
+/* virtio-blk */
+#define	VIRTIO_BLK_T_IN			0	/* read */
+#define	VIRTIO_BLK_T_OUT		1	/* write */
+
+#define	VIRTIO_BLK_S_OK			0
+#define	VIRTIO_BLK_S_IOERR		1
+#define	VIRTIO_BLK_S_UNSUPP		2
+
+#define	VIRTIO_BLK_CFG_CAPACITY		(VIRTIO_PCI_CONFIG + 0)	/* u64 */
+
+struct virtio_blk_outhdr {
+	u32	type;
+	u32	ioprio;
+	u64	sector;
+};
+
+#endif /* _ORANGES_VIRTIO_H_ */
@@ -0,0 +1,25 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   include/sys/work.h
+ * @brief  Work left by interrupt handlers, see kernel/work.c.
+ *****************************************************************************
+ *****************************************************************************/
+
+#ifndef	_ORANGES_WORK_H_
+#define	_ORANGES_WORK_H_
+
+/**
+ * @struct work
+ * What a handler leaves to be done once it has returned.
+ */
+struct work {
+	void		(*func)(struct work * w);
+	struct work *	next;
+	int		queued;		/**< Non-zero while on a list */
+};
+
+#define	WORK(func)	{ func }
+
+PUBLIC void	queue_work(struct work * w);
+
+#endif /* _ORANGES_WORK_H_ */
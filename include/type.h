@@ -60,10 +60,24 @@ typedef struct {
 	} u;
 } MESSAGE;
 
+/* Address Range Descriptor Structure, one entry of the E820 map */
+struct ards {
+	u32	base_low;
+	u32	base_high;
+	u32	len_low;
+	u32	len_high;
+	u32	type;		/* ARDS_RAM: usable */
+};
+
+#define	ARDS_RAM	1
+#define	MAX_ARDS	12	/* as many as LOADER's MemChkBuf holds */
+
 /* i have no idea of where to put this struct, so i put it here */
 struct boot_params {
 	int		mem_size;	/* memory size */
 	unsigned char *	kernel_file;	/* addr of kernel file */
+	int		nr_ards;	/* E820 map, nr_ards == 0 if none */
+	struct ards *	ards;
 };
 
 
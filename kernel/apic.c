@@ -0,0 +1,326 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   kernel/apic.c
+ * @brief  The local APIC and its timer, the I/O APIC.
+ *
+ * With an I/O APIC the IRQs come through it at INT_VECTOR_IRQ0 + irq, as
+ * they did through the 8259A, which is masked for good. An IRQ line is
+ * masked only while it has no handler: the local APIC takes no interrupt
+ * of the class being served until the EOI, see hwint_apic in kernel.asm.
+ * Without one the 8259A goes on, through LINT0 (virtual wire mode).
+ *
+ * The local APIC timer counts down the bus clock, divided by 16, and
+ * interrupts once at INT_VECTOR_LAPIC_TIMER, a clock event for clock.c.
+ * Each CPU has its own local APIC, at the same address, and timer; the IPIs
+ * between them go through it too, see smp.c.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+#define	CPUID_APIC		(1 << 9)
+
+#define	MSR_APIC_BASE		0x1B
+#define	APIC_BASE_ENABLE	(1 << 11)
+
+/* registers, offsets from the base */
+#define	LAPIC_ID		0x020
+#define	LAPIC_EOI		0x0B0
+#define	LAPIC_SVR		0x0F0	/* spurious interrupt vector */
+#define	LAPIC_ICR_LOW		0x300	/* interrupt command */
+#define	LAPIC_ICR_HIGH		0x310
+#define	LAPIC_LVT_TIMER		0x320
+#define	LAPIC_LVT_LINT0		0x350
+#define	LAPIC_LVT_LINT1		0x360
+#define	LAPIC_TIMER_ICR		0x380	/* initial count */
+#define	LAPIC_TIMER_CCR		0x390	/* current count */
+#define	LAPIC_TIMER_DCR		0x3E0	/* divide configuration */
+
+#define	SVR_ENABLE		0x100
+#define	LVT_MASKED		0x10000
+#define	LVT_EXTINT		0x700
+#define	LVT_NMI			0x400
+#define	DCR_DIV16		0x3
+
+#define	ICR_INIT		0x500
+#define	ICR_STARTUP		0x600
+#define	ICR_BUSY		0x1000	/* not sent yet */
+#define	ICR_ASSERT		0x4000
+#define	ICR_ALL_BUT_SELF	0xC0000
+
+/* no MP or ACPI tables are read, it is where PCs have it */
+#define	IOAPIC_BASE		0xFEC00000
+#define	IOAPIC_REGSEL		0x00
+#define	IOAPIC_WIN		0x10
+#define	IOAPIC_VER		0x01
+#define	IOAPIC_REDTBL(pin)	(0x10 + 2 * (pin))
+
+#define	RTE_LOW_ACTIVE		(1 << 13)
+#define	RTE_LEVEL		(1 << 15)
+#define	RTE_MASKED		(1 << 16)
+
+/* edge/level of each IRQ, set by the BIOS for the 8259A; PCI are level */
+#define	ELCR_M			0x4D0
+#define	ELCR_S			0x4D1
+
+#define	NO_PIN			0xFF
+
+PRIVATE u32	lapic;		/* base of the registers, 0: no local APIC */
+PRIVATE u32	ioapic;		/* 0: no I/O APIC, the IRQs go to the 8259A */
+
+/* the I/O APIC pin of each IRQ */
+PRIVATE u8	irq_pins[NR_IRQ] = {
+	2,			/* the PIT is on pin 2, pin 0 is the 8259A */
+	1, NO_PIN,		/* the cascade is nothing here */
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+};
+
+#define	LAPIC_REG(r)	(*(volatile u32 *)(lapic + (r)))
+
+PRIVATE u64 rdmsr(u32 msr)
+{
+	u64 val;
+	__asm__ __volatile__("rdmsr" : "=A"(val) : "c"(msr));
+	return val;
+}
+
+PRIVATE void wrmsr(u32 msr, u64 val)
+{
+	__asm__ __volatile__("wrmsr" :: "c"(msr), "A"(val));
+}
+
+PRIVATE u32 ioapic_read(int reg)
+{
+	*(volatile u32 *)(ioapic + IOAPIC_REGSEL) = reg;
+	return *(volatile u32 *)(ioapic + IOAPIC_WIN);
+}
+
+/* busy-wait, the TSC must have been timed by init_clock() */
+PRIVATE void udelay(u32 us)
+{
+	u64 end = read_tsc() + (u64)us * (KDATA->tsc_khz / 1000);
+
+	while (read_tsc() < end)
+		;
+}
+
+PRIVATE void ioapic_write(int reg, u32 val)
+{
+	*(volatile u32 *)(ioapic + IOAPIC_REGSEL) = reg;
+	*(volatile u32 *)(ioapic + IOAPIC_WIN) = val;
+}
+
+/* route the IRQs of irq_pins[] to this CPU, all masked */
+PRIVATE void init_ioapic()
+{
+	map_io_page(IOAPIC_BASE);
+	ioapic = IOAPIC_BASE;
+
+	u32 ver = ioapic_read(IOAPIC_VER);
+	if (ver == 0xFFFFFFFF || ((ver >> 16) & 0xFF) < 15) {
+		ioapic = 0;	/* not there, or too small */
+		return;
+	}
+
+	u16 elcr = in_byte(ELCR_M) | (in_byte(ELCR_S) << 8);
+	u32 dest = LAPIC_REG(LAPIC_ID) & 0xFF000000;
+	int irq;
+
+	for (irq = 0; irq < NR_IRQ; irq++) {
+		int pin = irq_pins[irq];
+		if (pin == NO_PIN)
+			continue;
+		u32 trig = elcr & (1 << irq) ? RTE_LEVEL | RTE_LOW_ACTIVE : 0;
+		ioapic_write(IOAPIC_REDTBL(pin) + 1, dest);
+		ioapic_write(IOAPIC_REDTBL(pin),
+			     RTE_MASKED | trig | (INT_VECTOR_IRQ0 + irq));
+	}
+}
+
+/*****************************************************************************
+ *                                init_apic
+ *****************************************************************************/
+/**
+ * <Ring 0> Turn on the local APIC, and take the IRQs from the 8259A if
+ * there is an I/O APIC. Before any IRQ is enabled.
+ *****************************************************************************/
+PUBLIC void init_apic()
+{
+	u32 eax, ebx, ecx, edx;
+
+	__asm__ __volatile__("cpuid"
+			     : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+			     : "a"(1));
+	if (!(edx & CPUID_APIC))
+		return;
+
+	u64 base = rdmsr(MSR_APIC_BASE);
+	if (!(base & APIC_BASE_ENABLE))
+		wrmsr(MSR_APIC_BASE, base | APIC_BASE_ENABLE);
+	lapic = (u32)base & ~0xFFF;
+	map_io_page(lapic);
+
+	LAPIC_REG(LAPIC_SVR) = SVR_ENABLE | INT_VECTOR_APIC_SPURIOUS;
+	LAPIC_REG(LAPIC_LVT_LINT0) = LVT_EXTINT;	/* the 8259A */
+	LAPIC_REG(LAPIC_LVT_LINT1) = LVT_NMI;
+
+	init_ioapic();
+	if (!ioapic)
+		return;
+
+	out_byte(INT_M_CTLMASK, 0xFF);
+	out_byte(INT_S_CTLMASK, 0xFF);
+	LAPIC_REG(LAPIC_LVT_LINT0) = LVT_MASKED | LVT_EXTINT;
+	apic_irqs = 1;
+}
+
+/*****************************************************************************
+ *                                ioapic_mask
+ *****************************************************************************/
+/**
+ * Mask or unmask an IRQ at the I/O APIC, see disable_irq().
+ *
+ * @param irq     The IRQ.
+ * @param masked  Nonzero to mask it.
+ *****************************************************************************/
+PUBLIC void ioapic_mask(int irq, int masked)
+{
+	int pin = irq_pins[irq];
+
+	if (pin == NO_PIN)
+		return;
+
+	u32 eflags = save_int();
+	u32 rte = ioapic_read(IOAPIC_REDTBL(pin));
+	ioapic_write(IOAPIC_REDTBL(pin),
+		     masked ? rte | RTE_MASKED : rte & ~RTE_MASKED);
+	restore_int(eflags);
+}
+
+/*****************************************************************************
+ *                                init_lapic_timer
+ *****************************************************************************/
+/**
+ * <Ring 0> Time the local APIC timer against the TSC, after init_apic().
+ *
+ * @param tsc_khz  TSC cycles per ms.
+ *
+ * @return Timer counts per ms, 0 if there is no local APIC.
+ *****************************************************************************/
+PUBLIC u32 init_lapic_timer(u32 tsc_khz)
+{
+	if (!lapic || !tsc_khz)
+		return 0;
+
+	LAPIC_REG(LAPIC_TIMER_DCR) = DCR_DIV16;
+	LAPIC_REG(LAPIC_LVT_TIMER) = LVT_MASKED | INT_VECTOR_LAPIC_TIMER;
+	LAPIC_REG(LAPIC_TIMER_ICR) = 0xFFFFFFFF;
+
+	u64 start = read_tsc();
+	while (read_tsc() - start < (u64)tsc_khz * CALIBRATE_MS)
+		;
+	u32 khz = (0xFFFFFFFF - LAPIC_REG(LAPIC_TIMER_CCR)) / CALIBRATE_MS;
+
+	LAPIC_REG(LAPIC_TIMER_ICR) = 0;		/* stopped */
+	LAPIC_REG(LAPIC_LVT_TIMER) = INT_VECTOR_LAPIC_TIMER;	/* one-shot */
+	return khz;
+}
+
+/*****************************************************************************
+ *                                init_lapic_cpu
+ *****************************************************************************/
+/**
+ * <Ring 0> Turn on the local APIC of another CPU, as init_apic() did that
+ * of the BSP, and its timer as init_lapic_timer() left it. No IRQ comes
+ * here, the 8259A (LINT0) is masked.
+ *
+ * @return Its local APIC ID.
+ *****************************************************************************/
+PUBLIC int init_lapic_cpu()
+{
+	LAPIC_REG(LAPIC_SVR) = SVR_ENABLE | INT_VECTOR_APIC_SPURIOUS;
+	LAPIC_REG(LAPIC_LVT_LINT0) = LVT_MASKED | LVT_EXTINT;
+	LAPIC_REG(LAPIC_LVT_LINT1) = LVT_NMI;
+
+	LAPIC_REG(LAPIC_TIMER_DCR) = DCR_DIV16;
+	LAPIC_REG(LAPIC_TIMER_ICR) = 0;
+	LAPIC_REG(LAPIC_LVT_TIMER) = INT_VECTOR_LAPIC_TIMER;	/* one-shot */
+
+	return lapic_id();
+}
+
+/* the local APIC ID of this CPU, -1 if there is no local APIC */
+PUBLIC int lapic_id()
+{
+	return lapic ? LAPIC_REG(LAPIC_ID) >> 24 : -1;
+}
+
+/* write the ICR and wait until it is sent */
+PRIVATE void lapic_icr(u32 high, u32 low)
+{
+	u32 eflags = save_int();
+
+	LAPIC_REG(LAPIC_ICR_HIGH) = high;
+	LAPIC_REG(LAPIC_ICR_LOW) = low;
+	while (LAPIC_REG(LAPIC_ICR_LOW) & ICR_BUSY)
+		;
+	restore_int(eflags);
+}
+
+/*****************************************************************************
+ *                                send_ipi
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Interrupt another CPU.
+ *
+ * @param apic_id  Its local APIC ID.
+ * @param vector   The vector it is to take.
+ *****************************************************************************/
+PUBLIC void send_ipi(int apic_id, int vector)
+{
+	lapic_icr(apic_id << 24, vector);
+}
+
+/*****************************************************************************
+ *                                startup_ipis
+ *****************************************************************************/
+/**
+ * <Ring 0> INIT, then startup twice, to every CPU but this one, the way
+ * the MP spec says. They start in real mode at `pa'.
+ *
+ * @param pa  Where they start, page aligned and below 1 MB.
+ *****************************************************************************/
+PUBLIC void startup_ipis(u32 pa)
+{
+	int i;
+
+	lapic_icr(0, ICR_ALL_BUT_SELF | ICR_ASSERT | ICR_INIT);
+	udelay(10000);
+	for (i = 0; i < 2; i++) {
+		lapic_icr(0, ICR_ALL_BUT_SELF | ICR_ASSERT | ICR_STARTUP |
+			  (pa >> PAGE_SHIFT));
+		udelay(200);
+	}
+}
+
+/* start the timer, it interrupts after `count' counts; 0 stops it */
+PUBLIC void lapic_timer_set(u32 count)
+{
+	LAPIC_REG(LAPIC_TIMER_ICR) = count;
+}
+
+/* <Ring 0> the interrupt in service is done, see hwint_apic */
+PUBLIC void lapic_eoi()
+{
+	LAPIC_REG(LAPIC_EOI) = 0;
+}
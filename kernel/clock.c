@@ -1,5 +1,3 @@
-
-
 #include "type.h"
 #include "stdio.h"
 #include "const.h"
@@ -11,38 +9,255 @@
 #include "console.h"
 #include "global.h"
 #include "proto.h"
+#include "work.h"
+
+/*
+ * There is no periodic tick. The clock event is set to go off when the
+ * running proc's quantum is over or the first alarm is up, whichever is
+ * first (see clock_rearm()), so no interrupt comes while nothing is due.
+ * `ticks' are counted from the TSC when it does.
+ *
+ * Every CPU has a clock event of its own for the quanta of its procs; the
+ * alarms, `ticks' and the load balancing are CPU 0's.
+ *
+ * The handler only charges the ticks, the rest is work for after it (see
+ * do_clock()).
+ */
+
+#define	PIT_MAX_US	50000	/* the PIT count is 16 bits */
+#define	EVENT_MAX_US	500000	/* at least one clock event every so often */
+#define	BALANCE_TICKS	(HZ / 10)	/* see balance() */
+
+/* a timer interrupting once, when told to */
+struct clock_event {
+	char *	name;
+	u32	max_us;			/* the longest it can be set for */
+	void	(*set_next)(u32 us);	/* interrupt in `us' microseconds */
+};
+
+PRIVATE void init_time();
+PRIVATE void pit_set_next(u32 us);
+PRIVATE void lapic_set_next(u32 us);
+PRIVATE void do_clock(struct work * w);
+
+PRIVATE struct clock_event	pit_event   = {"PIT", PIT_MAX_US,
+						 pit_set_next};
+PRIVATE struct clock_event	lapic_event = {"LAPIC", EVENT_MAX_US,
+						 lapic_set_next};
+PRIVATE struct clock_event *	clockevent;
 
+PRIVATE u32	lapic_khz;		/* local APIC timer counts per ms */
+PRIVATE u32	tsc_per_us;
+PRIVATE u32	tsc_per_tick;
+PRIVATE u64	tick_tsc[NR_CPUS];	/* TSC when the current tick began */
+PRIVATE int	balanced;		/* ticks at the last balance() */
+PRIVATE struct work	clock_work[NR_CPUS];
+
+PRIVATE u64	alarms[NR_TASKS + NR_PROCS];	/* TSC when up, 0: none */
+PRIVATE u64	next_alarm;		/* the first not up yet, 0: none */
+
+/* PIT channel 0, mode 0: IRQ 0 when the count runs out */
+PRIVATE void pit_set_next(u32 us)
+{
+	u32 count = max(us * (TIMER_FREQ / 1000) / 1000, 1);
+
+	out_byte(TIMER_MODE, TIMER0_ONESHOT);
+	out_byte(TIMER0, (u8)count);
+	out_byte(TIMER0, (u8)(count >> 8));
+}
+
+PRIVATE void lapic_set_next(u32 us)
+{
+	lapic_timer_set(max(us * (lapic_khz / 1000) +
+			    us * (lapic_khz % 1000) / 1000, 1));
+}
+
+/* see which alarms are up, next_alarm becomes the first of the others */
+PRIVATE int expire_alarms()
+{
+	u64 now = read_tsc();
+	int i, up = 0;
+
+	if (!next_alarm || now < next_alarm)
+		return 0;
+
+	next_alarm = 0;
+	for (i = 0; i < NR_TASKS + NR_PROCS; i++) {
+		if (!alarms[i])
+			continue;
+		if (alarms[i] <= now)
+			up = 1;
+		else if (!next_alarm || alarms[i] < next_alarm)
+			next_alarm = alarms[i];
+	}
+	return up;
+}
 
 /*****************************************************************************
  *                                clock_handler
  *****************************************************************************/
 /**
- * <Ring 0> This routine handles the clock interrupt generated by 8253/8254
- *          programmable interval timer.
+ * <Ring 0> This routine handles the clock event, the interrupt of the
+ *          local APIC timer or of the 8253/8254 PIT.
  * 
  * @param irq The IRQ nr, unused here.
  *****************************************************************************/
 PUBLIC void clock_handler(int irq)
 {
-	if (++ticks >= MAX_TICKS)
-		ticks = 0;
+	clock_account();
+	queue_work(&clock_work[cpu_id()]);
+}
 
-	if (p_proc_ready->ticks)
-		p_proc_ready->ticks--;
+/* <Ring 0> what the clock event was for, once its handler has returned */
+PRIVATE void do_clock(struct work * w)
+{
+	int woken = 0;
 
-	if (key_pressed)
-		inform_int(TASK_TTY);
+	if (cpu_id() == 0) {
+		/* TASK_SYS answers the sleepers, see usleep() */
+		woken = expire_alarms();
+		if (woken)
+			inform_int(TASK_SYS);
 
-	if (k_reenter != 0) {
-		return;
+		if ((u32)(ticks - balanced) >= BALANCE_TICKS) {
+			balance();
+			balanced = ticks;
+		}
 	}
 
-	if (p_proc_ready->ticks > 0) {
+	/* an idle CPU may have been given a proc by balance() */
+	if (woken || p_proc_ready->ticks == 0 ||
+	    p_proc_ready == &idle_proc[cpu_id()])
+		schedule();	/* sets the next clock event */
+	else
+		clock_rearm();
+}
+
+/*****************************************************************************
+ *                                clock_account
+ *****************************************************************************/
+/**
+ * <Ring 0> Count the ticks gone since the last call and charge them to
+ * the running proc's quantum. Called before it may lose the CPU.
+ *****************************************************************************/
+PUBLIC void clock_account()
+{
+	u32 eflags = save_int();
+	int cpu = cpu_id();
+	u64 d = read_tsc() - tick_tsc[cpu];
+	u32 n = (d >> 32) ? 0xFFFFFFFF / tsc_per_tick : (u32)d / tsc_per_tick;
+
+	if (!n) {
+		restore_int(eflags);
 		return;
 	}
 
-	schedule();
+	tick_tsc[cpu] += (u64)n * tsc_per_tick;
+	if (cpu == 0) {
+		ticks += n;
+		if (ticks >= MAX_TICKS)
+			ticks -= MAX_TICKS;
+		KDATA->ticks = ticks;
+	}
+
+	p_proc_ready->ticks -= min(n, p_proc_ready->ticks);
+	restore_int(eflags);
+}
+
+/*****************************************************************************
+ *                                clock_rearm
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Set the clock event for the end of the running proc's
+ * quantum, or for the first alarm if it comes before. Called whenever
+ * either changes. An idle CPU has no quantum to end: it sleeps until the
+ * alarm, or the next balance() for CPU 0, or at most max_us.
+ *****************************************************************************/
+PUBLIC void clock_rearm()
+{
+	u32 eflags = save_int();
+	int cpu = cpu_id();
+	u64 now = read_tsc();
+	u64 at = tick_tsc[cpu] + (u64)max(p_proc_ready->ticks, 1) * tsc_per_tick;
+	u32 us = clockevent->max_us;
+
+	if (cpu == 0 && next_alarm && next_alarm < at)
+		at = next_alarm;
+	if (cpu == 0 && nr_cpus > 1 && p_proc_ready == &idle_proc[0]) {
+		u32 gone = min((u32)(ticks - balanced), BALANCE_TICKS);
+		at = min(at, tick_tsc[0] +
+			 (u64)(BALANCE_TICKS - gone) * tsc_per_tick);
+	}
+
+	if (at <= now)
+		us = 1;
+	else if (at - now < (u64)us * tsc_per_us)	/* round up */
+		us = ((u32)(at - now) + tsc_per_us - 1) / tsc_per_us;
+
+	clockevent->set_next(us);
+	restore_int(eflags);
+}
+
+/*****************************************************************************
+ *                                set_alarm
+ *****************************************************************************/
+/**
+ * <Ring 1, TASK_SYS> Have TASK_SYS informed when a proc's sleep is over.
+ * 
+ * @param pid  The proc sleeping.
+ * @param us   For how long, in microseconds.
+ *****************************************************************************/
+PUBLIC void set_alarm(int pid, u32 us)
+{
+	disable_int();
+	alarms[pid] = read_tsc() + (u64)us * tsc_per_us;
+	if (!next_alarm || alarms[pid] < next_alarm) {
+		next_alarm = alarms[pid];
+		clock_rearm();	/* sooner than the clock event, maybe */
+	}
+	enable_int();
+}
+
+/*****************************************************************************
+ *                                get_expired_alarm
+ *****************************************************************************/
+/**
+ * <Ring 1, TASK_SYS> Take an alarm that is up.
+ * 
+ * @return The proc whose alarm it was, -1 if none is up.
+ *****************************************************************************/
+PUBLIC int get_expired_alarm()
+{
+	int i;
+
+	disable_int();
+	u64 now = read_tsc();
+	for (i = 0; i < NR_TASKS + NR_PROCS; i++)
+		if (alarms[i] && alarms[i] <= now) {
+			alarms[i] = 0;
+			break;
+		}
+	enable_int();
 
+	return i < NR_TASKS + NR_PROCS ? i : -1;
+}
+
+/*****************************************************************************
+ *                                usleep
+ *****************************************************************************/
+/**
+ * <Ring 1~3> Sleep, other procs have the CPU meanwhile. Not for TASK_SYS,
+ * which wakes the sleepers up.
+ * 
+ * @param usec How many microseconds to sleep.
+ *****************************************************************************/
+PUBLIC void usleep(int usec)
+{
+	MESSAGE msg;
+
+	msg.type  = SLEEP;
+	msg.USECS = usec;
+	send_recv(BOTH, TASK_SYS, &msg);
 }
 
 /*****************************************************************************
@@ -55,27 +270,133 @@ PUBLIC void clock_handler(int irq)
  *****************************************************************************/
 PUBLIC void milli_delay(int milli_sec)
 {
-        int t = get_ticks();
-
-        while(((get_ticks() - t) * 1000 / HZ) < milli_sec) {}
+	usleep(milli_sec * 1000);
 }
 
 /*****************************************************************************
  *                                init_clock
  *****************************************************************************/
 /**
- * <Ring 0> Initialize 8253/8254 PIT (Programmable Interval Timer).
+ * <Ring 0> Take the local APIC timer for the clock event, or the PIT if
+ * there is no local APIC, and set it for the first proc.
  * 
  *****************************************************************************/
 PUBLIC void init_clock()
 {
-        /* 初始化 8253 PIT */
-        out_byte(TIMER_MODE, RATE_GENERATOR);
-        out_byte(TIMER0, (u8) (TIMER_FREQ/HZ) );
-        out_byte(TIMER0, (u8) ((TIMER_FREQ/HZ) >> 8));
+	int i;
+
+	init_time();
+	for (i = 0; i < NR_CPUS; i++)
+		clock_work[i].func = do_clock;
+
+	u32 khz = KDATA->tsc_khz;
+	if (khz < 1000)
+		panic("cannot time the TSC");
+	tsc_per_us   = khz / 1000;
+	tsc_per_tick = khz * (1000 / HZ);
+	tick_tsc[0]  = KDATA->boot_tsc;
+
+	lapic_khz = init_lapic_timer(khz);
+	if (lapic_khz >= 1000) {
+		/* the count must not overflow, see lapic_set_next() */
+		lapic_event.max_us = min(EVENT_MAX_US,
+					 0xFFFFFFFF / (lapic_khz / 1000 + 1));
+		clockevent = &lapic_event;
+	}
+	else {
+		clockevent = &pit_event;
+		put_irq_handler(CLOCK_IRQ, clock_handler);
+		enable_irq(CLOCK_IRQ);
+	}
+
+	clock_rearm();
+}
+
+/* nonzero if every CPU has a clock event, its local APIC timer */
+PUBLIC int clock_per_cpu()
+{
+	return clockevent == &lapic_event;
+}
+
+/* <Ring 0> the clock of another CPU, see ap_main() */
+PUBLIC void init_clock_cpu()
+{
+	tick_tsc[cpu_id()] = read_tsc();
+}
+
+PRIVATE int read_register(char reg_addr)
+{
+	out_byte(CLK_ELE, reg_addr);
+	return in_byte(CLK_IO);
+}
+
+/* days from 1970-01-01 to the date */
+PRIVATE int days_since_epoch(int y, int m, int d)
+{
+	/* years start in March here, Feb 29 is the last day of one */
+	y -= m <= 2;
+	int era = y / 400;
+	int yoe = y - era * 400;
+	int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
 
-        put_irq_handler(CLOCK_IRQ, clock_handler);    /* 设定时钟中断处理程序 */
-        enable_irq(CLOCK_IRQ);                        /* 让8259A可以接收时钟中断 */
+	return era * 146097 + doe - 719468;
 }
 
+/* TSC cycles per ms, counted while PIT channel 2 runs down CALIBRATE_MS */
+PRIVATE u32 calibrate_tsc()
+{
+	u16 latch = TIMER_FREQ * CALIBRATE_MS / 1000;
+
+	out_byte(PORT_B, (in_byte(PORT_B) & ~PORT_B_SPKR) | PORT_B_GATE2);
+	out_byte(TIMER_MODE, TIMER2_ONESHOT);
+	out_byte(TIMER2, (u8)latch);
+	out_byte(TIMER2, (u8)(latch >> 8));
+
+	u64 start = read_tsc();
+	while (!(in_byte(PORT_B) & PORT_B_OUT2))	/* up when it is 0 */
+		;
+	return (u32)(read_tsc() - start) / CALIBRATE_MS;
+}
 
+/*****************************************************************************
+ *                                init_time
+ *****************************************************************************/
+/**
+ * <Ring 0> Read the wall clock from the RTC, once, and tie it to the TSC:
+ * procs get the time from the TSC and the kernel data page, see
+ * clock_gettime(). Nobody else touches the CMOS.
+ *****************************************************************************/
+PRIVATE void init_time()
+{
+	struct time t;
+
+	KDATA->tsc_khz = calibrate_tsc();
+
+	/* the registers may be half updated while UIP is set, there are
+	 * 244us left once it is clear */
+	while (read_register(CLK_UPDATE) & 0x80)
+		;
+
+	t.year = read_register(YEAR);
+	t.month = read_register(MONTH);
+	t.day = read_register(DAY);
+	t.hour = read_register(HOUR);
+	t.minute = read_register(MINUTE);
+	t.second = read_register(SECOND);
+
+	if ((read_register(CLK_STATUS) & 0x04) == 0) {
+		t.year = BCD_TO_DEC(t.year);
+		t.month = BCD_TO_DEC(t.month);
+		t.day = BCD_TO_DEC(t.day);
+		t.hour = BCD_TO_DEC(t.hour);
+		t.minute = BCD_TO_DEC(t.minute);
+		t.second = BCD_TO_DEC(t.second);
+	}
+
+	t.year += 2000;
+
+	KDATA->boot_tsc = read_tsc();
+	KDATA->boot_time = days_since_epoch(t.year, t.month, t.day) * 86400 +
+		t.hour * 3600 + t.minute * 60 + t.second;
+}
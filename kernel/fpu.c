@@ -0,0 +1,254 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   kernel/fpu.c
+ * @brief  The FPU and SSE registers, switched lazily between procs.
+ *
+ * A proc gets a save area (an FXSAVE image) the first time it uses the
+ * FPU. restart() sets CR0.TS for every proc but fpu_owner, the one whose
+ * state is in the registers, so the first FPU instruction of another proc
+ * raises #NM. Only then is the owner's state saved and the proc's loaded
+ * (see fpu_handler()). Procs that never touch the FPU cost nothing.
+ *
+ * With more than one CPU the state is saved as soon as its proc leaves the
+ * CPU (see fpu_release()): the proc may go on on another one.
+ *
+ * The kernel and the tasks must not use the FPU themselves.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+#include "slab.h"
+
+#define	FPU_STATE_SIZE	512	/* FXSAVE image, FNSAVE takes 108 of it */
+
+#define	CPUID_FXSR	(1 << 24)
+#define	CPUID_SSE	(1 << 25)
+
+#define	CR0_MP		0x2
+#define	CR0_EM		0x4
+#define	CR0_TS		0x8
+#define	CR0_NE		0x20
+#define	CR4_OSFXSR	0x200
+#define	CR4_OSXMMEXCPT	0x400
+
+/* 16-byte aligned, as FXSAVE wants, see SLAB_OBJS() */
+PRIVATE struct kmem_cache	fpu_cache = KMEM_CACHE("fpu", FPU_STATE_SIZE);
+
+/* what a proc starts with */
+PRIVATE u8	fpu_init_state[FPU_STATE_SIZE] __attribute__((aligned(16)));
+PRIVATE int	has_fxsr;
+PRIVATE int	has_sse;
+
+PRIVATE void fpu_save_state(u8 * area)
+{
+	if (has_fxsr)
+		__asm__ __volatile__("fxsave %0" : "=m"(*area) :: "memory");
+	else
+		__asm__ __volatile__("fnsave %0\n\t"
+				     "fwait" : "=m"(*area) :: "memory");
+}
+
+PRIVATE void fpu_load_state(u8 * area)
+{
+	if (has_fxsr)
+		__asm__ __volatile__("fxrstor %0" :: "m"(*area));
+	else
+		__asm__ __volatile__("frstor %0" :: "m"(*area));
+}
+
+/* turn the FPU of this CPU on and reset it, CR0.TS clear */
+PRIVATE void fpu_on()
+{
+	__asm__ __volatile__("movl %%cr0, %%eax\n\t"
+			     "andl %0, %%eax\n\t"
+			     "orl %1, %%eax\n\t"
+			     "movl %%eax, %%cr0"
+			     :: "i"(~(CR0_EM | CR0_TS)), "i"(CR0_MP | CR0_NE)
+			     : "eax");
+	if (has_fxsr)
+		__asm__ __volatile__("movl %%cr4, %%eax\n\t"
+				     "orl %0, %%eax\n\t"
+				     "movl %%eax, %%cr4"
+				     :: "r"(CR4_OSFXSR |
+					    (has_sse ? CR4_OSXMMEXCPT : 0))
+				     : "eax");
+
+	__asm__ __volatile__("fninit");
+}
+
+/* nobody owns the FPU of this CPU, the first use traps */
+PRIVATE void fpu_off()
+{
+	fpu_owner = 0;
+	__asm__ __volatile__("movl %%cr0, %%eax\n\t"
+			     "orl %0, %%eax\n\t"
+			     "movl %%eax, %%cr0" :: "i"(CR0_TS) : "eax");
+}
+
+/*****************************************************************************
+ *                                init_fpu
+ *****************************************************************************/
+/**
+ * <Ring 0> Turn the FPU on, with SSE if there is FXSR, and take the state
+ * new procs start with. Nobody owns the FPU yet, so the first use traps.
+ *****************************************************************************/
+PUBLIC void init_fpu()
+{
+	u32 eax, ebx, ecx, edx;
+
+	__asm__ __volatile__("cpuid"
+			     : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+			     : "a"(1));
+	has_fxsr = edx & CPUID_FXSR;
+	has_sse	 = edx & CPUID_SSE;
+
+	fpu_on();
+	fpu_save_state(fpu_init_state);
+	fpu_off();
+}
+
+/* <Ring 0> the same for the FPU of another CPU, see ap_main() */
+PUBLIC void init_fpu_cpu()
+{
+	fpu_on();
+	fpu_off();
+}
+
+/*****************************************************************************
+ *                                fpu_handler
+ *****************************************************************************/
+/**
+ * <Ring 0> #NM: the current proc uses the FPU and does not own it. The
+ * owner's registers are saved, the proc's loaded, or the initial ones if
+ * this is its first use.
+ *****************************************************************************/
+PUBLIC void fpu_handler()
+{
+	struct proc * p = p_proc_ready;
+
+	if (k_reenter != 0)
+		panic("FPU used in the kernel");
+
+	__asm__ __volatile__("clts");
+	if (fpu_owner == p)
+		return;
+
+	if (fpu_owner)
+		fpu_save_state(fpu_owner->p_fpu);
+	fpu_owner = 0;
+
+	if (!p->p_fpu) {
+		p->p_fpu = kmem_alloc(&fpu_cache);
+		if (!p->p_fpu)
+			panic("no memory for the FPU state of %s", p->name);
+		memcpy(p->p_fpu, fpu_init_state, FPU_STATE_SIZE);
+	}
+	fpu_load_state(p->p_fpu);
+	fpu_owner = p;
+}
+
+/*****************************************************************************
+ *                                sys_save_fpu
+ *****************************************************************************/
+/**
+ * <Ring 0> Put the state in the FPU back into its owner's save area, for
+ * MM to copy it. The owner traps and reloads it on its next use.
+ *****************************************************************************/
+PUBLIC int sys_save_fpu(int _unused1, int _unused2, int _unused3,
+			struct proc * p)
+{
+	disable_int();
+	if (fpu_owner) {
+		__asm__ __volatile__("clts");
+		fpu_save_state(fpu_owner->p_fpu);
+		fpu_owner = 0;
+		/* restart() sets CR0.TS again */
+	}
+	enable_int();
+	return 0;
+}
+
+/*****************************************************************************
+ *                                fpu_release
+ *****************************************************************************/
+/**
+ * <Ring 0> Save the state of a proc leaving this CPU, if the registers have
+ * it, for it to go on anywhere. See schedule().
+ *
+ * @param p  The proc.
+ *****************************************************************************/
+PUBLIC void fpu_release(struct proc * p)
+{
+	if (fpu_owner != p)
+		return;
+
+	__asm__ __volatile__("clts");
+	fpu_save_state(p->p_fpu);
+	fpu_owner = 0;		/* restart() sets CR0.TS again */
+}
+
+/*****************************************************************************
+ *                                fpu_fork
+ *****************************************************************************/
+/**
+ * <Ring 1, TASK_MM> The child of a fork gets a copy of the parent's FPU
+ * state, if the parent has any.
+ *
+ * @param parent  PID of the parent.
+ * @param child   PID of the child.
+ *
+ * @return Zero if successful, -1 if out of memory.
+ *****************************************************************************/
+PUBLIC int fpu_fork(int parent, int child)
+{
+	struct proc * p = &proc_table[parent];
+	struct proc * c = &proc_table[child];
+
+	c->p_fpu = 0;
+	if (!p->p_fpu)
+		return 0;
+
+	c->p_fpu = kmem_alloc(&fpu_cache);
+	if (!c->p_fpu)
+		return -1;
+
+	save_fpu();	/* the registers may be newer than p->p_fpu */
+	memcpy(c->p_fpu, p->p_fpu, FPU_STATE_SIZE);
+	return 0;
+}
+
+/*****************************************************************************
+ *                                fpu_free
+ *****************************************************************************/
+/**
+ * <Ring 1, TASK_MM> Drop the FPU state of a proc, on exec and exit.
+ *
+ * @param pid  The proc, not running.
+ *****************************************************************************/
+PUBLIC void fpu_free(int pid)
+{
+	struct proc * p = &proc_table[pid];
+	u8 * area = p->p_fpu;
+
+	if (!area)
+		return;
+
+	disable_int();
+	if (fpu_owner == p)
+		fpu_owner = 0;
+	p->p_fpu = 0;
+	enable_int();
+
+	kmem_free(&fpu_cache, area);
+}
@@ -12,6 +12,7 @@
 #include "proc.h"
 #include "global.h"
 #include "proto.h"
+#include "slab.h"
 
 
 PUBLIC	struct proc proc_table[NR_TASKS + NR_PROCS];
@@ -24,7 +25,12 @@ PUBLIC	struct task	task_table[NR_TASKS] = {
 	{task_sys,      STACK_SIZE_SYS,   "SYS"       },
 	{task_hd,       STACK_SIZE_HD,    "HD"        },
 	{task_fs,       STACK_SIZE_FS,    "FS"        },
-	{task_mm,       STACK_SIZE_MM,    "MM"        }};
+	{task_mm,       STACK_SIZE_MM,    "MM"        },
+	{task_vblk,     STACK_SIZE_VBLK,  "VBLK"      },
+	{task_hd2,      STACK_SIZE_HD2,   "HD2"       },
+	{task_raid,     STACK_SIZE_RAID,  "RAID"      },
+	{task_rd,       STACK_SIZE_RD,    "RD"        },
+	{task_swap,     STACK_SIZE_SWAP,  "SWAP"      }};
 
 PUBLIC	struct task	user_proc_table[NR_NATIVE_PROCS] = {
 	/* entry    stack size     proc name */
@@ -46,7 +52,9 @@ PUBLIC	CONSOLE		console_table[NR_CONSOLES];
 PUBLIC	irq_handler	irq_table[NR_IRQ];
 
 PUBLIC	system_call	sys_call_table[NR_SYS_CALL] = {sys_printx,
-						       sys_sendrec};
+						       sys_sendrec,
+						       sys_flush_tlb,
+						       sys_save_fpu};
 
 /* FS related below */
 /*****************************************************************************/
@@ -64,8 +72,21 @@ struct dev_drv_map dd_map[] = {
 	{INVALID_DRIVER},	/**< 2 : Reserved for cdrom driver */
 	{TASK_HD},		/**< 3 : Hard disk */
 	{TASK_TTY},		/**< 4 : TTY */
-	{INVALID_DRIVER}	/**< 5 : Reserved for scsi disk driver */
+	{INVALID_DRIVER},	/**< 5 : Reserved for scsi disk driver */
+	{TASK_VBLK},		/**< 6 : virtio-blk disk */
+	{TASK_HD2},		/**< 7 : Hard disk, secondary channel */
+	{TASK_RAID},		/**< 8 : RAID-0 volume */
+	{TASK_RD}		/**< 9 : RAM disk */
 };
+/**
+ * FS tables, they grow with the nr. of open files (see kernel/slab.c).
+ */
+PUBLIC	struct kmem_cache	inode_cache =
+	KMEM_CACHE("inode", sizeof(struct inode));
+PUBLIC	struct kmem_cache	fdesc_cache =
+	KMEM_CACHE("file_desc", sizeof(struct file_desc));
+PUBLIC	struct kmem_cache	filp_cache =
+	KMEM_CACHE("filp", NR_FILES * sizeof(struct file_desc *));
 
 /**
  * 6MB~7MB: buffer for FS
@@ -11,21 +11,33 @@
 #include "proto.h"
 #include "hd.h"
 
-#define	DRV_OF_DEV(dev) (dev <= MAX_PRIM ? \
-			 dev / NR_PRIM_PER_DRIVE : \
-			 (dev - MINOR_hd1a) / NR_SUB_PER_DRIVE)
-
-PRIVATE	u8		hd_status;
-PRIVATE	u8		hdbuf[SECTOR_SIZE * 2];
-PRIVATE	struct hd_info	hd_info[1];
-
-
-PRIVATE int waitfor(int mask, int val, int timeout)
+/**
+ * Each ATA channel is served by its own task, so requests on the primary
+ * and the secondary channel are in flight at the same time. A channel
+ * has a master (drive 0) and a slave (drive 1).
+ */
+struct ata_chan {
+	int		task;		/* TASK_HD or TASK_HD2 */
+	int		cmd_base;	/* command block registers */
+	int		ctl_base;	/* control block registers */
+	int		irq;
+	u8		status;		/* status read by hd_handler() */
+	u8		buf[SECTOR_SIZE * 2];
+	struct hd_info	info[MAX_DRIVES];
+	struct io_stat	stat[MAX_DRIVES];
+};
+
+PRIVATE	struct ata_chan	ata_chan[NR_ATA_CHANNELS] = {
+	{TASK_HD,  ATA0_CMD_BASE, ATA0_CTL_BASE, AT_WINI_IRQ},
+	{TASK_HD2, ATA1_CMD_BASE, ATA1_CTL_BASE, AT_WINI2_IRQ}};
+
+
+PRIVATE int waitfor(struct ata_chan * ch, int mask, int val, int timeout)
 {
 	int t = get_ticks();
 
 	while(((get_ticks() - t) * 1000 / HZ) < timeout)
-		if ((in_byte(REG_STATUS) & mask) == val)
+		if ((in_byte(ch->cmd_base + REG_STATUS) & mask) == val)
 			return 1;
 
 	return 0;
@@ -37,47 +49,77 @@ PRIVATE void interrupt_wait()
 	send_recv(RECEIVE, INTERRUPT, &msg);
 }
 
-PRIVATE void hd_cmd_out(struct hd_cmd* cmd)
+PRIVATE void hd_cmd_out(struct ata_chan * ch, struct hd_cmd* cmd)
 {
+	int base = ch->cmd_base;
+
 	/**
 	 * For all commands, the host must first check if BSY=1,
 	 * and should proceed no further unless and until BSY=0
 	 */
-	if (!waitfor(STATUS_BSY, 0, HD_TIMEOUT))
+	if (!waitfor(ch, STATUS_BSY, 0, HD_TIMEOUT))
 		panic("hd error.");
 
 	/* Activate the Interrupt Enable (nIEN) bit */
-	out_byte(REG_DEV_CTRL, 0);
+	out_byte(ch->ctl_base + REG_DEV_CTRL, 0);
 	/* Load required parameters in the Command Block Registers */
-	out_byte(REG_FEATURES, cmd->features);
-	out_byte(REG_NSECTOR,  cmd->count);
-	out_byte(REG_LBA_LOW,  cmd->lba_low);
-	out_byte(REG_LBA_MID,  cmd->lba_mid);
-	out_byte(REG_LBA_HIGH, cmd->lba_high);
-	out_byte(REG_DEVICE,   cmd->device);
+	out_byte(base + REG_FEATURES, cmd->features);
+	out_byte(base + REG_NSECTOR,  cmd->count);
+	out_byte(base + REG_LBA_LOW,  cmd->lba_low);
+	out_byte(base + REG_LBA_MID,  cmd->lba_mid);
+	out_byte(base + REG_LBA_HIGH, cmd->lba_high);
+	out_byte(base + REG_DEVICE,   cmd->device);
 	/* Write the command code to the Command Register */
-	out_byte(REG_CMD,     cmd->command);
+	out_byte(base + REG_CMD,     cmd->command);
 }
 
-PRIVATE void init_hd()
+PRIVATE void init_hd(struct ata_chan * ch)
+{
+	if (ch->task == TASK_HD) {
+		/* Get the number of drives from the BIOS data area */
+		u8 * pNrDrives = (u8*)(0x475);
+		printl("{HD} NrDrives:%d.\n", *pNrDrives);
+		assert(*pNrDrives);
+	}
+
+	put_irq_handler(ch->irq, hd_handler);
+	enable_irq(CASCADE_IRQ);
+	enable_irq(ch->irq);
+
+	memset(ch->info, 0, sizeof(ch->info));
+}
+
+/*****************************************************************************
+ *                                hd_probe
+ *****************************************************************************/
+/**
+ * Select a drive and see whether anything answers, so that we never send
+ * IDENTIFY to an empty position (it would never interrupt).
+ * 
+ * @param ch     The channel.
+ * @param drive  0 (master) or 1 (slave).
+ * 
+ * @return Non-zero if the drive exists.
+ *****************************************************************************/
+PRIVATE int hd_probe(struct ata_chan * ch, int drive)
 {
 	int i;
 
-	/* Get the number of drives from the BIOS data area */
-	u8 * pNrDrives = (u8*)(0x475);
-	printl("{HD} NrDrives:%d.\n", *pNrDrives);
-	assert(*pNrDrives);
+	out_byte(ch->cmd_base + REG_DEVICE, MAKE_DEVICE_REG(0, drive, 0));
+	for (i = 0; i < 4; i++)	/* 400ns for the status to settle */
+		in_byte(ch->ctl_base + REG_ALT_STATUS);
 
-	put_irq_handler(AT_WINI_IRQ, hd_handler);
-	enable_irq(CASCADE_IRQ);
-	enable_irq(AT_WINI_IRQ);
+	u8 status = in_byte(ch->cmd_base + REG_STATUS);
+	if (status == 0 || status == 0xFF)	/* nobody / floating bus */
+		return 0;
 
-	for (i = 0; i < (sizeof(hd_info) / sizeof(hd_info[0])); i++)
-		memset(&hd_info[i], 0, sizeof(hd_info[0]));
-	hd_info[0].open_cnt = 0;
+	return waitfor(ch, STATUS_BSY, 0, HD_TIMEOUT);
 }
+
 PRIVATE void get_part_table(int drive, int sect_nr, struct part_ent * entry)
 {
+	/* called back by partition(), on behalf of the running channel task */
+	struct ata_chan * ch = &ata_chan[proc2pid(p_proc_ready) == TASK_HD ? 0 : 1];
 	struct hd_cmd cmd;
 	cmd.count = 1;
 	cmd.features = 0;
@@ -86,58 +128,14 @@ PRIVATE void get_part_table(int drive, int sect_nr, struct part_ent * entry)
 	cmd.lba_mid	= (sect_nr >>  8) & 0xFF;
 	cmd.lba_high	= (sect_nr >> 16) & 0xFF;
 	cmd.device	= MAKE_DEVICE_REG(1, drive, (sect_nr >> 24) & 0xF);
-	hd_cmd_out(&cmd);
+	hd_cmd_out(ch, &cmd);
 	interrupt_wait();
-	port_read(REG_DATA, hdbuf, SECTOR_SIZE);
+	port_read(ch->cmd_base + REG_DATA, ch->buf, SECTOR_SIZE);
 	memcpy(entry,
-	       hdbuf + PARTITION_TABLE_OFFSET,
+	       ch->buf + PARTITION_TABLE_OFFSET,
 	       sizeof(struct part_ent) * NR_PART_PER_DRIVE);
 }
 
-PRIVATE void partition(int device, int style)
-{
-	int i;
-	int drive = DRV_OF_DEV(device);
-	struct hd_info * hdi = &hd_info[drive];
-	struct part_ent part_tbl[NR_SUB_PER_DRIVE];
-
-	if (style == P_PRIMARY) {
-		get_part_table(drive, drive, part_tbl);
-
-		int nr_prim_parts = 0;
-		for (i = 0; i < NR_PART_PER_DRIVE; i++) { /* 0~3 */
-			if (part_tbl[i].sys_id == NO_PART) continue;
-
-			nr_prim_parts++;
-			int dev_nr = i + 1;		  /* 1~4 */
-			hdi->primary[dev_nr].size = part_tbl[i].nr_sects;
-			hdi->primary[dev_nr].base = part_tbl[i].start_sect;
-
-			if (part_tbl[i].sys_id == EXT_PART) partition(device + dev_nr, P_EXTENDED);
-		}
-		assert(nr_prim_parts != 0);
-	}
-	else if (style == P_EXTENDED) {
-		int j = device % NR_PRIM_PER_DRIVE; /* 1~4 */
-		int ext_start_sect = hdi->primary[j].base;
-		int s = ext_start_sect;
-		int nr_1st_sub = (j - 1) * NR_SUB_PER_PART; /* 0/16/32/48 */
-
-		for (i = 0; i < NR_SUB_PER_PART; i++) {
-			int dev_nr = nr_1st_sub + i;/* 0~15/16~31/32~47/48~63 */
-
-			get_part_table(drive, s, part_tbl);
-			hdi->logical[dev_nr].size = part_tbl[0].nr_sects;
-			hdi->logical[dev_nr].base = s + part_tbl[0].start_sect;
-			s = ext_start_sect + part_tbl[1].start_sect;
-			if (part_tbl[1].sys_id == NO_PART) break;
-		}
-	}
-	else {
-		assert(0);
-	}
-}
-
 PRIVATE void print_identify_info(u16* hdinfo)
 {
 	int i, k;
@@ -168,70 +166,101 @@ PRIVATE void print_identify_info(u16* hdinfo)
 	printl("{HD} HD size: %dMB\n", sectors * 512 / 1000000);
 }
 
-PRIVATE void hd_identify(int drive)
+PRIVATE void hd_identify(struct ata_chan * ch, int drive)
 {
 	struct hd_cmd cmd;
 	cmd.command = ATA_IDENTIFY;
 	cmd.device  = MAKE_DEVICE_REG(0, drive, 0);
-	hd_cmd_out(&cmd);
+	hd_cmd_out(ch, &cmd);
 	interrupt_wait();
-	port_read(REG_DATA, hdbuf, SECTOR_SIZE);
-	print_identify_info((u16*)hdbuf);
+	port_read(ch->cmd_base + REG_DATA, ch->buf, SECTOR_SIZE);
+	print_identify_info((u16*)ch->buf);
 
-	u16* hdinfo = (u16*)hdbuf;
+	u16* hdinfo = (u16*)ch->buf;
 
-	hd_info[drive].primary[0].base = 0;
-	hd_info[drive].primary[0].size = ((int)hdinfo[61] << 16) + hdinfo[60];
+	ch->info[drive].primary[0].base = 0;
+	ch->info[drive].primary[0].size = ((int)hdinfo[61] << 16) + hdinfo[60];
 }
 
-PRIVATE void hd_open(int device)
+/*****************************************************************************
+ *                                hd_open
+ *****************************************************************************/
+/**
+ * <Ring 1> Open a device: identify the drive and read its partition
+ * tables the first time.
+ * 
+ * @param ch      The channel.
+ * @param device  The minor device nr.
+ * 
+ * @return Zero on success, -1 if the drive or the partition is absent.
+ *****************************************************************************/
+PRIVATE int hd_open(struct ata_chan * ch, int device)
 {
-	int drive = DRV_OF_DEV(device);
-	assert(drive == 0);	/* only one drive */
+	if (!valid_minor(device))
+		return -1;
 
-	hd_identify(drive);
-
-	if (hd_info[drive].open_cnt++ == 0) {
-		partition(drive * (NR_PART_PER_DRIVE + 1), P_PRIMARY);
+	int drive = DRV_OF_DEV(device);
+	if (ch->info[drive].open_cnt == 0) {
+		if (!hd_probe(ch, drive)) {
+			printl("{HD} no drive at %x/%d\n", ch->cmd_base, drive);
+			return -1;
+		}
+		hd_identify(ch, drive);
+		partition(&ch->info[drive], drive * (NR_PART_PER_DRIVE + 1),
+			  P_PRIMARY, get_part_table);
+	}
+	if (get_part_info(&ch->info[drive], device)->size == 0) {
+		printl("{HD} no partition %d at %x/%d\n",
+		       device, ch->cmd_base, drive);
+		return -1;
 	}
+	ch->info[drive].open_cnt++;
+
+	return 0;
 }
 
-PRIVATE void hd_close(int device)
+PRIVATE void hd_close(struct ata_chan * ch, int device)
 {
 	int drive = DRV_OF_DEV(device);
-	assert(drive == 0);	/* only one drive */
+	assert(drive < MAX_DRIVES);
 
-	hd_info[drive].open_cnt--;
+	ch->info[drive].open_cnt--;
 }
 
-PRIVATE void hd_cmd_init(MESSAGE * p, u32 sect_nr)
-{
-	struct hd_cmd cmd;
-	cmd.features	= 0;
-	cmd.count	= (p->CNT + SECTOR_SIZE - 1) / SECTOR_SIZE;
-	cmd.lba_low	= sect_nr & 0xFF;
-	cmd.lba_mid	= (sect_nr >>  8) & 0xFF;
-	cmd.lba_high	= (sect_nr >> 16) & 0xFF;
-	cmd.device	= MAKE_DEVICE_REG(1, DRV_OF_DEV(p->DEVICE), (sect_nr >> 24) & 0xF);
-	cmd.command	= (p->type == DEV_READ) ? ATA_READ : ATA_WRITE;
-}
-
-PRIVATE void hd_rdwt(MESSAGE * p)
+/*****************************************************************************
+ *                                hd_rdwt
+ *****************************************************************************/
+/**
+ * Serve DEV_READ/DEV_WRITE. The caller's buffer is pinned meanwhile.
+ * 
+ * @param ch  The channel.
+ * @param p   The message.
+ * 
+ * @return Zero if successful, -1 if the drive reported an error or the
+ *         buffer could not be brought in.
+ *****************************************************************************/
+PRIVATE int hd_rdwt(struct ata_chan * ch, MESSAGE * p)
 {
 	int drive = DRV_OF_DEV(p->DEVICE);
+	int err = 0;
+	struct io_stamp stamp;
+
+	io_begin(&stamp);
 
 	u64 pos = p->POSITION;
 	assert((pos >> SECTOR_SIZE_SHIFT) < (1 << 31));
 	assert((pos & 0x1FF) == 0);
 
 	u32 sect_nr = (u32)(pos >> SECTOR_SIZE_SHIFT); /* pos / SECTOR_SIZE */
-	int logidx = (p->DEVICE - MINOR_hd1a) % NR_SUB_PER_DRIVE;
-	sect_nr += p->DEVICE < MAX_PRIM ?
-		hd_info[drive].primary[p->DEVICE].base :
-		hd_info[drive].logical[logidx].base;
+	sect_nr += get_part_info(&ch->info[drive], p->DEVICE)->base;
+
+	u8 * buf = (u8*)va2la(p->PROC_NR, p->BUF);
+	if (pin_pages((u32)buf, p->CNT, p->type == DEV_READ) != 0) {
+		io_end(&ch->stat[drive], p, &stamp, 1);
+		return -1;
+	}
 
 	struct hd_cmd cmd;
-	hd_cmd_init(p, sect_nr);
 	cmd.features	= 0;
 	cmd.lba_low	= sect_nr & 0xFF;
 	cmd.lba_mid	= (sect_nr >>  8) & 0xFF;
@@ -239,64 +268,85 @@ PRIVATE void hd_rdwt(MESSAGE * p)
 	cmd.count	= (p->CNT + SECTOR_SIZE - 1) / SECTOR_SIZE;
 	cmd.command	= (p->type == DEV_READ) ? ATA_READ : ATA_WRITE;
 	cmd.device	= MAKE_DEVICE_REG(1, drive, (sect_nr >> 24) & 0xF);
-	hd_cmd_out(&cmd);
+	hd_cmd_out(ch, &cmd);
 
 	int bytes_left = p->CNT;
-	void * la = (void*)va2la(p->PROC_NR, p->BUF);
+	u8 * la = buf;
 
 	while (bytes_left) {
 		int bytes = min(SECTOR_SIZE, bytes_left);
 		if (p->type == DEV_READ) {
 			interrupt_wait();
-			port_read(REG_DATA, hdbuf, SECTOR_SIZE);
-			phys_copy(la, (void*)va2la(TASK_HD, hdbuf), bytes);
+			port_read(ch->cmd_base + REG_DATA, ch->buf, SECTOR_SIZE);
+			phys_copy(la, (void*)va2la(ch->task, ch->buf), bytes);
 		}
 		else {
-			if (!waitfor(STATUS_DRQ, STATUS_DRQ, HD_TIMEOUT)) panic("hd writing error.");
-			port_write(REG_DATA, la, bytes);
+			if (!waitfor(ch, STATUS_DRQ, STATUS_DRQ, HD_TIMEOUT)) panic("hd writing error.");
+			port_write(ch->cmd_base + REG_DATA, la, bytes);
 			interrupt_wait();
 		}
+		if (ch->status & STATUS_ERR)
+			err = 1;
 		bytes_left -= SECTOR_SIZE;
 		la += SECTOR_SIZE;
 	}
+
+	unpin_pages((u32)buf, p->CNT);
+	io_end(&ch->stat[drive], p, &stamp, err);
+
+	return err ? -1 : 0;
 }
 
-PRIVATE void hd_ioctl(MESSAGE * p)
+/*****************************************************************************
+ *                                hd_ioctl
+ *****************************************************************************/
+/**
+ * Serve DEV_IOCTL. The minor may come from a proc, see iostat().
+ * 
+ * @param ch  The channel.
+ * @param p   The message.
+ * 
+ * @return Zero if successful, -1 if there is no such device.
+ *****************************************************************************/
+PRIVATE int hd_ioctl(struct ata_chan * ch, MESSAGE * p)
 {
 	int device = p->DEVICE;
+
+	if (!valid_minor(device))
+		return -1;
+
 	int drive = DRV_OF_DEV(device);
-	struct hd_info * hdi = &hd_info[drive];
-
-	if (p->REQUEST == DIOCTL_GET_GEO) {
-		void * dst = va2la(p->PROC_NR, p->BUF);
-		void * src = va2la(TASK_HD,
-				   device < MAX_PRIM ?
-				   &hdi->primary[device] :
-				   &hdi->logical[(device - MINOR_hd1a) %
-						NR_SUB_PER_DRIVE]);
-		phys_copy(dst, src, sizeof(struct part_info));
-	}
-	else {
-		assert(0);
-	}
+	struct hd_info * hdi = &ch->info[drive];
+
+	void * dst = va2la(p->PROC_NR, p->BUF);
+
+	if (p->REQUEST == DIOCTL_GET_GEO)
+		return pinned_copy(dst,
+				   va2la(ch->task, get_part_info(hdi, device)),
+				   sizeof(struct part_info));
+	else if (p->REQUEST == DIOCTL_GET_STAT)
+		return pinned_copy(dst, va2la(ch->task, &ch->stat[drive]),
+				   sizeof(struct io_stat));
+
+	assert(0);
+	return -1;
 }
 
-/*public function*/
-PUBLIC void task_hd()
+PRIVATE void hd_main(struct ata_chan * ch)
 {
 	MESSAGE msg;
 
-	init_hd();
+	init_hd(ch);
 
 	while (1) {
 		send_recv(RECEIVE, ANY, &msg);
 		int src = msg.source;
 
 		switch (msg.type) {
-		case DEV_CLOSE: hd_close(msg.DEVICE); break;
-		case DEV_IOCTL: hd_ioctl(&msg); break;
-		case DEV_READ: case DEV_WRITE: hd_rdwt(&msg); break;
-		case DEV_OPEN: hd_open(msg.DEVICE); break;
+		case DEV_CLOSE: hd_close(ch, msg.DEVICE); break;
+		case DEV_IOCTL: msg.RETVAL = hd_ioctl(ch, &msg); break;
+		case DEV_READ: case DEV_WRITE: msg.RETVAL = hd_rdwt(ch, &msg); break;
+		case DEV_OPEN: msg.RETVAL = hd_open(ch, msg.DEVICE); break;
 		default:
 			dump_msg("HD driver::unknown msg", &msg);
 			spin("FS::main_loop (invalid msg.type)");
@@ -307,8 +357,21 @@ PUBLIC void task_hd()
 	}
 }
 
+/*public function*/
+PUBLIC void task_hd()
+{
+	hd_main(&ata_chan[0]);
+}
+
+PUBLIC void task_hd2()
+{
+	hd_main(&ata_chan[1]);
+}
+
 PUBLIC void hd_handler(int irq)
 {
-	hd_status = in_byte(REG_STATUS);
-	inform_int(TASK_HD);
+	struct ata_chan * ch = &ata_chan[irq == AT_WINI_IRQ ? 0 : 1];
+
+	ch->status = in_byte(ch->cmd_base + REG_STATUS);
+	defer_int(ch->task);
 }
@@ -54,3 +54,41 @@ PUBLIC void put_irq_handler(int irq, irq_handler handler)
 	disable_irq(irq);
 	irq_table[irq] = handler;
 }
+
+/*======================================================================*
+                           disable_irq
+ *----------------------------------------------------------------------*
+ Mask an IRQ, at the 8259A or at the I/O APIC (see init_apic)
+ *======================================================================*/
+PUBLIC void disable_irq(int irq)
+{
+	if (apic_irqs) {
+		ioapic_mask(irq, 1);
+		return;
+	}
+
+	u32 eflags = save_int();
+	if (irq < 8)
+		out_byte(INT_M_CTLMASK, in_byte(INT_M_CTLMASK) | (1 << irq));
+	else
+		out_byte(INT_S_CTLMASK, in_byte(INT_S_CTLMASK) | (1 << (irq - 8)));
+	restore_int(eflags);
+}
+
+/*======================================================================*
+                           enable_irq
+ *======================================================================*/
+PUBLIC void enable_irq(int irq)
+{
+	if (apic_irqs) {
+		ioapic_mask(irq, 0);
+		return;
+	}
+
+	u32 eflags = save_int();
+	if (irq < 8)
+		out_byte(INT_M_CTLMASK, in_byte(INT_M_CTLMASK) & ~(1 << irq));
+	else
+		out_byte(INT_S_CTLMASK, in_byte(INT_S_CTLMASK) & ~(1 << (irq - 8)));
+	restore_int(eflags);
+}
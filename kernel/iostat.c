@@ -0,0 +1,67 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   kernel/iostat.c
+ * @brief  I/O accounting shared by the block drivers.
+ *
+ * A driver calls io_begin() right after it got a DEV_READ/DEV_WRITE and
+ * io_end() before replying. Times are TSC cycles, kept in log2 buckets.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+PRIVATE int log2_bucket(u32 v)
+{
+	int b = 0;
+	while (v >>= 1)
+		b++;
+	return b;
+}
+
+/*****************************************************************************
+ *                                io_begin
+ *****************************************************************************/
+/**
+ * <Ring 1> Stamp the request just received by the calling driver.
+ *
+ * @param s  Where to keep the stamps until io_end().
+ *****************************************************************************/
+PUBLIC void io_begin(struct io_stamp * s)
+{
+	s->wait  = p_proc_ready->p_recv_wait;
+	s->start = (u32)read_tsc();
+}
+
+/*****************************************************************************
+ *                                io_end
+ *****************************************************************************/
+/**
+ * <Ring 1> Account a finished request.
+ *
+ * @param st   Statistics of the device.
+ * @param p    The DEV_READ/DEV_WRITE message.
+ * @param s    Stamps from io_begin().
+ * @param err  Non-zero if the request failed.
+ *****************************************************************************/
+PUBLIC void io_end(struct io_stat * st, MESSAGE * p, struct io_stamp * s,
+		   int err)
+{
+	struct io_dir_stat * d = (p->type == DEV_READ) ? &st->rd : &st->wt;
+
+	d->reqs++;
+	d->sects += (p->CNT + SECTOR_SIZE - 1) >> SECTOR_SIZE_SHIFT;
+	if (err)
+		d->errors++;
+	d->wait_hist[log2_bucket(s->wait)]++;
+	d->svc_hist[log2_bucket((u32)read_tsc() - s->start)]++;
+}
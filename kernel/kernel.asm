@@ -12,8 +12,15 @@
 extern	cstart
 extern	kernel_main
 extern	exception_handler
+extern	page_fault_handler
+extern	fpu_handler
 extern	spurious_irq
 extern	clock_handler
+extern	lapic_eoi
+extern	apic_irqs
+extern	resched_handler
+extern	run_work
+extern	ap_main
 extern	disp_str
 extern	delay
 extern	irq_table
@@ -21,11 +28,12 @@ extern	irq_table
 ; 导入全局变量
 extern	gdt_ptr
 extern	idt_ptr
-extern	p_proc_ready
-extern	tss
 extern	disp_pos
-extern	k_reenter
 extern	sys_call_table
+extern	cpus
+extern	kernel_lock
+extern	kernel_owner
+extern	ap_count
 
 bits 32
 
@@ -42,6 +50,7 @@ global _start	; 导出 _start
 
 global restart
 global sys_call
+global sys_enter
 
 global	divide_error
 global	single_step_exception
@@ -59,6 +68,7 @@ global	stack_exception
 global	general_protection
 global	page_fault
 global	copr_error
+global	simd_exception
 global	hwint00
 global	hwint01
 global	hwint02
@@ -75,6 +85,15 @@ global	hwint12
 global	hwint13
 global	hwint14
 global	hwint15
+global	lapic_timer
+global	apic_spurious
+global	resched_ipi
+global	tlb_ipi
+global	cpu_idle
+global	ap_trampoline
+global	ap_trampoline_end
+global	tr_cr0
+global	tr_cr4
 
 
 _start:
@@ -174,16 +193,84 @@ csinit:		; “这个跳转指令强制使用刚刚初始化的结构”——<<O
 	mov	ax, SELECTOR_TSS
 	ltr	ax
 
+	mov	dword [cpus + CPU_STACKTOP], StackTop	; of CPU 0
+
 	;sti
 	jmp	kernel_main
 
 	;hlt
 
 
+; ---------------------------------
+; %1 = &cpus[cpu_id()], this CPU's struct cpu, see cpu_id() in kliba.asm
+%macro	this_cpu	1
+	str	%1
+	and	%1, 0FFFFh
+	sub	%1, INDEX_TSS << 3
+	shl	%1, CPU_SHIFT - 3
+	add	%1, cpus
+%endmacro
+
+; take kernel_lock as lock_kernel() in smp.c does, with ebp the CPU; edi is
+; lost. While it spins, the TLB shootdown it may be asked for is done here.
+%macro	take_kernel_lock	0
+	cmp	[kernel_owner], ebp
+	jne	%%spin
+	inc	dword [ebp + CPU_LOCK_DEPTH]	; a task faulted holding it
+	jmp	%%done
+%%spin:
+	mov	edi, 1
+	xchg	edi, [kernel_lock]
+	test	edi, edi
+	jz	%%locked
+%%wait:
+	pause
+	cmp	dword [ebp + CPU_FLUSH], 0
+	je	%%no_flush
+	mov	edi, cr3
+	mov	cr3, edi
+	mov	dword [ebp + CPU_FLUSH], 0
+%%no_flush:
+	cmp	dword [kernel_lock], 0
+	jne	%%wait
+	jmp	%%spin
+%%locked:
+	mov	[kernel_owner], ebp
+%%done:
+%endmacro
+
+; give kernel_lock back, with ebp the CPU
+%macro	give_kernel_lock	0
+	cmp	dword [ebp + CPU_LOCK_DEPTH], 0
+	je	%%release
+	dec	dword [ebp + CPU_LOCK_DEPTH]
+	jmp	%%done
+%%release:
+	mov	dword [kernel_owner], 0
+	mov	dword [kernel_lock], 0
+%%done:
+%endmacro
+
+
 ; 中断和异常 -- 硬件中断
 ; ---------------------------------
+; the local APIC takes no interrupt of the class being served before the
+; EOI, the IRQ is not masked
+%macro	hwint_apic	1
+	sti
+	push	%1
+	call	[irq_table + 4 * %1]
+	pop	ecx
+	cli
+	call	lapic_eoi
+	ret
+%endmacro
+; ---------------------------------
+
 %macro	hwint_master	1
 	call	save
+	cmp	dword [apic_irqs], 0
+	jne	%%apic
 	in	al, INT_M_CTLMASK	; `.
 	or	al, (1 << %1)		;  | 屏蔽当前中断
 	out	INT_M_CTLMASK, al	; /
@@ -198,6 +285,8 @@ csinit:		; “这个跳转指令强制使用刚刚初始化的结构”——<<O
 	and	al, ~(1 << %1)		;  | 恢复接受当前中断
 	out	INT_M_CTLMASK, al	; /
 	ret
+%%apic:
+	hwint_apic	%1
 %endmacro
 
 
@@ -236,6 +325,8 @@ hwint07:		; Interrupt routine for irq 7 (printer)
 ; ---------------------------------
 %macro	hwint_slave	1
 	call	save
+	cmp	dword [apic_irqs], 0
+	jne	%%apic
 	in	al, INT_S_CTLMASK	; `.
 	or	al, (1 << (%1 - 8))	;  | 屏蔽当前中断
 	out	INT_S_CTLMASK, al	; /
@@ -252,6 +343,8 @@ hwint07:		; Interrupt routine for irq 7 (printer)
 	and	al, ~(1 << (%1 - 8))	;  | 恢复接受当前中断
 	out	INT_S_CTLMASK, al	; /
 	ret
+%%apic:
+	hwint_apic	%1
 %endmacro
 ; ---------------------------------
 
@@ -287,6 +380,61 @@ ALIGN	16
 hwint15:		; Interrupt routine for irq 15
 	hwint_slave	15
 
+; ---------------------------------
+ALIGN	16
+lapic_timer:		; the local APIC timer, see kernel/apic.c
+	call	save
+	sti
+	push	0			; CLOCK_IRQ
+	call	clock_handler
+	pop	ecx
+	cli
+	call	lapic_eoi
+	ret
+
+ALIGN	16
+apic_spurious:		; no EOI for these
+	iretd
+
+ALIGN	16
+resched_ipi:		; an idle CPU has a proc to run, see kick_cpu()
+	call	save
+	call	resched_handler
+	call	lapic_eoi
+	ret
+
+; the TLB shootdown, see tlb_shootdown(). Without save: the few pushes land
+; in the frame of the proc running, which nothing reads while it runs.
+ALIGN	16
+tlb_ipi:
+	push	ds
+	push	es
+	push	eax
+	push	ecx
+	push	edx
+	mov	ax, ss
+	mov	ds, ax
+	mov	es, ax
+	mov	eax, cr3
+	mov	cr3, eax
+	this_cpu	eax
+	mov	dword [eax + CPU_FLUSH], 0
+	call	lapic_eoi
+	pop	edx
+	pop	ecx
+	pop	eax
+	pop	es
+	pop	ds
+	iretd
+
+; what idle_proc runs, in ring 0 with no stack: an interrupt pushes its
+; eip, cs and eflags into its stackframe, see init_smp()
+ALIGN	16
+cpu_idle:
+	sti
+	hlt
+	jmp	cpu_idle
+
 
 
 ; 中断和异常 -- 异常
@@ -319,9 +467,9 @@ inval_opcode:
 	push	6		; vector_no	= 6
 	jmp	exception
 copr_not_available:
-	push	0xFFFFFFFF	; no err code
-	push	7		; vector_no	= 7
-	jmp	exception
+	call	save
+	call	fpu_handler
+	ret
 double_fault:
 	push	8		; vector_no	= 8
 	jmp	exception
@@ -342,12 +490,31 @@ general_protection:
 	push	13		; vector_no	= D
 	jmp	exception
 page_fault:
-	push	14		; vector_no	= E
-	jmp	exception
+	; the error code is where save puts its return address: keep it in the
+	; CPU's pf_err. The pushes land in the frame save fills in anyway.
+	push	eax
+	push	ebx
+	this_cpu	ebx
+	mov	eax, [esp + 4 * 2]
+	mov	[ebx + CPU_PF_ERR], eax
+	pop	ebx
+	pop	eax
+	add	esp, 4			; save wants the frame without it
+	call	save
+	push	dword [ebp + CPU_PF_ERR]
+	mov	eax, cr2
+	push	eax
+	call	page_fault_handler
+	add	esp, 4 * 2
+	ret
 copr_error:
 	push	0xFFFFFFFF	; no err code
 	push	16		; vector_no	= 10h
 	jmp	exception
+simd_exception:
+	push	0xFFFFFFFF	; no err code
+	push	19		; vector_no	= 13h
+	jmp	exception
 
 exception:
 	call	exception_handler
@@ -377,11 +544,13 @@ save:
 	mov	edx, esi	; 恢复 edx
 
         mov     esi, esp                    ;esi = 进程表起始地址
+	this_cpu	ebp		    ;ebp = this CPU, for the handler too
 
-        inc     dword [k_reenter]           ;k_reenter++;
-        cmp     dword [k_reenter], 0        ;if(k_reenter ==0)
+        inc     dword [ebp + CPU_REENTER]   ;k_reenter++;
+        cmp     dword [ebp + CPU_REENTER], 0 ;if(k_reenter ==0)
         jne     .1                          ;{
-        mov     esp, StackTop               ;  mov esp, StackTop <--切换到内核栈
+	take_kernel_lock		    ;  from a proc: one CPU in the kernel
+        mov     esp, [ebp + CPU_STACKTOP]   ;  mov esp, StackTop <--切换到内核栈
         push    restart                     ;  push restart
         jmp     [esi + RETADR - P_STACKBASE];  return;
 .1:                                         ;} else { 已经在内核栈，不需要再切换
@@ -390,6 +559,21 @@ save:
                                             ;}
 
 
+; CR0.TS set unless the proc at esp owns the FPU of CPU ebp, see kernel/fpu.c
+%macro	fpu_ts	0
+	mov	eax, cr0
+	cmp	esp, [ebp + CPU_FPU]
+	je	%%owner
+	test	eax, 8
+	jnz	%%done
+	or	eax, 8
+	mov	cr0, eax
+	jmp	%%done
+%%owner:
+	clts
+%%done:
+%endmacro
+
 ; =============================================================================
 ;                                 sys_call
 ; =============================================================================
@@ -399,7 +583,7 @@ sys_call:
         sti
 	push	esi
 
-	push	dword [p_proc_ready]
+	push	dword [ebp + CPU_PROC]
 	push	edx
 	push	ecx
 	push	ebx
@@ -413,16 +597,93 @@ sys_call:
         ret
 
 
+; =============================================================================
+;                                 sys_enter
+; =============================================================================
+; SYSENTER lands here with IF clear and esp at tss.esp0. Procs in ring 3 come
+; with their esp in esi and where to go on in edi, see lib/syscall.asm. The
+; frame an int would have pushed is made by hand, the rest is as in sys_call.
+sys_enter:
+	mov	esp, [esp]		; top of the caller's stackframe
+	push	SELECTOR_LDT_RW3	; ss
+	push	esi			; esp
+	pushfd				; eflags
+	or	dword [esp], 200h	;   IF was set in the proc
+	push	SELECTOR_LDT_C3		; cs
+	push	edi			; eip
+	call	save
+
+	sti
+	push	esi
+
+	push	dword [ebp + CPU_PROC]
+	push	edx
+	push	ecx
+	push	ebx
+	call	[sys_call_table + eax * 4]
+	add	esp, 4 * 4
+
+	pop	esi
+	mov	[esi + EAXREG - P_STACKBASE], eax
+	cli
+	call	run_work		; as restart does, the proc may change
+
+	; back by SYSEXIT if the caller goes on where it left, else by restart
+	cmp	esi, [ebp + CPU_PROC]
+	jne	.restart
+	mov	eax, [esi + EIPREG - P_STACKBASE]
+	cmp	eax, [esi + EDIREG - P_STACKBASE]
+	jne	.restart		; the call is to be made again
+	mov	esp, esi
+	fpu_ts
+	dec	dword [ebp + CPU_REENTER]
+	give_kernel_lock
+
+	; SYSEXIT loads flat segments: make eip and esp linear
+	mov	eax, [esp + P_LDT + 2]	; base of the code segment, 0~23
+	and	eax, 0FFFFFFh
+	mov	ebx, [esp + P_LDT + 4]	; 24~31
+	and	ebx, 0FF000000h
+	or	eax, ebx
+	mov	ebx, [esp + EIPREG - P_STACKBASE]
+	add	ebx, eax
+	mov	[esp + EDXREG - P_STACKBASE], ebx
+	add	eax, [esp + ESPREG - P_STACKBASE]
+	mov	[esp + ECXREG - P_STACKBASE], eax
+
+	pop	gs
+	pop	fs
+	pop	es
+	pop	ds
+	popad
+	sti			; takes effect after sysexit
+	sysexit
+.restart:
+	ret
+
+
 ; ====================================================================================
 ;                                   restart
 ; ====================================================================================
 restart:
-	mov	esp, [p_proc_ready]
+	call	run_work		; left by the handlers, see kernel/work.c
+	this_cpu	ebp
+	mov	esp, [ebp + CPU_PROC]
+	mov	eax, [esp + P_CR3]
+	mov	ebx, cr3
+	cmp	eax, ebx
+	je	.same_pgdir		; reloading cr3 would flush the TLB
+	mov	cr3, eax
+.same_pgdir:
+	fpu_ts
 	lldt	[esp + P_LDT_SEL] 
 	lea	eax, [esp + P_STACKTOP]
-	mov	dword [tss + TSS3_S_SP0], eax
+	mov	ebx, [ebp + CPU_ESP0]
+	mov	[ebx], eax		; tss.esp0
+	give_kernel_lock		; back to a proc
 restart_reenter:
-	dec	dword [k_reenter]
+	this_cpu	ebp
+	dec	dword [ebp + CPU_REENTER]
 	pop	gs
 	pop	fs
 	pop	es
@@ -431,3 +692,85 @@ restart_reenter:
 	add	esp, 4
 	iretd
 
+
+
+; ====================================================================================
+;                                   ap_start
+; ====================================================================================
+; The other CPUs come here from ap_trampoline, with paging on. Each takes a
+; number, and with it its struct cpu, kernel stack and TSS.
+ap_start:
+	lgdt	[gdt_ptr]
+	lidt	[idt_ptr]
+	jmp	SELECTOR_KERNEL_CS:.csinit
+.csinit:
+	mov	ax, SELECTOR_KERNEL_DS
+	mov	ds, ax
+	mov	es, ax
+	mov	fs, ax
+	mov	ss, ax
+	mov	ax, SELECTOR_KERNEL_GS
+	mov	gs, ax
+
+	mov	eax, 1
+	lock xadd [ap_count], eax	; eax: its number
+	cmp	eax, NR_CPUS
+	jae	.park			; one CPU too many
+	mov	ebx, eax
+	shl	ebx, CPU_SHIFT
+	mov	esp, [cpus + ebx + CPU_STACKTOP]
+	lea	ecx, [SELECTOR_TSS + eax * 8]
+	ltr	cx
+	push	eax
+	call	ap_main			; no return
+.park:
+	cli
+	hlt
+	jmp	.park
+
+
+; ====================================================================================
+;                                   ap_trampoline
+; ====================================================================================
+; Copied to TRAMPOLINE_BASE by init_smp(), where the startup IPI has the other
+; CPUs begin, in real mode. They go to protected mode with the flat segments
+; LOADER had and turn paging on as the BSP has it: it puts its CR0 and CR4
+; in tr_cr0 and tr_cr4.
+[BITS 16]
+ap_trampoline:
+	cli
+	mov	ax, cs
+	mov	ds, ax
+	lgdt	[tr_gdt_ptr - ap_trampoline]
+	mov	eax, cr0
+	or	eax, 1			; PE
+	mov	cr0, eax
+	jmp	dword SELECTOR_FLAT_C:(TRAMPOLINE_BASE + tr_pm - ap_trampoline)
+[BITS 32]
+tr_pm:
+	mov	ax, SELECTOR_FLAT_RW
+	mov	ds, ax
+	mov	es, ax
+	mov	ss, ax
+	mov	eax, [TRAMPOLINE_BASE + tr_cr4 - ap_trampoline]
+	mov	cr4, eax
+	mov	eax, PAGE_DIR_BASE
+	mov	cr3, eax
+	mov	eax, [TRAMPOLINE_BASE + tr_cr0 - ap_trampoline]
+	mov	cr0, eax
+	mov	eax, ap_start		; not relative, this code has moved
+	jmp	eax
+
+ALIGN	8
+tr_gdt:
+	dd	0, 0
+	dd	0000FFFFh, 00CF9A00h	; SELECTOR_FLAT_C
+	dd	0000FFFFh, 00CF9200h	; SELECTOR_FLAT_RW
+tr_gdt_ptr:
+	dw	tr_gdt_ptr - tr_gdt - 1
+	dd	TRAMPOLINE_BASE + tr_gdt - ap_trampoline
+tr_cr0:
+	dd	0
+tr_cr4:
+	dd	0
+ap_trampoline_end:
@@ -53,6 +53,7 @@ PUBLIC void keyboard_handler(int irq)
 	}
 
 	key_pressed = 1;
+	defer_int(TASK_TTY);	/* no clock tick to do it any more */
 }
 
 
@@ -36,6 +36,8 @@ PUBLIC void get_boot_params(struct boot_params * pbp)
 
 	pbp->mem_size = p[BI_MEM_SIZE];
 	pbp->kernel_file = (unsigned char *)(p[BI_KERNEL_FILE]);
+	pbp->nr_ards = min(p[BI_NR_ARDS], MAX_ARDS);
+	pbp->ards = (struct ards *)&p[BI_ARDS];
 
 	/**
 	 * the kernel file should be a ELF executable,
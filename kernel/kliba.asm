@@ -10,6 +10,12 @@
 ; 导入全局变量
 extern	disp_pos
 
+; 导入函数
+extern	lock_kernel
+extern	unlock_kernel
+extern	irqoff_begin
+extern	irqoff_end
+
 
 [SECTION .text]
 
@@ -18,10 +24,16 @@ global	disp_str
 global	disp_color_str
 global	out_byte
 global	in_byte
-global	enable_irq
-global	disable_irq
+global	out_word
+global	in_word
+global	out_dword
+global	in_dword
+global	read_tsc
 global	enable_int
 global	disable_int
+global	save_int
+global	restore_int
+global	cpu_id
 global	port_read
 global	port_write
 global	glitter
@@ -126,6 +138,56 @@ in_byte:
 	nop
 	ret
 
+; ========================================================================
+;		   void out_word(u16 port, u16 value);
+; ========================================================================
+out_word:
+	mov	edx, [esp + 4]		; port
+	mov	ax, [esp + 4 + 4]	; value
+	out	dx, ax
+	nop
+	nop
+	ret
+
+; ========================================================================
+;		   u16 in_word(u16 port);
+; ========================================================================
+in_word:
+	mov	edx, [esp + 4]		; port
+	xor	eax, eax
+	in	ax, dx
+	nop
+	nop
+	ret
+
+; ========================================================================
+;		   void out_dword(u16 port, u32 value);
+; ========================================================================
+out_dword:
+	mov	edx, [esp + 4]		; port
+	mov	eax, [esp + 4 + 4]	; value
+	out	dx, eax
+	nop
+	nop
+	ret
+
+; ========================================================================
+;		   u32 in_dword(u16 port);
+; ========================================================================
+in_dword:
+	mov	edx, [esp + 4]		; port
+	in	eax, dx
+	nop
+	nop
+	ret
+
+; ========================================================================
+;		   u64 read_tsc();
+; ========================================================================
+read_tsc:
+	rdtsc				; edx:eax <- time-stamp counter
+	ret
+
 ; ========================================================================
 ;                  void port_read(u16 port, void* buf, int n);
 ; ========================================================================
@@ -151,92 +213,86 @@ port_write:
 	ret
 
 ; ========================================================================
-;		   void disable_irq(int irq);
+;		   void disable_int();
 ; ========================================================================
-; Disable an interrupt request line by setting an 8259 bit.
-; Equivalent code:
-;	if(irq < 8){
-;		out_byte(INT_M_CTLMASK, in_byte(INT_M_CTLMASK) | (1 << irq));
-;	}
-;	else{
-;		out_byte(INT_S_CTLMASK, in_byte(INT_S_CTLMASK) | (1 << irq));
-;	}
-disable_irq:
-	mov	ecx, [esp + 4]		; irq
-	pushf
+; a task takes kernel_lock too, the kernel may be on another CPU
+disable_int:
+	pushfd
 	cli
-	mov	ah, 1
-	rol	ah, cl			; ah = (1 << (irq % 8))
-	cmp	cl, 8
-	jae	disable_8		; disable irq >= 8 at the slave 8259
-disable_0:
-	in	al, INT_M_CTLMASK
-	test	al, ah
-	jnz	dis_already		; already disabled?
-	or	al, ah
-	out	INT_M_CTLMASK, al	; set bit at master 8259
-	popf
-	mov	eax, 1			; disabled by this function
-	ret
-disable_8:
-	in	al, INT_S_CTLMASK
-	test	al, ah
-	jnz	dis_already		; already disabled?
-	or	al, ah
-	out	INT_S_CTLMASK, al	; set bit at slave 8259
-	popf
-	mov	eax, 1			; disabled by this function
+	mov	ax, cs
+	test	al, 3			; CPL
+	jz	.1
+	call	lock_kernel		; see kernel/smp.c
+.1:
+	pop	eax
+	test	eax, 200h		; IF: they were on, see kernel/work.c
+	jz	.2
+	call	irqoff_begin
+.2:
 	ret
-dis_already:
-	popf
-	xor	eax, eax		; already disabled
+
+; ========================================================================
+;		   void enable_int();
+; ========================================================================
+enable_int:
+	pushfd
+	pop	eax
+	test	eax, 200h
+	jnz	.1			; on already
+	push	dword [esp]		; our caller
+	call	irqoff_end
+	add	esp, 4
+.1:
+	mov	ax, cs
+	test	al, 3
+	jz	.2
+	call	unlock_kernel
+.2:
+	sti
 	ret
 
 ; ========================================================================
-;		   void enable_irq(int irq);
+;		   u32 save_int();
 ; ========================================================================
-; Enable an interrupt request line by clearing an 8259 bit.
-; Equivalent code:
-;	if(irq < 8){
-;		out_byte(INT_M_CTLMASK, in_byte(INT_M_CTLMASK) & ~(1 << irq));
-;	}
-;	else{
-;		out_byte(INT_S_CTLMASK, in_byte(INT_S_CTLMASK) & ~(1 << irq));
-;	}
-;
-enable_irq:
-	mov	ecx, [esp + 4]		; irq
+; disable_int(), returning the flags for restore_int()
+save_int:
 	pushf
 	cli
-	mov	ah, ~1
-	rol	ah, cl			; ah = ~(1 << (irq % 8))
-	cmp	cl, 8
-	jae	enable_8		; enable irq >= 8 at the slave 8259
-enable_0:
-	in	al, INT_M_CTLMASK
-	and	al, ah
-	out	INT_M_CTLMASK, al	; clear bit at master 8259
-	popf
-	ret
-enable_8:
-	in	al, INT_S_CTLMASK
-	and	al, ah
-	out	INT_S_CTLMASK, al	; clear bit at slave 8259
-	popf
+	test	dword [esp], 200h
+	jz	.1
+	call	irqoff_begin
+.1:
+	pop	eax
 	ret
 
 ; ========================================================================
-;		   void disable_int();
+;		   void restore_int(u32 eflags);
 ; ========================================================================
-disable_int:
-	cli
+; interrupts back on if they were before save_int()
+restore_int:
+	test	dword [esp + 4], 200h
+	jz	.1			; they stay off
+	pushf
+	pop	eax
+	test	eax, 200h
+	jnz	.1			; on already
+	push	dword [esp]		; our caller
+	call	irqoff_end
+	add	esp, 4
+.1:
+	push	dword [esp + 4]
+	popf
 	ret
 
 ; ========================================================================
-;		   void enable_int();
+;		   int cpu_id();
 ; ========================================================================
-enable_int:
-	sti
+; the CPU running: each has a TSS of its own, from INDEX_TSS on
+cpu_id:
+	str	eax
+	and	eax, 0FFFFh
+	shr	eax, 3
+	sub	eax, INDEX_TSS
 	ret
 
 ; ========================================================================
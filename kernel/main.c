@@ -27,9 +27,7 @@ PRIVATE void n_proc(struct proc* p,int j)
 	p->has_int_msg = 0;
 	p->q_sending = 0;
 	p->next_sending = 0;
-
-	for (j = 0; j < NR_FILES; j++)
-		p->filp[j] = 0;
+	p->filp = 0;
 }
 PUBLIC int kernel_main()
 {
@@ -44,7 +42,13 @@ PUBLIC int kernel_main()
 
 	char * stk = task_stack + STACK_SIZE_TOTAL;
 
+	init_paging();
+	init_fpu();
+	init_apic();
+
 	for (i = 0; i < NR_TASKS + NR_PROCS; i++,p++,t++) {
+		p->p_cr3 = PAGE_DIR_BASE;	/* until MM gives it its own */
+		p->p_image = -1;
 		if (i >= NR_TASKS + NR_NATIVE_PROCS) {
 			p->p_flags = FREE_SLOT;
 			continue;
@@ -103,6 +107,7 @@ PUBLIC int kernel_main()
 
 	init_clock();
         init_keyboard();
+	init_smp();
 
 	restart();
 	
@@ -113,11 +118,11 @@ PUBLIC int kernel_main()
 
 PUBLIC int get_ticks()
 {
-	MESSAGE msg;
-	reset_msg(&msg);
-	msg.type = GET_TICKS;
-	send_recv(BOTH, TASK_SYS, &msg);
-	return msg.RETVAL;
+	struct timespec ts;
+
+	/* KDATA->ticks lags, there may be no clock event for a while */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * HZ + ts.tv_nsec / (1000000000 / HZ);
 }
 
 
@@ -150,8 +155,9 @@ void untar(const char * filename)
 	int fd = open(filename, O_RDWR);
 	assert(fd != -1);
 
-	char buf[SECTOR_SIZE * 16];
-	int chunk = sizeof(buf);
+	int chunk = SECTOR_SIZE * 16;
+	char * buf = malloc(chunk);
+	assert(buf);
 	int i = 0;
 	int bytes = 0;
 
@@ -177,6 +183,7 @@ void untar(const char * filename)
 			printf("    failed to extract file: %s\n", phdr->name);
 			printf(" aborted]\n");
 			close(fd);
+			free(buf);
 			return;
 		}
 		printf("    %s\n", phdr->name);
@@ -199,6 +206,7 @@ void untar(const char * filename)
 	}
 
 	close(fd);
+	free(buf);
 
 	printf(" done, %d files extracted]\n", i);
 }
@@ -288,6 +296,8 @@ void shabby_shell(const char * tty_name)
 	assert(fd_stdout == 1);
 
 	char rdbuf[128];
+	char ** argv = malloc(sizeof(char*) * (sizeof(rdbuf) / 2 + 1));
+	assert(argv);
         show_start();
         show_operations();
 	while (1) {
@@ -296,7 +306,6 @@ void shabby_shell(const char * tty_name)
 		rdbuf[r] = 0;
 
 		int argc = 0;
-		char * argv[PROC_ORIGIN_STACK];
 		char * p = rdbuf;
 		char * s;
 		int word = 0;
@@ -316,8 +325,8 @@ void shabby_shell(const char * tty_name)
 		} while(ch);
 		argv[argc] = 0;
 
-		int fd = open(argv[0], O_RDWR);
-		if (fd == -1) {
+		int pid = argv[0] ? spawn(argv[0], argv) : -1;
+		if (pid == -1) {
 			if (rdbuf[0]) {
                                 if(rdbuf[0]=='1')show_processes();
                                 else if(rdbuf[0]=='2')show_user_processes();
@@ -326,15 +335,8 @@ void shabby_shell(const char * tty_name)
 			}
 		}
 		else {
-			close(fd);
-			int pid = fork();
-			if (pid != 0) { /* parent */
-				int s;
-				wait(&s);
-			}
-			else {	/* child */
-				execv(argv[0], argv);
-			}
+			int s;
+			wait(&s);
 		}
 	}
 
@@ -352,8 +354,14 @@ void Init()
         
 	printf("Init() is running ...\n");
 
-	/* extract `cmd.tar' */
-	untar("/cmd.tar");delay(10);
+	/* extract `cmd.tar', in a child: INIT has no heap */
+	if (fork() == 0) {
+		untar("/cmd.tar");
+		exit(0);
+	}
+	int status;
+	wait(&status);
+	delay(10);
 			
 	char * tty_list[] = {"/dev_tty1", "/dev_tty2"};
 
@@ -0,0 +1,1031 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   kernel/page.c
+ * @brief  Page frames, page tables and the page fault handler.
+ *
+ * All page directories share the PDEs of the kernel page directory: the
+ * identity mapping of RAM made by LOADER (4 MB pages if the CPU has PSE,
+ * page tables otherwise), and the windows of the paged
+ * procs (see PROC_VM_BASE) whose page tables are created on demand and
+ * kept for the slot. A proc's own directory differs only in the U/S bits,
+ * so a proc can touch nothing but its own window, while the kernel and
+ * the tasks reach every window through the same linear addresses.
+ *
+ * fork() shares pages: both PTEs are made read-only and marked PG_COW, a
+ * write fault copies the page (see break_cow()). CR0.WP is set so that
+ * writes from rings 0-2 fault as well.
+ *
+ * Pages holding bytes of the program file (see vm_area) are read in by
+ * MM: the faulting proc is blocked until then. Other pages come up zeroed.
+ *
+ * When memory runs low TASK_SWAP writes pages out to the swap partition,
+ * picking them with a clock over the windows (see evict_page()). The PTE
+ * of a page written out holds its swap slot; a proc touching it, or out
+ * of memory, waits for TASK_SWAP as it waits for MM above.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/**
+ * Frames are handed out by a buddy allocator: a free block of 2^order
+ * frames starts on a multiple of its size and is on free_area[order],
+ * linked through its first two words.
+ */
+#define	MAX_ORDER	10		/* 4 MB */
+
+struct frame {
+	u8	ref;			/* number of users */
+	u8	free;			/* 1 + order if a free block starts here */
+};
+
+struct free_block {
+	u32	next;
+	u32	prev;
+};
+
+PRIVATE u32		free_area[MAX_ORDER + 1];
+PRIVATE int		nr_free_frames;
+PRIVATE u32		frames_top;	/* end of the pool */
+PRIVATE struct frame *	frames;		/* indexed by physical frame nr */
+PRIVATE u32 *		pgdirs[NR_VM_SLOTS];	/* page directory of each window */
+PRIVATE u32		kdata_pa;	/* the kernel data page, see struct kdata */
+
+#define	FRAME(pa)	(&frames[(pa) >> PAGE_SHIFT])
+
+/* a swap slot per page of the swap partition, see init_swap() */
+#define	MAX_SWAP_ORDER	2		/* 4 frames of map: 64 MB of swap */
+#define	SWAP_PTE(slot)	(((slot) << PAGE_SHIFT) | PG_SWAP)
+#define	SWAP_SLOT(pte)	((pte) >> PAGE_SHIFT)
+
+PRIVATE u8 *		swap_map;	/* number of users of each slot */
+PRIVATE int		nr_swap_slots;	/* 0 if there is no swap */
+PRIVATE int		swap_hint;	/* where to look for a free slot */
+
+/**
+ * The page fault handler runs with interrupts off, a task (MM, a driver)
+ * must keep it out while it changes the same structures.
+ */
+PRIVATE void lock_vm()
+{
+	if (k_reenter == (u32)-1)
+		disable_int();
+}
+
+PRIVATE void unlock_vm()
+{
+	if (k_reenter == (u32)-1)
+		enable_int();
+}
+
+PRIVATE void list_add(int order, u32 pa)
+{
+	struct free_block * b = (struct free_block*)pa;
+
+	b->next = free_area[order];
+	b->prev = 0;
+	if (b->next)
+		((struct free_block*)b->next)->prev = pa;
+	free_area[order] = pa;
+	FRAME(pa)->free = order + 1;
+}
+
+PRIVATE void list_del(int order, u32 pa)
+{
+	struct free_block * b = (struct free_block*)pa;
+
+	if (b->prev)
+		((struct free_block*)b->prev)->next = b->next;
+	else
+		free_area[order] = b->next;
+	if (b->next)
+		((struct free_block*)b->next)->prev = b->prev;
+	FRAME(pa)->free = 0;
+}
+
+/* take 2^order contiguous frames, split a bigger block if needed */
+PRIVATE u32 get_pages(int order)
+{
+	int o = order;
+
+	while (o <= MAX_ORDER && !free_area[o])
+		o++;
+	if (o > MAX_ORDER)
+		return 0;
+
+	u32 pa = free_area[o];
+	list_del(o, pa);
+	while (o > order) {
+		o--;
+		list_add(o, pa + (PAGE_SIZE << o));
+	}
+
+	nr_free_frames -= 1 << order;
+	FRAME(pa)->ref = 1;
+	return pa;
+}
+
+/* give back 2^order frames, merge with the buddy as long as it is free */
+PRIVATE void put_pages(u32 pa, int order)
+{
+	assert(pa > PAGE_DIR_BASE && pa < frames_top);
+	assert((pa & ((PAGE_SIZE << order) - 1)) == 0);
+
+	nr_free_frames += 1 << order;
+	FRAME(pa)->ref = 0;
+	while (order < MAX_ORDER) {
+		u32 buddy = pa ^ (PAGE_SIZE << order);
+		if (buddy >= frames_top || FRAME(buddy)->free != order + 1)
+			break;
+		list_del(order, buddy);
+		pa &= ~(PAGE_SIZE << order);
+		order++;
+	}
+	list_add(order, pa);
+}
+
+PRIVATE u32 get_frame()
+{
+	return get_pages(0);
+}
+
+/* drop a reference, the frame goes back to the pool with the last one */
+PRIVATE void put_frame(u32 pa)
+{
+	assert(FRAME(pa)->ref);
+	if (--FRAME(pa)->ref == 0)
+		put_pages(pa, 0);
+}
+
+/* add [start, end) to the pool */
+PRIVATE void add_pages(u32 start, u32 end)
+{
+	u32 pa;
+
+	for (pa = start; pa < end; pa += PAGE_SIZE)
+		put_pages(pa, 0);
+}
+
+/* add the usable RAM of the E820 map within [start, end) to the pool */
+PRIVATE void add_ram(struct boot_params * bp, u32 start, u32 end)
+{
+	int i;
+
+	if (!bp->nr_ards) {	/* no E820 map, trust mem_size */
+		add_pages(start, end);
+		return;
+	}
+	for (i = 0; i < bp->nr_ards; i++) {
+		struct ards * a = &bp->ards[i];
+		if (a->type != ARDS_RAM || a->base_high)
+			continue;
+
+		u32 top = a->base_low + a->len_low;
+		if (a->len_high || top < a->base_low)
+			top = 0xFFFFFFFF;
+		add_pages(max(PG_FRAME(a->base_low + PAGE_SIZE - 1), start),
+			  min(PG_FRAME(top), end));
+	}
+}
+
+/*****************************************************************************
+ *                                map_kdata
+ *****************************************************************************/
+/**
+ * <Ring 0> Take the kernel data page from the pool and map it at
+ * PROC_KDATA_VA in the kernel page directory, for the kernel, the tasks
+ * and the native procs. The windows get it from map_zero_page().
+ *
+ * The identity mapping loses that page: its frame is kept out of the pool,
+ * the RAM disk stops short of it (see init_rd()). A 4 MB page holding it
+ * is split into a page table.
+ *****************************************************************************/
+PRIVATE void map_kdata()
+{
+	u32 * kdir = (u32*)PAGE_DIR_BASE;
+	u32 * pde = &kdir[PDE_IDX(PROC_KDATA_VA)];
+	u32 flags = PG_P | PG_RWW | PG_USU;
+	int i;
+
+	kdata_pa = get_frame();		/* never freed */
+	assert(kdata_pa);
+	memset((void*)kdata_pa, 0, PAGE_SIZE);
+
+	if (!(*pde & PG_P) || (*pde & PG_PS)) {
+		u32 pt = get_frame();
+		assert(pt);
+		for (i = 0; i < 1024; i++)
+			((u32*)pt)[i] = (*pde & PG_P) ?
+				(PG_FRAME(*pde) + (i << PAGE_SHIFT)) | flags :
+				0;
+		*pde = pt | flags;
+	}
+	((u32*)PG_FRAME(*pde))[PTE_IDX(PROC_KDATA_VA)] = kdata_pa | flags;
+
+	__asm__ __volatile__("movl %%cr3, %%eax\n\t"
+			     "movl %%eax, %%cr3" ::: "eax", "memory");
+}
+
+/*****************************************************************************
+ *                                init_paging
+ *****************************************************************************/
+/**
+ * <Ring 0> Put the usable RAM of the E820 map above PROCS_BASE into the
+ * frame pool, less the frame table kept at its bottom, take the kernel
+ * data page from it (see map_kdata()), and turn on CR0.WP. If LOADER mapped RAM with 4 MB pages, the room it keeps for
+ * page tables (up to fsbuf) is free and goes into the pool as well. Must
+ * be called before any proc runs.
+ *****************************************************************************/
+PUBLIC void init_paging()
+{
+	struct boot_params bp;
+	get_boot_params(&bp);
+
+	u32 * kdir = (u32*)PAGE_DIR_BASE;
+	int i;
+
+	assert(bp.mem_size <= PROC_LINEAR_BASE);
+
+	/* LOADER filled in the PDEs for RAM only */
+	for (i = PDE_IDX(bp.mem_size + 0x3FFFFF); i < 1024; i++)
+		kdir[i] = 0;
+
+	frames_top = PG_FRAME(bp.mem_size - RAMDISK_SIZE(bp.mem_size));
+	frames = (struct frame*)PROCS_BASE;
+
+	u32 tbl_size = (frames_top >> PAGE_SHIFT) * sizeof(struct frame);
+	u32 base = PROCS_BASE + PG_FRAME(tbl_size + PAGE_SIZE - 1);
+	memset(frames, 0, tbl_size);
+
+	/* the frame at PROC_KDATA_VA is out of reach, see map_kdata() */
+	nr_free_frames = 0;
+	add_ram(&bp, base, min(PROC_KDATA_VA, frames_top));
+	add_ram(&bp, max(PROC_KDATA_VA + PAGE_SIZE, base), frames_top);
+	if (kdir[0] & PG_PS)
+		add_ram(&bp, PAGE_DIR_BASE + PAGE_SIZE, (u32)fsbuf);
+
+	map_kdata();
+
+	__asm__ __volatile__("movl %%cr0, %%eax\n\t"
+			     "orl $0x10000, %%eax\n\t"	/* WP */
+			     "movl %%eax, %%cr0" ::: "eax");
+}
+
+/*****************************************************************************
+ *                                map_io_page
+ *****************************************************************************/
+/**
+ * <Ring 0> Map a page of device registers above the RAM where it is,
+ * uncached and for the kernel only, e.g. the local APIC. Must be called
+ * before any proc has a page directory of its own.
+ *
+ * @param pa  Physical address of the page.
+ *****************************************************************************/
+PUBLIC void map_io_page(u32 pa)
+{
+	u32 * kdir = (u32*)PAGE_DIR_BASE;
+	int idx = PDE_IDX(pa);
+	int i;
+
+	assert(pa >= PROC_VM_END);
+	for (i = 0; i < NR_VM_SLOTS; i++)
+		assert(!pgdirs[i]);
+
+	if (!(kdir[idx] & PG_P)) {
+		u32 pt = alloc_frame();
+		if (!pt)
+			panic("no memory to map 0x%x", pa);
+		memset((void*)pt, 0, PAGE_SIZE);
+		kdir[idx] = pt | PG_P | PG_RWW;
+	}
+	assert(!(kdir[idx] & PG_PS));
+
+	u32 * pt = (u32*)PG_FRAME(kdir[idx]);
+	pt[PTE_IDX(pa)] = PG_FRAME(pa) | PG_P | PG_RWW | PG_PCD | PG_PWT;
+	__asm__ __volatile__("invlpg (%0)" :: "r"(pa) : "memory");
+}
+
+PUBLIC u32 alloc_frame()
+{
+	lock_vm();
+	u32 pa = get_frame();
+	unlock_vm();
+
+	return pa;
+}
+
+/* one more user of a frame, e.g. a cached page mapped into a proc */
+PUBLIC void ref_frame(u32 pa)
+{
+	lock_vm();
+	FRAME(pa)->ref++;
+	unlock_vm();
+}
+
+/* drop a reference to a frame */
+PUBLIC void free_frame(u32 pa)
+{
+	lock_vm();
+	put_frame(pa);
+	unlock_vm();
+}
+
+/*****************************************************************************
+ *                                alloc_pages
+ *****************************************************************************/
+/**
+ * Allocate physically contiguous memory.
+ *
+ * @param order  log2 of the number of frames, up to MAX_ORDER.
+ *
+ * @return The physical address, 0 if out of memory.
+ *****************************************************************************/
+PUBLIC u32 alloc_pages(int order)
+{
+	assert(order >= 0 && order <= MAX_ORDER);
+
+	lock_vm();
+	u32 pa = get_pages(order);
+	unlock_vm();
+
+	return pa;
+}
+
+PUBLIC void free_pages(u32 pa, int order)
+{
+	lock_vm();
+	put_pages(pa, order);
+	unlock_vm();
+}
+
+PUBLIC int free_frame_cnt()
+{
+	return nr_free_frames;
+}
+
+/* the window holding `la' */
+PRIVATE int vm_slot(u32 la)
+{
+	return (la - PROC_LINEAR_BASE) / PROC_VM_SIZE;
+}
+
+#define	PID2SLOT(pid)	((pid) - (NR_TASKS + NR_NATIVE_PROCS))
+
+/*****************************************************************************
+ *                                get_pte
+ *****************************************************************************/
+/**
+ * Find the PTE of a linear address in a proc window.
+ *
+ * @param la      The linear address.
+ * @param create  Make the page table if there is none.
+ *
+ * @return Ptr to the PTE, 0 if there is no page table (or no memory).
+ *****************************************************************************/
+PRIVATE u32 * get_pte(u32 la, int create)
+{
+	u32 * kdir = (u32*)PAGE_DIR_BASE;
+	int idx = PDE_IDX(la);
+
+	assert(la >= PROC_LINEAR_BASE && la < PROC_VM_END);
+
+	if (!(kdir[idx] & PG_P)) {
+		if (!create)
+			return 0;
+
+		u32 pt = get_frame();
+		if (!pt)
+			return 0;
+		memset((void*)pt, 0, PAGE_SIZE);
+
+		/* every page directory gets the new page table */
+		int owner = vm_slot(la);
+		int i;
+		kdir[idx] = pt | PG_P | PG_RWW;
+		for (i = 0; i < NR_VM_SLOTS; i++)
+			if (pgdirs[i])
+				pgdirs[i][idx] = pt | PG_P | PG_RWW |
+					(i == owner ? PG_USU : 0);
+	}
+
+	return (u32*)PG_FRAME(kdir[idx]) + PTE_IDX(la);
+}
+
+/*****************************************************************************
+ *                                get_page
+ *****************************************************************************/
+/**
+ * @param la  A linear address in a proc window.
+ *
+ * @return The PTE mapping `la', zero if none.
+ *****************************************************************************/
+PUBLIC u32 get_page(u32 la)
+{
+	u32 * pte = get_pte(la, 0);
+	return pte ? *pte : 0;
+}
+
+/*****************************************************************************
+ *                                set_page
+ *****************************************************************************/
+/**
+ * Change the PTE of a linear address in a proc window. The caller flushes
+ * the TLB if a present mapping is changed.
+ *
+ * @param la   The linear address.
+ * @param pte  The new PTE.
+ *
+ * @return Zero if successful, -1 if no page table could be made.
+ *****************************************************************************/
+PUBLIC int set_page(u32 la, u32 pte)
+{
+	lock_vm();
+	u32 * p = get_pte(la, pte & PG_P);
+	if (p)
+		*p = pte;
+	unlock_vm();
+
+	return (p || !(pte & PG_P)) ? 0 : -1;
+}
+
+/*****************************************************************************
+ *                                map_zero_page
+ *****************************************************************************/
+/**
+ * Back a not present page of a proc window with a zeroed frame, or with
+ * the kernel data page (read-only) at PROC_KDATA_VA.
+ *
+ * @param la  The linear address.
+ *
+ * @return Zero if `la' is now mapped, otherwise -1.
+ *****************************************************************************/
+PRIVATE int map_zero_page(u32 la)
+{
+	if (la < PROC_LINEAR_BASE || la >= PROC_VM_END || !pgdirs[vm_slot(la)])
+		return -1;	/* not in any window in use */
+
+	struct proc * p = &proc_table[vm_slot(la) + NR_TASKS + NR_NATIVE_PROCS];
+	u32 va = la - PROC_VM_BASE(proc2pid(p));
+	int kdata = PG_FRAME(va) == PROC_KDATA_VA;
+	if (va >= PROC_HEAP_BASE && va >= p->p_brk && !kdata)
+		return -1;	/* above the break */
+
+	lock_vm();
+	u32 * pte = get_pte(la, 1);
+	if (pte && !(*pte & (PG_P | PG_SWAP))) {
+		if (kdata) {
+			FRAME(kdata_pa)->ref++;
+			*pte = kdata_pa | PG_P | PG_USU | PG_SHARED;
+		}
+		else {
+			u32 pa = get_frame();
+			if (pa) {
+				memset((void*)pa, 0, PAGE_SIZE);
+				*pte = pa | PG_P | PG_RWW | PG_USU;
+			}
+		}
+	}
+	int ok = pte && (*pte & PG_P);
+	unlock_vm();
+
+	return ok ? 0 : -1;
+}
+
+/*****************************************************************************
+ *                                file_page
+ *****************************************************************************/
+/**
+ * @param la  A linear address in a proc window.
+ *
+ * @return Non-zero if part of the page comes from the proc's program file
+ *         or from a file it mapped.
+ *****************************************************************************/
+PRIVATE int file_page(u32 la)
+{
+	struct proc * p = &proc_table[vm_slot(la) + NR_TASKS + NR_NATIVE_PROCS];
+	u32 va = PG_FRAME(la) - PROC_VM_BASE(proc2pid(p));
+	int i;
+
+	for (i = 0; i < NR_MMAP_AREAS; i++) {
+		struct mmap_area * m = &p->p_mmap[i];
+		if (m->va && va >= m->va && va < m->va + m->len)
+			return 1;
+	}
+
+	if (p->p_image < 0)
+		return 0;
+
+	for (i = 0; i < NR_VM_AREAS; i++) {
+		struct vm_area * a = &p->p_vm[i];
+		if (a->filesz && va < a->vaddr + a->filesz &&
+		    va + PAGE_SIZE > a->vaddr)
+			return 1;
+	}
+	return 0;
+}
+
+/*****************************************************************************
+ *                                break_cow
+ *****************************************************************************/
+/**
+ * Make a PG_COW page writable: the last user takes the frame over, the
+ * others get a copy.
+ *
+ * @param la  The linear address.
+ *
+ * @return Zero if `la' is now writable, otherwise -1.
+ *****************************************************************************/
+PRIVATE int break_cow(u32 la)
+{
+	int ret = -1;
+
+	lock_vm();
+	u32 * pte = get_pte(la, 0);
+	if (pte && (*pte & PG_COW)) {
+		u32 old = PG_FRAME(*pte);
+		u32 pa = old;
+		if (FRAME(old)->ref > 1 && (pa = get_frame())) {
+			memcpy((void*)pa, (void*)old, PAGE_SIZE);
+			put_frame(old);
+		}
+		if (pa) {
+			*pte = pa | (*pte & 0xFFF & ~PG_COW) | PG_RWW;
+			__asm__ __volatile__("invlpg (%0)" :: "r"(la) : "memory");
+			tlb_shootdown();	/* tasks may see the window */
+			ret = 0;
+		}
+	}
+	else if (pte && (*pte & PG_RWW)) {
+		ret = 0;	/* already done */
+	}
+	unlock_vm();
+
+	return ret;
+}
+
+/*****************************************************************************
+ *                                share_page
+ *****************************************************************************/
+/**
+ * Map the page at `from' at `to' as well, copy-on-write unless it is
+ * shared memory (PG_SHARED). A page in swap is shared by its slot, each
+ * proc reads it back into a frame of its own. The caller flushes the TLB
+ * when done.
+ *
+ * @param from  A linear address in a proc window.
+ * @param to    A linear address in another (empty) window.
+ *
+ * @return Zero if successful, -1 if no page table could be made.
+ *****************************************************************************/
+PUBLIC int share_page(u32 from, u32 to)
+{
+	int ret = -1;
+
+	lock_vm();
+	u32 * src = get_pte(from, 0);
+	u32 * dst = get_pte(to, 1);
+	if (src && dst) {
+		if (*src & PG_SWAP) {
+			swap_map[SWAP_SLOT(*src)]++;
+		}
+		else if (*src & PG_P) {
+			if ((*src & PG_RWW) && !(*src & PG_SHARED))
+				*src = (*src & ~PG_RWW) | PG_COW;
+			FRAME(PG_FRAME(*src))->ref++;
+		}
+		*dst = *src;
+		ret = 0;
+	}
+	unlock_vm();
+
+	return ret;
+}
+
+/*****************************************************************************
+ *                                la2pa
+ *****************************************************************************/
+/**
+ * Linear address -> physical address, for DMA. A page of a proc window
+ * must be pinned, see pin_pages().
+ *
+ * @param la  The linear address, e.g. from va2la().
+ *
+ * @return The physical address.
+ *****************************************************************************/
+PUBLIC void * la2pa(void * la)
+{
+	u32 a = (u32)la;
+
+	if (a < PROC_LINEAR_BASE)	/* identity mapped */
+		return la;
+
+	u32 pte = get_page(a);
+	assert((pte & PG_P) && FRAME(PG_FRAME(pte))->ref > 1);
+	return (void*)(PG_FRAME(pte) | (a & (PAGE_SIZE - 1)));
+}
+
+/*****************************************************************************
+ *                                new_pgdir
+ *****************************************************************************/
+/**
+ * Make a page directory for a paged proc.
+ *
+ * @param pid  The proc.
+ *
+ * @return Zero if successful, -1 if out of memory.
+ *****************************************************************************/
+PUBLIC int new_pgdir(int pid)
+{
+	u32 * kdir = (u32*)PAGE_DIR_BASE;
+	u32 base = PROC_VM_BASE(pid);
+	int i;
+
+	assert(!pgdirs[PID2SLOT(pid)]);
+
+	lock_vm();
+	u32 * dir = (u32*)get_frame();
+	if (dir) {
+		for (i = 0; i < 1024; i++)
+			dir[i] = kdir[i] & ~PG_USU;
+		for (i = PDE_IDX(base); i < PDE_IDX(base + PROC_VM_SIZE); i++)
+			if (dir[i] & PG_P)
+				dir[i] |= PG_USU;
+		pgdirs[PID2SLOT(pid)] = dir;
+		proc_table[pid].p_cr3 = (u32)dir;
+	}
+	unlock_vm();
+
+	return dir ? 0 : -1;
+}
+
+PUBLIC void free_pgdir(int pid)
+{
+	struct proc * p = &proc_table[pid];
+
+	assert(p->p_cr3 == (u32)pgdirs[PID2SLOT(pid)]);
+	lock_vm();
+	put_frame(p->p_cr3);
+	pgdirs[PID2SLOT(pid)] = 0;
+	p->p_cr3 = PAGE_DIR_BASE;
+	unlock_vm();
+}
+
+/* unmap a page of a proc window, freeing its frame or its swap slot; the
+ * caller flushes the TLB when done */
+PUBLIC void drop_page(u32 la)
+{
+	lock_vm();
+	u32 * pte = get_pte(la, 0);
+	if (pte && (*pte & PG_P))
+		put_frame(PG_FRAME(*pte));
+	else if (pte && (*pte & PG_SWAP))
+		swap_map[SWAP_SLOT(*pte)]--;
+	if (pte)
+		*pte = 0;
+	unlock_vm();
+}
+
+/*****************************************************************************
+ *                                init_swap
+ *****************************************************************************/
+/**
+ * <Ring 1, TASK_SWAP> Make the map of the swap slots.
+ *
+ * @param nr_slots  Nr. of pages the swap partition holds.
+ *
+ * @return Nr. of slots that can be used, 0 if none.
+ *****************************************************************************/
+PUBLIC int init_swap(int nr_slots)
+{
+	int order = 0;
+
+	while (order < MAX_SWAP_ORDER && (PAGE_SIZE << order) < nr_slots)
+		order++;
+	nr_slots = min(nr_slots, PAGE_SIZE << order);
+
+	u8 * map = nr_slots > 0 ? (u8*)alloc_pages(order) : 0;
+	if (!map)
+		return 0;
+	memset(map, 0, PAGE_SIZE << order);
+
+	lock_vm();
+	swap_map = map;
+	nr_swap_slots = nr_slots;
+	unlock_vm();
+
+	return nr_slots;
+}
+
+/* a free swap slot, -1 if swap is full */
+PRIVATE int get_slot()
+{
+	int i;
+
+	for (i = 0; i < nr_swap_slots; i++) {
+		int s = (swap_hint + i) % nr_swap_slots;
+		if (!swap_map[s]) {
+			swap_map[s] = 1;
+			swap_hint = s + 1;
+			return s;
+		}
+	}
+	return -1;
+}
+
+/* non-zero if the kernel may copy a message to or from the page at `la' */
+PRIVATE int msg_page(u32 la)
+{
+	int pid = vm_slot(la) + NR_TASKS + NR_NATIVE_PROCS;
+	struct proc * p = &proc_table[pid];
+	u32 m = PROC_VM_BASE(pid) + (u32)p->p_msg;
+
+	return (p->p_flags & (SENDING | RECEIVING)) &&
+		(PG_FRAME(m) == PG_FRAME(la) ||
+		 PG_FRAME(m + sizeof(MESSAGE) - 1) == PG_FRAME(la));
+}
+
+/*****************************************************************************
+ *                                evict_page
+ *****************************************************************************/
+/**
+ * <Ring 1, TASK_SWAP> One step of the clock: take a page from its proc,
+ * giving the PTE a swap slot. A page used since the last step over it
+ * only loses its accessed bit; shared pages stay, so do those the kernel
+ * may copy a message to and those a driver pinned (see pin_pages()).
+ *
+ * @param la    A linear address in a proc window.
+ * @param slot  Where to put the slot.
+ *
+ * @return The frame, to be written to the slot and freed after the TLB
+ *         is flushed. 0 if the page stays.
+ *****************************************************************************/
+PUBLIC u32 evict_page(u32 la, int * slot)
+{
+	u32 pa = 0;
+
+	lock_vm();
+	u32 * pte = get_pte(la, 0);
+	if (pte && (*pte & PG_P)) {
+		if (*pte & PG_ACCESSED)
+			*pte &= ~PG_ACCESSED;
+		else if (!(*pte & PG_SHARED) &&
+			 FRAME(PG_FRAME(*pte))->ref == 1 && !msg_page(la) &&
+			 (*slot = get_slot()) != -1) {
+			pa = PG_FRAME(*pte);
+			*pte = SWAP_PTE(*slot);
+		}
+	}
+	unlock_vm();
+
+	return pa;
+}
+
+/*****************************************************************************
+ *                                unswap_page
+ *****************************************************************************/
+/**
+ * <Ring 1, TASK_SWAP> Map a page read back from swap, unless its PTE has
+ * changed meanwhile (the proc has exited).
+ *
+ * @param la   A linear address in a proc window.
+ * @param old  The PTE the page was read for.
+ * @param pa   The frame holding it.
+ *
+ * @return Zero if the frame is mapped, -1 if the caller is to free it.
+ *****************************************************************************/
+PUBLIC int unswap_page(u32 la, u32 old, u32 pa)
+{
+	int ret = -1;
+
+	lock_vm();
+	u32 * pte = get_pte(la, 0);
+	if (pte && *pte == old) {
+		swap_map[SWAP_SLOT(old)]--;
+		*pte = pa | PG_P | PG_RWW | PG_USU;
+		ret = 0;
+	}
+	unlock_vm();
+
+	return ret;
+}
+
+/* non-zero if the current proc may wait for TASK_SWAP: not those it needs */
+PRIVATE int swap_waitable()
+{
+	int pid = proc2pid(p_proc_ready);
+
+	return nr_swap_slots && pid != TASK_SWAP &&
+		pid != dd_map[MAJOR(SWAP_DEV)].driver_nr;
+}
+
+/* let the current proc wait for TASK_SWAP, 0 if it cannot */
+PRIVATE int wait_for_swap(u32 la)
+{
+	struct proc * p = p_proc_ready;
+
+	/* the kernel cannot wait */
+	if (k_reenter != 0 || !swap_waitable())
+		return 0;
+
+	p->p_fault_la = la;
+	p->p_flags |= SWAPPING;
+	inform_int(TASK_SWAP);
+	schedule();
+	return 1;
+}
+
+/*****************************************************************************
+ *                                swap_wait
+ *****************************************************************************/
+/**
+ * <Ring 0> Called by system calls before the kernel touches the caller's
+ * memory: if part of it is in swap, the caller waits for TASK_SWAP and
+ * must make the call again.
+ *
+ * @param la   Linear address of the memory.
+ * @param len  Its size in bytes.
+ *
+ * @return Non-zero if the caller waits.
+ *****************************************************************************/
+PUBLIC int swap_wait(u32 la, int len)
+{
+	u32 a;
+
+	for (a = PG_FRAME(la); a < la + len; a += PAGE_SIZE)
+		if (a >= PROC_LINEAR_BASE && a < PROC_VM_END &&
+		    (get_page(a) & PG_SWAP))
+			return wait_for_swap(a);
+	return 0;
+}
+
+/*****************************************************************************
+ *                                pin_pages
+ *****************************************************************************/
+/**
+ * <Ring 1> Keep the memory of a request in its frames while a driver works
+ * on it: each page of a proc window is brought in (copied if shared and
+ * to be written) and its frame gets a reference, so evict_page() leaves it
+ * alone. A page in swap is read back, the driver faulting on it waits for
+ * TASK_SWAP, unless TASK_SWAP needs that driver.
+ *
+ * @param la     Linear address of the memory.
+ * @param len    Its size in bytes.
+ * @param write  Non-zero if the memory is to be written.
+ *
+ * @return Zero if successful, -1 if a page cannot be brought in: nothing
+ *         is pinned then.
+ *****************************************************************************/
+PUBLIC int pin_pages(u32 la, int len, int write)
+{
+	u32 a = PG_FRAME(la);
+
+	while (a < la + len) {
+		if (a < PROC_LINEAR_BASE || a >= PROC_VM_END) {
+			a += PAGE_SIZE;		/* identity mapped */
+			continue;
+		}
+
+		lock_vm();
+		u32 pte = get_page(a);
+		int ok = (pte & PG_P) && !(write && (pte & PG_COW));
+		if (ok)
+			FRAME(PG_FRAME(pte))->ref++;
+		unlock_vm();
+
+		if (ok)
+			a += PAGE_SIZE;
+		else if ((pte & PG_P) ? break_cow(a) == 0 :
+			 !(pte & PG_SWAP) && !file_page(a) &&
+			 map_zero_page(a) == 0)
+			;			/* look again */
+		else if (((pte & PG_SWAP) || (!nr_free_frames &&
+			  ((pte & PG_P) || !file_page(a)))) &&
+			 swap_waitable()) {
+			/* in swap or out of memory, see page_fault_handler() */
+			if (write)
+				*(volatile u8*)a = *(volatile u8*)a;
+			else
+				(void)*(volatile u8*)a;
+		}
+		else {
+			unpin_pages(la, a - la);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*****************************************************************************
+ *                                unpin_pages
+ *****************************************************************************/
+/**
+ * <Ring 1> Drop what pin_pages() took. The proc is still there: it waits
+ * for the driver.
+ *
+ * @param la   Linear address of the memory.
+ * @param len  Its size in bytes.
+ *****************************************************************************/
+PUBLIC void unpin_pages(u32 la, int len)
+{
+	u32 a;
+
+	lock_vm();
+	for (a = PG_FRAME(la); a < la + len; a += PAGE_SIZE)
+		if (a >= PROC_LINEAR_BASE && a < PROC_VM_END)
+			put_frame(PG_FRAME(get_page(a)));
+	unlock_vm();
+}
+
+/*****************************************************************************
+ *                                pinned_copy
+ *****************************************************************************/
+/**
+ * <Ring 1> phys_copy() to the memory of a proc, e.g. the reply of a
+ * DEV_IOCTL, pinned meanwhile: a driver cannot fault on a page of a file.
+ *
+ * @param dst  Linear address of the proc's memory.
+ * @param src  Linear address of the data.
+ * @param len  Its size in bytes.
+ *
+ * @return Zero if successful, -1 if the memory could not be brought in.
+ *****************************************************************************/
+PUBLIC int pinned_copy(void * dst, void * src, int len)
+{
+	if (pin_pages((u32)dst, len, 1) != 0)
+		return -1;
+	phys_copy(dst, src, len);
+	unpin_pages((u32)dst, len);
+	return 0;
+}
+
+/*****************************************************************************
+ *                                page_fault_handler
+ *****************************************************************************/
+/**
+ * <Ring 0> Called by page_fault (kernel.asm) with interrupts off.
+ *
+ * @param la        The faulting linear address (cr2).
+ * @param err_code  Error code pushed by the CPU.
+ *****************************************************************************/
+PUBLIC void page_fault_handler(u32 la, u32 err_code)
+{
+	int in_window = la >= PROC_LINEAR_BASE && la < PROC_VM_END &&
+		pgdirs[vm_slot(la)];
+
+	if (!(err_code & PF_PROT) && in_window && (get_page(la) & PG_SWAP)) {
+		if (wait_for_swap(la))
+			return;
+		panic("0x%x touched by %s while in swap",
+		      la, p_proc_ready->name);
+	}
+	if (!(err_code & PF_PROT) && in_window && file_page(la)) {
+		/* only the proc itself can wait, see prefault() */
+		if (!(err_code & PF_USER))
+			panic("0x%x of %s touched before it was paged in",
+			      la, p_proc_ready->name);
+		p_proc_ready->p_fault_la = la;
+		p_proc_ready->p_flags |= PAGING;
+		inform_int(TASK_MM);
+		schedule();
+		return;
+	}
+	if ((!(err_code & PF_PROT) && map_zero_page(la) == 0) ||
+	    ((err_code & PF_WRITE) && in_window && break_cow(la) == 0)) {
+		if (nr_swap_slots && nr_free_frames < SWAP_LOW_FRAMES)
+			inform_int(TASK_SWAP);	/* write some pages out */
+		return;
+	}
+	/* out of memory: wait for TASK_SWAP to free some, then fault again */
+	if (in_window && !nr_free_frames && wait_for_swap(la))
+		return;
+
+	panic("page fault at 0x%x, err:0x%x, proc:%s",
+	      la, err_code, p_proc_ready->name);
+}
+
+/*****************************************************************************
+ *                                sys_flush_tlb
+ *****************************************************************************/
+/**
+ * <Ring 0> Drop the TLB after mappings have been removed, on every CPU.
+ * MM runs in ring 1 and cannot do this itself.
+ *****************************************************************************/
+PUBLIC int sys_flush_tlb(int _unused1, int _unused2, int _unused3,
+			 struct proc * p)
+{
+	__asm__ __volatile__("movl %%cr3, %%eax\n\t"
+			     "movl %%eax, %%cr3" ::: "eax", "memory");
+	tlb_shootdown();
+	return 0;
+}
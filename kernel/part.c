@@ -0,0 +1,112 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   kernel/part.c
+ * @brief  Partition table parsing shared by the block device drivers.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+#include "hd.h"
+
+
+/*****************************************************************************
+ *                                partition
+ *****************************************************************************/
+/**
+ * <Ring 1> This routine is called when a device is opened. It reads the
+ * partition table(s) and fills the hd_info struct. A drive may have no
+ * partitions, those of size 0 are not there.
+ * 
+ * @param hdi             The drive's hd_info.
+ * @param device          Device nr.
+ * @param style           P_PRIMARY or P_EXTENDED.
+ * @param get_part_table  Driver routine which reads a partition table.
+ *****************************************************************************/
+PUBLIC void partition(struct hd_info * hdi, int device, int style,
+		      part_reader get_part_table)
+{
+	int i;
+	int drive = DRV_OF_DEV(device);
+	struct part_ent part_tbl[NR_SUB_PER_DRIVE];
+
+	if (style == P_PRIMARY) {
+		get_part_table(drive, 0, part_tbl);	/* the MBR */
+
+		for (i = 0; i < NR_PART_PER_DRIVE; i++) { /* 0~3 */
+			if (part_tbl[i].sys_id == NO_PART) continue;
+
+			int dev_nr = i + 1;		  /* 1~4 */
+			hdi->primary[dev_nr].size = part_tbl[i].nr_sects;
+			hdi->primary[dev_nr].base = part_tbl[i].start_sect;
+
+			if (part_tbl[i].sys_id == EXT_PART)
+				partition(hdi, device + dev_nr, P_EXTENDED,
+					  get_part_table);
+		}
+	}
+	else if (style == P_EXTENDED) {
+		int j = device % NR_PRIM_PER_DRIVE; /* 1~4 */
+		int ext_start_sect = hdi->primary[j].base;
+		int s = ext_start_sect;
+		int nr_1st_sub = (j - 1) * NR_SUB_PER_PART; /* 0/16/32/48 */
+
+		for (i = 0; i < NR_SUB_PER_PART; i++) {
+			int dev_nr = nr_1st_sub + i;/* 0~15/16~31/32~47/48~63 */
+
+			get_part_table(drive, s, part_tbl);
+			hdi->logical[dev_nr].size = part_tbl[0].nr_sects;
+			hdi->logical[dev_nr].base = s + part_tbl[0].start_sect;
+			s = ext_start_sect + part_tbl[1].start_sect;
+			if (part_tbl[1].sys_id == NO_PART) break;
+		}
+	}
+	else {
+		assert(0);
+	}
+}
+
+/*****************************************************************************
+ *                                valid_minor
+ *****************************************************************************/
+/**
+ * Check a minor from outside the driver before DRV_OF_DEV() and
+ * get_part_info() index with it.
+ * 
+ * @param device  Device nr.
+ * 
+ * @return Non-zero if it is a partition of one of MAX_DRIVES drives.
+ *****************************************************************************/
+PUBLIC int valid_minor(int device)
+{
+	return (device >= 0 && device <= MAX_PRIM) ||
+		(device >= MINOR_hd1a &&
+		 device < MINOR_hd1a + MAX_SUBPARTITIONS);
+}
+
+/*****************************************************************************
+ *                                get_part_info
+ *****************************************************************************/
+/**
+ * Get the base and size of a (primary or logical) partition.
+ * 
+ * @param hdi     The drive's hd_info.
+ * @param device  Device nr.
+ * 
+ * @return Ptr to the part_info.
+ *****************************************************************************/
+PUBLIC struct part_info * get_part_info(struct hd_info * hdi, int device)
+{
+	return device <= MAX_PRIM ?
+		&hdi->primary[device % NR_PRIM_PER_DRIVE] :
+		&hdi->logical[(device - MINOR_hd1a) % NR_SUB_PER_DRIVE];
+}
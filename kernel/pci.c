@@ -0,0 +1,87 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   kernel/pci.c
+ * @brief  Minimal PCI bus access through configuration mechanism #1.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+#include "pci.h"
+
+
+/*****************************************************************************
+ *                                pci_read_config
+ *****************************************************************************/
+/**
+ * Read a dword from the configuration space of a PCI function.
+ * 
+ * @param dev  PCI_DEV(bus, slot).
+ * @param reg  Register offset, needn't be dword aligned.
+ * 
+ * @return The dword containing `reg', shifted so that `reg' is the lowest
+ *         byte.
+ *****************************************************************************/
+PUBLIC u32 pci_read_config(int dev, int reg)
+{
+	out_dword(PCI_CONFIG_ADDR, 0x80000000 | (dev << 8) | (reg & 0xFC));
+	return in_dword(PCI_CONFIG_DATA) >> ((reg & 3) * 8);
+}
+
+/*****************************************************************************
+ *                                pci_write_config
+ *****************************************************************************/
+/**
+ * Write a dword to the configuration space of a PCI function.
+ * 
+ * @param dev  PCI_DEV(bus, slot).
+ * @param reg  Register offset, must be dword aligned.
+ * @param val  The value.
+ *****************************************************************************/
+PUBLIC void pci_write_config(int dev, int reg, u32 val)
+{
+	assert((reg & 3) == 0);
+	out_dword(PCI_CONFIG_ADDR, 0x80000000 | (dev << 8) | reg);
+	out_dword(PCI_CONFIG_DATA, val);
+}
+
+/*****************************************************************************
+ *                                pci_find_device
+ *****************************************************************************/
+/**
+ * Scan the buses for a function with the given IDs.
+ * 
+ * @param vendor  Vendor ID.
+ * @param device  Device ID.
+ * @param nth     0 for the first match, 1 for the second, etc.
+ * 
+ * @return PCI_DEV(bus, slot) if found, otherwise -1.
+ *****************************************************************************/
+PUBLIC int pci_find_device(int vendor, int device, int nth)
+{
+	int bus, slot;
+
+	for (bus = 0; bus < PCI_MAX_BUS; bus++) {
+		for (slot = 0; slot < PCI_MAX_SLOT; slot++) {
+			int dev = PCI_DEV(bus, slot);
+			u32 id = pci_read_config(dev, PCI_VENDOR_ID);
+
+			if ((id & 0xFFFF) == PCI_NO_VENDOR)
+				continue;
+			if ((id & 0xFFFF) == vendor && (id >> 16) == device &&
+			    nth-- == 0)
+				return dev;
+		}
+	}
+
+	return -1;
+}
@@ -32,26 +32,101 @@ PRIVATE  int w_count;
 PRIVATE  int r_count;
 
 
+/*****************************************************************************
+ *                                schedule
+ *****************************************************************************/
+/**
+ * <Ring 0> Pick the next proc for this CPU among those on it (p_cpu), its
+ * idle_proc if none is ready. Other CPUs idling with a proc ready, woken
+ * by a task maybe, are told to look too.
+ *****************************************************************************/
 PUBLIC void schedule()
 {
 	struct proc*	p;
+	struct proc*	prev = p_proc_ready;
+	int		cpu = cpu_id();
 	int		greatest_ticks = 0;
+	int		kicked = 0;	/* a bit per CPU */
+
+	clock_account();	/* charge the proc leaving the CPU */
 
 	while (!greatest_ticks) {
+		int ready = 0;
+
 		for (p = &FIRST_PROC; p <= &LAST_PROC; p++) {
-			if (p->p_flags == 0) {
-				if (p->ticks > greatest_ticks) {
-					greatest_ticks = p->ticks;
-					p_proc_ready = p;
-				}
+			if (p->p_flags != 0)
+				continue;
+			if (p->p_cpu != cpu) {
+				if (!(kicked & (1 << p->p_cpu)))
+					kick_cpu(p->p_cpu);
+				kicked |= 1 << p->p_cpu;
+				continue;
+			}
+			ready = 1;
+			if (p->ticks > greatest_ticks) {
+				greatest_ticks = p->ticks;
+				p_proc_ready = p;
 			}
 		}
 
+		if (!ready) {
+			/* until an alarm or a wakeup, see clock_rearm() */
+			p_proc_ready = &idle_proc[cpu];
+			p_proc_ready->ticks = MAX_TICKS;
+			break;
+		}
 		if (!greatest_ticks)
 			for (p = &FIRST_PROC; p <= &LAST_PROC; p++)
-				if (p->p_flags == 0)
+				if (p->p_flags == 0 && p->p_cpu == cpu)
 					p->ticks = p->priority;
 	}
+
+	if (nr_cpus > 1 && prev != p_proc_ready)
+		fpu_release(prev);	/* it may go on on another CPU */
+	if (nr_cpus == 1 && p_proc_ready != &idle_proc[cpu])
+		KDATA->pid = proc2pid(p_proc_ready);	/* see getpid() */
+	clock_rearm();				/* for the end of its quantum */
+}
+
+/*****************************************************************************
+ *                                balance
+ *****************************************************************************/
+/**
+ * <Ring 0, CPU 0> Move procs ready to run from the busiest CPU to the
+ * idlest, until they differ by one at most. Tasks stay on CPU 0, a proc
+ * running stays where it is.
+ *****************************************************************************/
+PUBLIC void balance()
+{
+	int		load[NR_CPUS];
+	struct proc*	p;
+	int		i, busy = 0, idle = 0;
+
+	if (nr_cpus == 1)
+		return;
+
+	memset(load, 0, sizeof(load));
+	for (p = &FIRST_PROC; p <= &LAST_PROC; p++)
+		if (p->p_flags == 0)
+			load[p->p_cpu]++;
+
+	for (i = 1; i < nr_cpus; i++) {
+		if (load[i] > load[busy])
+			busy = i;
+		if (load[i] < load[idle])
+			idle = i;
+	}
+
+	for (p = &proc_table[NR_TASKS];
+	     p <= &LAST_PROC && load[busy] - load[idle] > 1; p++)
+		if (p->p_flags == 0 && p->p_cpu == busy &&
+		    cpus[busy].proc != p) {
+			p->p_cpu = idle;
+			load[busy]--;
+			load[idle]++;
+		}
+
+	kick_cpu(idle);
 }
 
 PRIVATE void if_go_wait()
@@ -129,6 +204,12 @@ PUBLIC int sys_sendrec(int function, int src_dest, MESSAGE* m, struct proc* p)
 	int ret = 0;
 	int caller = proc2pid(p);
 	MESSAGE* mla = (MESSAGE*)va2la(caller, m);
+
+	/* the kernel cannot wait for a message in swap, the caller can */
+	if (swap_wait((u32)mla, sizeof(MESSAGE))) {
+		p->regs.eip -= 2;	/* back to the int or sysenter */
+		return p->regs.eax;
+	}
 	mla->source = caller;
 
 	assert(mla->source != src_dest);
@@ -186,6 +267,12 @@ PRIVATE void block(struct proc* p)
 PRIVATE void unblock(struct proc* p)
 {
 	assert(p->p_flags == 0);
+
+	/* an idle CPU runs it at once */
+	if (p->p_cpu != cpu_id())
+		kick_cpu(p->p_cpu);
+	else if (p_proc_ready == &idle_proc[p->p_cpu] && k_reenter == 0)
+		schedule();
 }
 
 
@@ -239,6 +326,7 @@ PRIVATE int msg_send(struct proc* current, int dest, MESSAGE* m)
 		p_dest->p_msg = 0;
 		p_dest->p_flags &= ~RECEIVING; /* dest has received the msg */
 		p_dest->p_recvfrom = NO_TASK;
+		p_dest->p_recv_wait = 0;
 		unblock(p_dest);
 
 		assert(p_dest->p_flags == 0);
@@ -255,6 +343,7 @@ PRIVATE int msg_send(struct proc* current, int dest, MESSAGE* m)
 		assert(sender->p_flags == SENDING);
 		sender->p_sendto = dest;
 		sender->p_msg = m;
+		sender->p_send_tsc = (u32)read_tsc();
 
 		//ӵͶ
 		struct proc * p;
@@ -388,6 +477,8 @@ PRIVATE int msg_receive(struct proc* current, int src, MESSAGE* m)
 		p_from->p_msg = 0;
 		p_from->p_sendto = NO_TASK;
 		p_from->p_flags &= ~SENDING;
+		p_who_wanna_recv->p_recv_wait = (u32)read_tsc() -
+			p_from->p_send_tsc;
 		unblock(p_from);
 	}
 	else {
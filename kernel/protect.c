@@ -19,6 +19,19 @@
 
 /* 本文件内函数声明 */
 PRIVATE void init_idt_desc(unsigned char vector, u8 desc_type, int_handler handler, unsigned char privilege);
+PRIVATE void init_sysenter();
+
+#define	CPUID_SEP		(1 << 11)
+#define	MSR_SYSENTER_CS		0x174
+#define	MSR_SYSENTER_ESP	0x175
+#define	MSR_SYSENTER_EIP	0x176
+
+PRIVATE int	has_sysenter;
+
+PRIVATE void wrmsr(u32 msr, u32 val)
+{
+	__asm__ __volatile__("wrmsr" :: "c"(msr), "a"(val), "d"(0));
+}
 
 
 /* 中断处理函数 */
@@ -38,6 +51,7 @@ void	stack_exception();
 void	general_protection();
 void	page_fault();
 void	copr_error();
+void	simd_exception();
 void	hwint00();
 void	hwint01();
 void	hwint02();
@@ -54,6 +68,10 @@ void	hwint12();
 void	hwint13();
 void	hwint14();
 void	hwint15();
+void	lapic_timer();
+void	apic_spurious();
+void	resched_ipi();
+void	tlb_ipi();
 
 
 /*======================================================================*
@@ -114,6 +132,9 @@ PUBLIC void init_prot()
 	init_idt_desc(INT_VECTOR_COPROC_ERR,	DA_386IGate,
 		      copr_error,		PRIVILEGE_KRNL);
 
+	init_idt_desc(INT_VECTOR_SIMD,		DA_386IGate,
+		      simd_exception,		PRIVILEGE_KRNL);
+
         init_idt_desc(INT_VECTOR_IRQ0 + 0,      DA_386IGate,
                       hwint00,                  PRIVILEGE_KRNL);
 
@@ -162,20 +183,36 @@ PUBLIC void init_prot()
         init_idt_desc(INT_VECTOR_IRQ8 + 7,      DA_386IGate,
                       hwint15,                  PRIVILEGE_KRNL);
 
+	init_idt_desc(INT_VECTOR_LAPIC_TIMER,	DA_386IGate,
+		      lapic_timer,		PRIVILEGE_KRNL);
+
+	init_idt_desc(INT_VECTOR_APIC_SPURIOUS,	DA_386IGate,
+		      apic_spurious,		PRIVILEGE_KRNL);
+
+	init_idt_desc(INT_VECTOR_RESCHED,	DA_386IGate,
+		      resched_ipi,		PRIVILEGE_KRNL);
+
+	init_idt_desc(INT_VECTOR_TLB,		DA_386IGate,
+		      tlb_ipi,			PRIVILEGE_KRNL);
+
 	init_idt_desc(INT_VECTOR_SYS_CALL,	DA_386IGate,
 		      sys_call,			PRIVILEGE_USER);
 
-	/* Fill the TSS descriptor in GDT */
-	memset(&tss, 0, sizeof(tss));
-	tss.ss0	= SELECTOR_KERNEL_DS;
-	init_desc(&gdt[INDEX_TSS],
-		  makelinear(SELECTOR_KERNEL_DS, &tss),
-		  sizeof(tss) - 1,
-		  DA_386TSS);
-	tss.iobase = sizeof(tss); /* No IO permission bitmap */
+	/* Fill the TSS descriptors in GDT, one per CPU */
+	int i;
+	assert(sizeof(struct cpu) == 1 << CPU_SHIFT);
+	for (i = 0; i < NR_CPUS; i++) {
+		memset(&tss[i], 0, sizeof(tss[i]));
+		tss[i].ss0 = SELECTOR_KERNEL_DS;
+		init_desc(&gdt[INDEX_TSS + i],
+			  makelinear(SELECTOR_KERNEL_DS, &tss[i]),
+			  sizeof(tss[i]) - 1,
+			  DA_386TSS);
+		tss[i].iobase = sizeof(tss[i]); /* No IO permission bitmap */
+		cpus[i].esp0 = &tss[i].esp0;
+	}
 
 	/* Fill the LDT descriptors of each proc in GDT  */
-	int i;
 	for (i = 0; i < NR_TASKS + NR_PROCS; i++) {
 		memset(&proc_table[i], 0, sizeof(struct proc));
 
@@ -186,6 +223,56 @@ PUBLIC void init_prot()
 			  LDT_SIZE * sizeof(struct descriptor) - 1,
 			  DA_LDT);
 	}
+
+	init_sysenter();
+}
+
+
+/*======================================================================*
+                           init_sysenter
+ *----------------------------------------------------------------------*
+ Let procs in ring 3 make syscalls by SYSENTER, see sys_enter
+ *======================================================================*/
+PRIVATE void init_sysenter()
+{
+	u32 eax, ebx, ecx, edx;
+
+	__asm__ __volatile__("cpuid"
+			     : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+			     : "a"(1));
+	/* early Pentium Pros say SEP but have no SYSENTER */
+	if (!(edx & CPUID_SEP) || (((eax >> 8) & 0xF) == 6 &&
+				   ((eax >> 4) & 0xF) < 3 && (eax & 0xF) < 3))
+		return;
+
+	assert(INDEX_SYSENTER + 3 < GDT_SIZE);
+	init_desc(&gdt[INDEX_SYSENTER], 0, 0xFFFFF,
+		  DA_CR | DA_32 | DA_LIMIT_4K);
+	init_desc(&gdt[INDEX_SYSENTER + 1], 0, 0xFFFFF,
+		  DA_DRW | DA_32 | DA_LIMIT_4K);
+	init_desc(&gdt[INDEX_SYSENTER + 2], 0, 0xFFFFF,
+		  DA_CR | DA_32 | DA_LIMIT_4K | DA_DPL3);
+	init_desc(&gdt[INDEX_SYSENTER + 3], 0, 0xFFFFF,
+		  DA_DRW | DA_32 | DA_LIMIT_4K | DA_DPL3);
+
+	has_sysenter = 1;
+	init_sysenter_cpu(0);
+}
+
+
+/*======================================================================*
+                           init_sysenter_cpu
+ *----------------------------------------------------------------------*
+ The MSRs are each CPU's own: SYSENTER takes esp from the CPU's TSS
+ *======================================================================*/
+PUBLIC void init_sysenter_cpu(int cpu)
+{
+	if (!has_sysenter)
+		return;
+
+	wrmsr(MSR_SYSENTER_CS,	SELECTOR_SYSENTER);
+	wrmsr(MSR_SYSENTER_ESP,	(u32)&tss[cpu].esp0);	/* see sys_enter */
+	wrmsr(MSR_SYSENTER_EIP,	(u32)sys_enter);
 }
 
 
@@ -0,0 +1,247 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   kernel/raid0.c
+ * @brief  RAID-0: one block device striped over several member disks.
+ *
+ * The volume is minor 0 of DEV_RAID; members and the stripe size come
+ * from config.h. A DEV_READ/DEV_WRITE is cut into stripe units which are
+ * forwarded to the member drivers with the caller's buffer, so data never
+ * passes through this task. Each round posts one unit to every member
+ * driver (SEND to all, then RECEIVE from all), thus all disks work in
+ * parallel.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+#include "hd.h"
+
+PRIVATE int		raid_members[RAID0_NR_MEMBERS] = RAID0_MEMBERS;
+PRIVATE int		raid_open_cnt;
+PRIVATE u32		raid_member_sects;	/* used sectors of each member */
+PRIVATE struct io_stat	raid_stat;
+
+/*****************************************************************************
+ *                                member_call
+ *****************************************************************************/
+/**
+ * Send a message to the driver of a member and wait for the reply.
+ *
+ * @param m    Member index.
+ * @param msg  The message, DEVICE is filled in here.
+ *****************************************************************************/
+PRIVATE void member_call(int m, MESSAGE * msg)
+{
+	int dev = raid_members[m];
+
+	msg->DEVICE = MINOR(dev);
+	assert(dd_map[MAJOR(dev)].driver_nr != INVALID_DRIVER);
+	send_recv(BOTH, dd_map[MAJOR(dev)].driver_nr, msg);
+}
+
+PRIVATE int raid_open(int device)
+{
+	int i;
+	int err = 0;
+	MESSAGE msg;
+	struct part_info geo;
+
+	if (device != 0)
+		return -1;
+	if (raid_open_cnt++)
+		return 0;
+
+	raid_member_sects = 0xFFFFFFFF;
+	for (i = 0; i < RAID0_NR_MEMBERS; i++) {
+		msg.type = DEV_OPEN;
+		msg.RETVAL = 0;
+		member_call(i, &msg);
+		if (msg.RETVAL != 0) {
+			printl("{RAID} member 0x%x missing\n", raid_members[i]);
+			err = 1;
+			break;
+		}
+
+		msg.type = DEV_IOCTL;
+		msg.REQUEST = DIOCTL_GET_GEO;
+		msg.PROC_NR = TASK_RAID;
+		msg.BUF = &geo;
+		msg.RETVAL = 0;
+		member_call(i, &msg);
+		if (msg.RETVAL != 0) {
+			i++;		/* it is open, close it too */
+			err = 1;
+			break;
+		}
+		raid_member_sects = min(raid_member_sects, geo.size);
+	}
+	if (err) {
+		/* give back the members opened so far */
+		while (i-- > 0) {
+			msg.type = DEV_CLOSE;
+			member_call(i, &msg);
+		}
+		raid_open_cnt = 0;
+		return -1;
+	}
+	raid_member_sects -= raid_member_sects % RAID0_STRIPE_SECTS;
+
+	printl("{RAID} %d members, stripe:%dKB, size:%dMB\n",
+	       RAID0_NR_MEMBERS, RAID0_STRIPE_SECTS / 2,
+	       raid_member_sects / 2048 * RAID0_NR_MEMBERS);
+
+	return 0;
+}
+
+PRIVATE void raid_close(int device)
+{
+	int i;
+	MESSAGE msg;
+
+	assert(raid_open_cnt > 0);
+	if (--raid_open_cnt)
+		return;
+
+	for (i = 0; i < RAID0_NR_MEMBERS; i++) {
+		msg.type = DEV_CLOSE;
+		member_call(i, &msg);
+	}
+}
+
+/*****************************************************************************
+ *                                raid_rdwt
+ *****************************************************************************/
+/**
+ * Split a request into stripe units and run them on the members, one
+ * unit per member driver at a time. RETVAL is -1 if a unit failed.
+ *
+ * @param p  The DEV_READ/DEV_WRITE message.
+ *****************************************************************************/
+PRIVATE void raid_rdwt(MESSAGE * p)
+{
+	MESSAGE sub[RAID0_NR_MEMBERS];
+	int drivers[RAID0_NR_MEMBERS];
+	int i;
+	int err = 0;
+	struct io_stamp stamp;
+
+	io_begin(&stamp);
+
+	u64 pos = p->POSITION;
+	assert((pos >> SECTOR_SIZE_SHIFT) < (1 << 31));
+	assert((pos & 0x1FF) == 0);
+
+	u32 sect = (u32)(pos >> SECTOR_SIZE_SHIFT);
+	int left = p->CNT;
+	u8 * buf = p->BUF;
+
+	assert(sect + (left >> SECTOR_SIZE_SHIFT) <=
+	       raid_member_sects * RAID0_NR_MEMBERS);
+
+	while (left) {
+		int nr = 0;
+
+		/* post one unit to each member driver */
+		while (left && nr < RAID0_NR_MEMBERS) {
+			u32 stripe = sect / RAID0_STRIPE_SECTS;
+			u32 off    = sect % RAID0_STRIPE_SECTS;
+			int m      = stripe % RAID0_NR_MEMBERS;
+			int drv    = dd_map[MAJOR(raid_members[m])].driver_nr;
+			int bytes  = min(left, (RAID0_STRIPE_SECTS - off) *
+					 SECTOR_SIZE);
+
+			for (i = 0; i < nr; i++)
+				if (drivers[i] == drv)
+					break;
+			if (i < nr)	/* that driver is busy in this round */
+				break;
+
+			u32 msect = (stripe / RAID0_NR_MEMBERS) *
+				RAID0_STRIPE_SECTS + off;
+
+			sub[nr].type	 = p->type;
+			sub[nr].DEVICE	 = MINOR(raid_members[m]);
+			sub[nr].POSITION = (u64)msect << SECTOR_SIZE_SHIFT;
+			sub[nr].CNT	 = bytes;
+			sub[nr].PROC_NR	 = p->PROC_NR;
+			sub[nr].BUF	 = buf;
+			sub[nr].RETVAL	 = 0;	/* left alone if it went well */
+			send_recv(SEND, drv, &sub[nr]);
+			drivers[nr++] = drv;
+
+			sect += bytes >> SECTOR_SIZE_SHIFT;
+			buf  += bytes;
+			left -= bytes;
+		}
+
+		/* and wait until all of them are done */
+		for (i = 0; i < nr; i++) {
+			send_recv(RECEIVE, drivers[i], &sub[i]);
+			if (sub[i].RETVAL != 0)
+				err = 1;
+		}
+	}
+
+	io_end(&raid_stat, p, &stamp, err);
+	p->RETVAL = err ? -1 : 0;
+}
+
+/* DEV_IOCTL, -1 if the caller's buffer could not be brought in */
+PRIVATE int raid_ioctl(MESSAGE * p)
+{
+	void * dst = va2la(p->PROC_NR, p->BUF);
+
+	if (p->REQUEST == DIOCTL_GET_GEO) {
+		struct part_info geo;
+		geo.base = 0;
+		geo.size = raid_member_sects * RAID0_NR_MEMBERS;
+		return pinned_copy(dst, va2la(TASK_RAID, &geo),
+				   sizeof(struct part_info));
+	}
+	else if (p->REQUEST == DIOCTL_GET_STAT) {
+		return pinned_copy(dst, va2la(TASK_RAID, &raid_stat),
+				   sizeof(struct io_stat));
+	}
+
+	assert(0);
+	return -1;
+}
+
+/*****************************************************************************
+ *                                task_raid
+ *****************************************************************************/
+/**
+ * Main loop of the RAID-0 driver.
+ *****************************************************************************/
+PUBLIC void task_raid()
+{
+	MESSAGE msg;
+
+	while (1) {
+		send_recv(RECEIVE, ANY, &msg);
+		int src = msg.source;
+
+		switch (msg.type) {
+		case DEV_OPEN: msg.RETVAL = raid_open(msg.DEVICE); break;
+		case DEV_CLOSE: raid_close(msg.DEVICE); break;
+		case DEV_READ: case DEV_WRITE: raid_rdwt(&msg); break;
+		case DEV_IOCTL: msg.RETVAL = raid_ioctl(&msg); break;
+		default:
+			dump_msg("RAID driver::unknown msg", &msg);
+			spin("RAID::main_loop (invalid msg.type)");
+			break;
+		}
+
+		send_recv(SEND, src, &msg);
+	}
+}
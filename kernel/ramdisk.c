@@ -0,0 +1,166 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   kernel/ramdisk.c
+ * @brief  RAM disk: a block device kept in the top of physical memory.
+ *
+ * The size is taken from the boot params (see RAMDISK_SIZE in config.h),
+ * MM leaves that memory alone. DEV_READ/DEV_WRITE are plain memory
+ * copies. FS mounts minor 0 at RAMDISK_MNT for scratch files.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+#include "hd.h"
+
+PRIVATE u8 *	rd_base;
+PRIVATE u32	rd_sects;
+PRIVATE struct io_stat	rd_stat;
+
+PRIVATE void init_rd();
+PRIVATE int  rd_rdwt(MESSAGE * p);
+PRIVATE int  rd_ioctl(MESSAGE * p);
+
+/*****************************************************************************
+ *                                task_rd
+ *****************************************************************************/
+/**
+ * Main loop of the RAM disk driver.
+ *****************************************************************************/
+PUBLIC void task_rd()
+{
+	MESSAGE msg;
+
+	init_rd();
+
+	while (1) {
+		send_recv(RECEIVE, ANY, &msg);
+		int src = msg.source;
+
+		switch (msg.type) {
+		case DEV_OPEN:
+			msg.RETVAL = (msg.DEVICE == 0 && rd_sects) ? 0 : -1;
+			break;
+		case DEV_CLOSE:
+			break;
+		case DEV_READ:
+		case DEV_WRITE:
+			msg.RETVAL = rd_rdwt(&msg);
+			break;
+		case DEV_IOCTL:
+			msg.RETVAL = rd_ioctl(&msg);
+			break;
+		default:
+			dump_msg("RAM disk driver::unknown msg", &msg);
+			spin("RD::main_loop (invalid msg.type)");
+			break;
+		}
+
+		send_recv(SEND, src, &msg);
+	}
+}
+
+/*****************************************************************************
+ *                                init_rd
+ *****************************************************************************/
+/**
+ * Place the RAM disk at the top of memory and wipe its super block so
+ * that FS makes a fresh file system on it. With little memory it would
+ * hold PROC_KDATA_VA, which is not identity mapped (see map_kdata()): it
+ * ends below then.
+ *****************************************************************************/
+PRIVATE void init_rd()
+{
+	struct boot_params bp;
+	get_boot_params(&bp);
+
+	int size = RAMDISK_SIZE(bp.mem_size);
+	rd_base = (u8*)(bp.mem_size - size);
+	if ((u32)rd_base <= PROC_KDATA_VA && bp.mem_size > PROC_KDATA_VA)
+		size = PROC_KDATA_VA - (u32)rd_base;
+	rd_sects = size >> SECTOR_SIZE_SHIFT;
+	if (!rd_sects)
+		return;
+
+	memset(rd_base, 0, 2 * SECTOR_SIZE);
+
+	printl("{RD} base:0x%x, size:%dMB\n", rd_base, size >> 20);
+}
+
+/*****************************************************************************
+ *                                rd_rdwt
+ *****************************************************************************/
+/**
+ * Copy between the RAM disk and the caller's buffer, pinned meanwhile.
+ *
+ * @param p  The DEV_READ/DEV_WRITE message.
+ *
+ * @return Zero if successful, -1 if the buffer could not be brought in.
+ *****************************************************************************/
+PRIVATE int rd_rdwt(MESSAGE * p)
+{
+	struct io_stamp stamp;
+	io_begin(&stamp);
+
+	u64 pos = p->POSITION;
+	assert((pos >> SECTOR_SIZE_SHIFT) < (1 << 31));
+
+	u32 off = (u32)pos;
+	assert(off + p->CNT <= rd_sects << SECTOR_SIZE_SHIFT);
+
+	void * la = (void*)va2la(p->PROC_NR, p->BUF);
+	if (pin_pages((u32)la, p->CNT, p->type == DEV_READ) != 0) {
+		io_end(&rd_stat, p, &stamp, 1);
+		return -1;
+	}
+
+	if (p->type == DEV_READ)
+		phys_copy(la, rd_base + off, p->CNT);
+	else
+		phys_copy(rd_base + off, la, p->CNT);
+
+	unpin_pages((u32)la, p->CNT);
+	io_end(&rd_stat, p, &stamp, 0);
+	return 0;
+}
+
+/*****************************************************************************
+ *                                rd_ioctl
+ *****************************************************************************/
+/**
+ * <Ring 1> Handle DEV_IOCTL. The RAM disk is one big partition.
+ *
+ * @param p  Ptr to the MESSAGE.
+ *
+ * @return Zero if successful, -1 if the caller's buffer could not be
+ *         brought in.
+ *****************************************************************************/
+PRIVATE int rd_ioctl(MESSAGE * p)
+{
+	void * dst = va2la(p->PROC_NR, p->BUF);
+
+	if (p->REQUEST == DIOCTL_GET_GEO) {
+		struct part_info geo;
+		geo.base = 0;
+		geo.size = rd_sects;
+		return pinned_copy(dst, va2la(TASK_RD, &geo),
+				   sizeof(struct part_info));
+	}
+	else if (p->REQUEST == DIOCTL_GET_STAT) {
+		return pinned_copy(dst, va2la(TASK_RD, &rd_stat),
+				   sizeof(struct io_stat));
+	}
+
+	assert(0);
+	return -1;
+}
@@ -0,0 +1,229 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   kernel/slab.c
+ * @brief  Object caches: kernel tables that grow and shrink with their use.
+ *
+ * A cache hands out objects of one size. They are carved out of slabs, a
+ * slab being one page frame with a small header at its start. A slab
+ * that becomes empty goes back to the frame allocator, except one per
+ * cache which is kept for the next allocation.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+#include "slab.h"
+
+#define	MIN_OBJ_SIZE	16
+#define	MAX_PER_SLAB	(PAGE_SIZE / MIN_OBJ_SIZE)
+
+struct slab {
+	struct slab *		next;
+	struct slab *		prev;
+	struct kmem_cache *	cache;
+	void *			free;	/* free objects, linked through their
+					   first word */
+	int			inuse;
+	u32			map[(MAX_PER_SLAB + 31) / 32];	/* objects in use */
+};
+
+#define	SLAB_OF(obj)	((struct slab*)PG_FRAME((u32)(obj)))
+/* objects of a size that is a multiple of 16 are 16-byte aligned */
+#define	SLAB_HDR_SIZE	((sizeof(struct slab) + 15) & ~15)
+#define	SLAB_OBJS(s)	((u8*)(s) + SLAB_HDR_SIZE)
+
+/* a task may allocate while the clock (or a fault) is in the kernel */
+PRIVATE void lock_slab()
+{
+	if (k_reenter == (u32)-1)
+		disable_int();
+}
+
+PRIVATE void unlock_slab()
+{
+	if (k_reenter == (u32)-1)
+		enable_int();
+}
+
+PRIVATE void slab_link(struct slab ** list, struct slab * s)
+{
+	s->prev = 0;
+	s->next = *list;
+	if (*list)
+		(*list)->prev = s;
+	*list = s;
+}
+
+PRIVATE void slab_unlink(struct slab ** list, struct slab * s)
+{
+	if (s->prev)
+		s->prev->next = s->next;
+	else
+		*list = s->next;
+	if (s->next)
+		s->next->prev = s->prev;
+}
+
+/* turn a fresh frame into a slab of free objects */
+PRIVATE struct slab * init_slab(struct kmem_cache * c, u32 pa)
+{
+	struct slab * s = (struct slab*)pa;
+	int i;
+
+	memset(s, 0, sizeof(struct slab));
+	s->cache = c;
+	for (i = c->per_slab - 1; i >= 0; i--) {
+		void ** obj = (void**)(SLAB_OBJS(s) + i * c->size);
+		*obj = s->free;
+		s->free = obj;
+	}
+	return s;
+}
+
+/*****************************************************************************
+ *                                kmem_alloc
+ *****************************************************************************/
+/**
+ * Allocate an object from a cache.
+ *
+ * @param c  The cache.
+ *
+ * @return The object, zeroed. 0 if out of memory.
+ *****************************************************************************/
+PUBLIC void * kmem_alloc(struct kmem_cache * c)
+{
+	if (!c->per_slab) {
+		c->size = max((c->size + 3) & ~3, MIN_OBJ_SIZE);
+		c->per_slab = (PAGE_SIZE - SLAB_HDR_SIZE) / c->size;
+		assert(c->per_slab > 0 && c->per_slab <= MAX_PER_SLAB);
+	}
+
+	lock_slab();
+	if (!c->partial && c->empty) {
+		slab_link(&c->partial, c->empty);
+		c->empty = 0;
+	}
+	if (!c->partial) {
+		/* alloc_frame() takes the lock itself */
+		unlock_slab();
+		u32 pa = alloc_frame();
+		if (!pa)
+			return 0;
+		struct slab * fresh = init_slab(c, pa);
+
+		lock_slab();
+		slab_link(&c->partial, fresh);
+		c->nr_slabs++;
+	}
+
+	struct slab * s = c->partial;
+	void ** obj = s->free;
+	s->free = *obj;
+	s->inuse++;
+	int i = ((u8*)obj - SLAB_OBJS(s)) / c->size;
+	s->map[i / 32] |= 1 << (i % 32);
+	if (!s->free) {
+		slab_unlink(&c->partial, s);
+		slab_link(&c->full, s);
+	}
+	c->nr_objs++;
+	unlock_slab();
+
+	memset(obj, 0, c->size);
+	return obj;
+}
+
+/*****************************************************************************
+ *                                kmem_free
+ *****************************************************************************/
+/**
+ * Give an object back to its cache.
+ *
+ * @param c    The cache it came from.
+ * @param obj  The object.
+ *****************************************************************************/
+PUBLIC void kmem_free(struct kmem_cache * c, void * obj)
+{
+	struct slab * s = SLAB_OF(obj);
+	struct slab * release = 0;
+	int i = ((u8*)obj - SLAB_OBJS(s)) / c->size;
+
+	assert(s->cache == c);
+	assert((u8*)obj == SLAB_OBJS(s) + i * c->size);
+	assert(s->map[i / 32] & (1 << (i % 32)));
+
+	lock_slab();
+	s->map[i / 32] &= ~(1 << (i % 32));
+	if (!s->free) {
+		slab_unlink(&c->full, s);
+		slab_link(&c->partial, s);
+	}
+	*(void**)obj = s->free;
+	s->free = obj;
+	c->nr_objs--;
+
+	if (--s->inuse == 0) {
+		slab_unlink(&c->partial, s);
+		if (c->empty) {
+			release = s;
+			c->nr_slabs--;
+		}
+		else {
+			c->empty = s;
+		}
+	}
+	unlock_slab();
+
+	if (release)
+		free_frame((u32)release);
+}
+
+/* the first object in use from slot i of s on, s and its successors */
+PRIVATE void * next_obj(struct kmem_cache * c, struct slab * s, int i)
+{
+	for (; s; s = s->next, i = 0)
+		for (; i < c->per_slab; i++)
+			if (s->map[i / 32] & (1 << (i % 32)))
+				return SLAB_OBJS(s) + i * c->size;
+	return 0;
+}
+
+/*****************************************************************************
+ *                                kmem_first
+ *****************************************************************************/
+/**
+ * Walk the objects in use of a cache, for debugging dumps. The cache must
+ * not change during the walk.
+ *
+ * @param c  The cache.
+ *
+ * @return The first object, 0 if there is none.
+ *****************************************************************************/
+PUBLIC void * kmem_first(struct kmem_cache * c)
+{
+	void * obj = next_obj(c, c->partial, 0);
+	return obj ? obj : next_obj(c, c->full, 0);
+}
+
+/* the object after obj, see kmem_first() */
+PUBLIC void * kmem_next(struct kmem_cache * c, void * obj)
+{
+	struct slab * s = SLAB_OF(obj);
+	int i = ((u8*)obj - SLAB_OBJS(s)) / c->size;
+	int in_full = !s->free;
+
+	obj = next_obj(c, s, i + 1);
+	if (!obj && !in_full)
+		obj = next_obj(c, c->full, 0);
+	return obj;
+}
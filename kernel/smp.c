@@ -0,0 +1,259 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   kernel/smp.c
+ * @brief  The other CPUs: started at boot, each running procs of its own.
+ *
+ * There is one lock, kernel_lock, held by the CPU in the kernel: save()
+ * takes it when a CPU comes in from a proc, restart() gives it back. So the
+ * kernel still runs on one CPU at a time and needs no finer locks, while
+ * the procs run on all of them. Tasks stay on CPU 0, where the IRQs come,
+ * and take the lock whenever they turn interrupts off (see disable_int()).
+ *
+ * A proc runs on the CPU its p_cpu says, schedule() picks among those of
+ * its CPU. CPU 0 moves procs from the busiest CPU to the idlest now and
+ * then (see balance()). A CPU with nothing to run halts in its idle_proc
+ * until it is kicked by a reschedule IPI. Mappings changed on one CPU are
+ * flushed from the others by a TLB shootdown IPI.
+ *
+ * This is short of locks of their own around proc_table and the IPC state,
+ * and of FS and MM running in parallel. kernel_lock stands for every
+ * lock: syscalls, IPC and handlers of different CPUs never overlap, only
+ * procs do. The run queue of a CPU is the procs of proc_table whose p_cpu
+ * it is. FS, MM and the drivers are tasks and share CPU 0: they run
+ * alongside the procs of the other CPUs, not alongside each other. To
+ * go further, proc_table and the IPC state need locks of their own, and
+ * the alarms of TASK_SYS, kept by CPU 0's clock, need to work from any CPU.
+ * Only then can tasks leave CPU 0.
+ *
+ * No MP or ACPI table is read: every CPU that answers the startup IPIs in
+ * time is used, up to NR_CPUS.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+#define	TRAMPOLINE_BASE	0x90000		/* LOADER was here; also in sconst.inc */
+#define	AP_STACK_SIZE	(2 * 1024)	/* as the BSP's, see kernel.asm */
+#define	AP_WAIT_MS	10		/* for the CPUs to answer */
+
+/* kernel.asm */
+void	ap_trampoline();
+void	ap_trampoline_end();
+void	cpu_idle();
+extern	u32	tr_cr0;
+extern	u32	tr_cr4;
+
+PUBLIC	volatile int		kernel_lock = 1;	/* CPU 0 has it at boot */
+PUBLIC	struct cpu * volatile	kernel_owner = &cpus[0];
+PUBLIC	volatile int		ap_count = 1;	/* CPUs up, see ap_start */
+
+PRIVATE	u8	ap_stacks[NR_CPUS - 1][AP_STACK_SIZE];
+PRIVATE	int	apic_ids[NR_CPUS];
+
+/* 1 if it was set already */
+PRIVATE int test_and_set(volatile int * lock)
+{
+	int old = 1;
+
+	__asm__ __volatile__("xchgl %0, %1"
+			     : "+r"(old), "+m"(*lock) :: "memory");
+	return old;
+}
+
+PRIVATE void reload_cr3()
+{
+	__asm__ __volatile__("movl %%cr3, %%eax\n\t"
+			     "movl %%eax, %%cr3" ::: "eax", "memory");
+}
+
+/*****************************************************************************
+ *                                lock_kernel
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Take kernel_lock, as save() does. This CPU may hold it already:
+ * a task faulting with interrupts off, say. A TLB shootdown must get
+ * through while it waits: a task waits with interrupts on, the kernel
+ * flushes by itself.
+ *****************************************************************************/
+PUBLIC void lock_kernel()
+{
+	struct cpu * c = this_cpu();
+	u16 cs;
+
+	if (kernel_owner == c) {
+		c->lock_depth++;
+		return;
+	}
+
+	__asm__ __volatile__("movw %%cs, %0" : "=r"(cs));
+	while (test_and_set(&kernel_lock)) {
+		if (cs & SA_RPL_MASK)
+			__asm__ __volatile__("sti");
+		while (kernel_lock) {
+			if (c->flush && !(cs & SA_RPL_MASK)) {
+				reload_cr3();
+				c->flush = 0;
+			}
+			__asm__ __volatile__("pause");
+		}
+		__asm__ __volatile__("cli");
+	}
+	kernel_owner = c;
+}
+
+/*****************************************************************************
+ *                                unlock_kernel
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Give kernel_lock back, see enable_int().
+ *****************************************************************************/
+PUBLIC void unlock_kernel()
+{
+	struct cpu * c = this_cpu();
+
+	if (kernel_owner != c)
+		return;		/* enable_int() with no disable_int() */
+
+	if (c->lock_depth) {
+		c->lock_depth--;
+		return;
+	}
+	kernel_owner = 0;
+	kernel_lock = 0;
+}
+
+/*****************************************************************************
+ *                                kick_cpu
+ *****************************************************************************/
+/**
+ * <Ring 0> Have an idle CPU look for a proc to run.
+ *
+ * @param cpu  The CPU.
+ *****************************************************************************/
+PUBLIC void kick_cpu(int cpu)
+{
+	if (cpus[cpu].proc == &idle_proc[cpu] && cpu != cpu_id())
+		send_ipi(apic_ids[cpu], INT_VECTOR_RESCHED);
+}
+
+/* <Ring 0> the reschedule IPI, see resched_ipi in kernel.asm */
+PUBLIC void resched_handler()
+{
+	if (k_reenter == 0)
+		schedule();
+}
+
+/*****************************************************************************
+ *                                tlb_shootdown
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Have the other CPUs flush their TLBs as this one did, and
+ * wait until they have. With kernel_lock held.
+ *****************************************************************************/
+PUBLIC void tlb_shootdown()
+{
+	struct cpu * c;
+
+	for (c = cpus; c < cpus + nr_cpus; c++)
+		if (c != this_cpu() && c->proc) {
+			c->flush = 1;
+			send_ipi(apic_ids[c - cpus], INT_VECTOR_TLB);
+		}
+
+	for (c = cpus; c < cpus + nr_cpus; c++)
+		while (c->flush)
+			__asm__ __volatile__("pause");
+}
+
+/*****************************************************************************
+ *                                init_smp
+ *****************************************************************************/
+/**
+ * <Ring 0> Make the idle procs and wake the other CPUs up, after
+ * init_clock(). They wait for kernel_lock, until restart().
+ *****************************************************************************/
+PUBLIC void init_smp()
+{
+	u32 cr0, cr4;
+	int i;
+
+	for (i = 0; i < NR_CPUS; i++) {
+		struct proc * p = &idle_proc[i];
+
+		strcpy(p->name, "IDLE");
+		p->regs.cs	= SELECTOR_KERNEL_CS;
+		p->regs.ds	=
+			p->regs.es =
+			p->regs.fs = SELECTOR_KERNEL_DS;
+		p->regs.gs	= SELECTOR_KERNEL_GS;
+		p->regs.eip	= (u32)cpu_idle;
+		p->regs.eflags	= 0x202;	/* IF=1, bit 2 is always 1 */
+		p->p_cr3	= PAGE_DIR_BASE;
+		p->ldt_sel	= proc_table[0].ldt_sel;	/* it uses none */
+		p->p_cpu	= i;
+	}
+
+	nr_cpus = 1;
+	KDATA->nr_cpus = 1;
+	apic_ids[0] = lapic_id();
+	if (apic_ids[0] < 0 || !clock_per_cpu())
+		return;
+
+	for (i = 1; i < NR_CPUS; i++)
+		cpus[i].stack_top = (u32)ap_stacks[i - 1] + AP_STACK_SIZE;
+
+	memcpy((void*)TRAMPOLINE_BASE, (void*)ap_trampoline,
+	       (u32)ap_trampoline_end - (u32)ap_trampoline);
+	__asm__ __volatile__("movl %%cr0, %0" : "=r"(cr0));
+	__asm__ __volatile__("movl %%cr4, %0" : "=r"(cr4));
+	*(u32*)(TRAMPOLINE_BASE + ((u32)&tr_cr0 - (u32)ap_trampoline)) = cr0;
+	*(u32*)(TRAMPOLINE_BASE + ((u32)&tr_cr4 - (u32)ap_trampoline)) = cr4;
+
+	startup_ipis(TRAMPOLINE_BASE);
+
+	u64 end = read_tsc() + (u64)KDATA->tsc_khz * AP_WAIT_MS;
+	while (read_tsc() < end)
+		;
+
+	/* those coming later park, see ap_main() */
+	nr_cpus = min(ap_count, NR_CPUS);
+	KDATA->nr_cpus = nr_cpus;
+}
+
+/*****************************************************************************
+ *                                ap_main
+ *****************************************************************************/
+/**
+ * <Ring 0> Where another CPU goes on from ap_start, on its own stack and
+ * TSS. It sets up what is its own and starts running procs.
+ *
+ * @param cpu  Its number.
+ *****************************************************************************/
+PUBLIC void ap_main(int cpu)
+{
+	apic_ids[cpu] = init_lapic_cpu();
+	init_fpu_cpu();
+	init_sysenter_cpu(cpu);
+
+	lock_kernel();
+	if (cpu >= nr_cpus) {		/* too late */
+		unlock_kernel();
+		while (1)
+			__asm__ __volatile__("hlt");
+	}
+
+	init_clock_cpu();
+	p_proc_ready = &idle_proc[cpu];		/* until schedule() */
+	schedule();
+	restart();
+}
@@ -12,22 +12,21 @@
 #include "keyboard.h"
 #include "proto.h"
 
-PRIVATE int read_register(char reg_addr);
-PRIVATE u32 get_rtc_time(struct time *t);
-
 
 PUBLIC void task_sys()
 {
 	MESSAGE msg;
 	struct time t;
+	int pid;
 
 	while (1) {
 		send_recv(RECEIVE, ANY, &msg);
 		int src = msg.source;
 
 		switch (msg.type) {
+		/* these are in the kernel data page now, see struct kdata */
 		case GET_TICKS:
-			msg.RETVAL = ticks;
+			msg.RETVAL = get_ticks();
 			send_recv(SEND, src, &msg);
 			break;
 		case GET_PID:
@@ -37,12 +36,21 @@ PUBLIC void task_sys()
 			break;
 		case GET_RTC_TIME:
 			msg.type = SYSCALL_RET;
-			get_rtc_time(&t);
+			get_time(&t);
 			phys_copy(va2la(src, msg.BUF),
 				  va2la(TASK_SYS, &t),
 				  sizeof(t));
 			send_recv(SEND, src, &msg);
 			break;
+		case SLEEP:	/* answered when the alarm is up */
+			set_alarm(src, msg.USECS);
+			break;
+		case HARD_INT:	/* alarms are up, see clock_handler() */
+			while ((pid = get_expired_alarm()) != -1) {
+				msg.type = SYSCALL_RET;
+				send_recv(SEND, pid, &msg);
+			}
+			break;
 		default:
 			panic("unknown msg type");
 			break;
@@ -50,36 +58,3 @@ PUBLIC void task_sys()
 	}
 }
 
-
-
-PRIVATE u32 get_rtc_time(struct time *t)
-{
-	t->year = read_register(YEAR);
-	t->month = read_register(MONTH);
-	t->day = read_register(DAY);
-	t->hour = read_register(HOUR);
-	t->minute = read_register(MINUTE);
-	t->second = read_register(SECOND);
-
-	if ((read_register(CLK_STATUS) & 0x04) == 0) {
-
-		t->year = BCD_TO_DEC(t->year);
-		t->month = BCD_TO_DEC(t->month);
-		t->day = BCD_TO_DEC(t->day);
-		t->hour = BCD_TO_DEC(t->hour);
-		t->minute = BCD_TO_DEC(t->minute);
-		t->second = BCD_TO_DEC(t->second);
-	}
-
-	t->year += 2000;
-
-	return 0;
-}
-
-
-PRIVATE int read_register(char reg_addr)
-{
-	out_byte(CLK_ELE, reg_addr);
-	return in_byte(CLK_IO);
-}
-
@@ -230,6 +230,11 @@ PUBLIC int sys_printx(int _unused1, int _unused2, char* s, struct proc* p_proc)
 	else if (k_reenter > 0) p = s;
 	else	p = reenter_err;
 
+	if (k_reenter == 0 && swap_wait((u32)p, STR_DEFAULT_LEN)) {
+		p_proc->regs.eip -= 2;	/* back to the int or sysenter */
+		return p_proc->regs.eax;
+	}
+
 	if ((*p == MAG_CH_PANIC) ||
 	    (*p == MAG_CH_ASSERT && p_proc_ready < &proc_table[NR_TASKS])) {
 		disable_int();
@@ -0,0 +1,415 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   kernel/vblk.c
+ * @brief  virtio-blk driver (legacy virtio-pci).
+ *
+ * One virtqueue is used. Every request takes a single ring descriptor which
+ * points to an indirect table (header, data segments, status), so a
+ * DEV_READ/DEV_WRITE of any size is split into a batch of requests that are
+ * all posted before the device is notified once.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+#include "hd.h"
+#include "pci.h"
+#include "virtio.h"
+
+#define	NR_VBLK_REQS	16	/* requests in flight at a time */
+#define	VBLK_MAX_SEGS	32	/* data segments of a request */
+#define	VBLK_SEG_SIZE	4096	/* a segment never crosses a page */
+#define	VBLK_QUEUE_MAX	256
+
+/* keep the compiler from moving memory accesses across, x86 keeps stores
+ * in order itself */
+#define	barrier()	__asm__ __volatile__("" ::: "memory")
+
+struct vblk_req {
+	struct vring_desc		tbl[VBLK_MAX_SEGS + 2]; /* indirect */
+	int				nr_desc;
+	struct virtio_blk_outhdr	hdr;
+	volatile u8			status;	/* written by the device */
+};
+
+PRIVATE int			vblk_iobase;
+PRIVATE int			vblk_irq;
+PRIVATE int			vblk_qsize;
+PRIVATE u16			vblk_last_used;
+PRIVATE volatile struct vring_desc *	vq_desc;
+PRIVATE volatile struct vring_avail *	vq_avail;
+PRIVATE volatile struct vring_used *	vq_used;
+PRIVATE u8			vq_mem[VRING_SIZE(VBLK_QUEUE_MAX) + VRING_ALIGN];
+PRIVATE struct vblk_req		vblk_reqs[NR_VBLK_REQS];
+PRIVATE u8			vblkbuf[SECTOR_SIZE];
+PRIVATE struct hd_info		vblk_info[1];
+PRIVATE struct io_stat		vblk_stat;
+
+PRIVATE void interrupt_wait()
+{
+	MESSAGE msg;
+	send_recv(RECEIVE, INTERRUPT, &msg);
+}
+
+/*****************************************************************************
+ *                                init_vblk
+ *****************************************************************************/
+/**
+ * <Ring 1> Find the device, negotiate features and set up the virtqueue.
+ *****************************************************************************/
+PRIVATE void init_vblk()
+{
+	memset(vblk_info, 0, sizeof(vblk_info));
+
+	int dev = pci_find_device(VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID, 0);
+	if (dev == -1) {
+		printl("{VBLK} no virtio-blk device.\n");
+		return;
+	}
+
+	u32 bar0 = pci_read_config(dev, PCI_BAR0);
+	assert(bar0 & PCI_BAR_IO);
+	int iobase = bar0 & PCI_BAR_IO_MASK;
+	vblk_irq = pci_read_config(dev, PCI_INTERRUPT_LINE) & 0xFF;
+
+	u32 cmd = pci_read_config(dev, PCI_COMMAND) & 0xFFFF;
+	pci_write_config(dev, PCI_COMMAND, cmd | PCI_CMD_IO | PCI_CMD_MASTER);
+
+	out_byte(iobase + VIRTIO_PCI_STATUS, 0); /* reset */
+	out_byte(iobase + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACK);
+	out_byte(iobase + VIRTIO_PCI_STATUS,
+		 VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+
+	u32 features = in_dword(iobase + VIRTIO_PCI_HOST_FEATURES);
+	if (!(features & (1 << VIRTIO_RING_F_INDIRECT_DESC))) {
+		printl("{VBLK} indirect descriptors not offered.\n");
+		out_byte(iobase + VIRTIO_PCI_STATUS, VIRTIO_STATUS_FAILED);
+		return;
+	}
+	out_dword(iobase + VIRTIO_PCI_GUEST_FEATURES,
+		  1 << VIRTIO_RING_F_INDIRECT_DESC);
+
+	out_word(iobase + VIRTIO_PCI_QUEUE_SEL, 0);
+	vblk_qsize = in_word(iobase + VIRTIO_PCI_QUEUE_NUM);
+	assert(vblk_qsize >= NR_VBLK_REQS && vblk_qsize <= VBLK_QUEUE_MAX);
+
+	/* the legacy interface wants the ring page aligned */
+	u8 * ring = (u8*)VRING_ALIGN_UP((u32)va2la(TASK_VBLK, vq_mem));
+	memset(ring, 0, VRING_SIZE(vblk_qsize));
+	vq_desc  = (struct vring_desc *)ring;
+	vq_avail = (struct vring_avail *)(ring + VRING_AVAIL_OFF(vblk_qsize));
+	vq_used  = (struct vring_used *)(ring + VRING_USED_OFF(vblk_qsize));
+	vblk_last_used = 0;
+	out_dword(iobase + VIRTIO_PCI_QUEUE_PFN, (u32)ring / VRING_ALIGN);
+
+	vblk_info[0].primary[0].base = 0;
+	vblk_info[0].primary[0].size = in_dword(iobase +
+						VIRTIO_BLK_CFG_CAPACITY);
+
+	put_irq_handler(vblk_irq, vblk_handler);
+	if (vblk_irq >= 8)
+		enable_irq(CASCADE_IRQ);
+	enable_irq(vblk_irq);
+
+	out_byte(iobase + VIRTIO_PCI_STATUS,
+		 VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER |
+		 VIRTIO_STATUS_DRIVER_OK);
+	vblk_iobase = iobase;
+
+	printl("{VBLK} irq:%d, queue:%d, size:%dMB\n", vblk_irq, vblk_qsize,
+	       vblk_info[0].primary[0].size / 2048);
+}
+
+/*****************************************************************************
+ *                                vblk_prep
+ *****************************************************************************/
+/**
+ * Fill in the indirect table of a request. The data is cut into segments
+ * at page boundaries, so at most VBLK_MAX_SEGS pages go in one request.
+ *
+ * @param req    The request.
+ * @param type   VIRTIO_BLK_T_IN or VIRTIO_BLK_T_OUT.
+ * @param sect   Absolute sector nr.
+ * @param pid    Whose buffer.
+ * @param buf    The buffer, as seen by `pid'.
+ * @param bytes  Bytes left to transfer.
+ *
+ * @return Bytes covered by this request.
+ *****************************************************************************/
+PRIVATE int vblk_prep(struct vblk_req * req, int type, u32 sect,
+		      int pid, u8 * buf, int bytes)
+{
+	int n = 0;
+	int len = 0;
+
+	req->hdr.type	= type;
+	req->hdr.ioprio	= 0;
+	req->hdr.sector	= sect;
+	req->status	= 0xFF;
+
+	req->tbl[0].addr  = (u32)va2la(TASK_VBLK, &req->hdr);
+	req->tbl[0].len   = sizeof(req->hdr);
+	req->tbl[0].flags = VRING_DESC_F_NEXT;
+	req->tbl[0].next  = 1;
+
+	while (len < bytes && n < VBLK_MAX_SEGS) {
+		u32 la = (u32)va2la(pid, buf + len);
+		int seg = min(bytes - len,
+			      VBLK_SEG_SIZE - (la & (VBLK_SEG_SIZE - 1)));
+
+		n++;
+		req->tbl[n].addr  = (u32)la2pa((void*)la);
+		req->tbl[n].len   = seg;
+		req->tbl[n].flags = VRING_DESC_F_NEXT |
+			(type == VIRTIO_BLK_T_IN ? VRING_DESC_F_WRITE : 0);
+		req->tbl[n].next  = n + 1;
+		len += seg;
+	}
+
+	/* the request must end on a sector boundary */
+	int partial = len % SECTOR_SIZE;
+	req->tbl[n].len -= partial;
+	len -= partial;
+
+	n++;
+	req->tbl[n].addr  = (u32)va2la(TASK_VBLK, (void*)&req->status);
+	req->tbl[n].len   = 1;
+	req->tbl[n].flags = VRING_DESC_F_WRITE;
+	req->tbl[n].next  = 0;
+	req->nr_desc = n + 1;
+
+	return len;
+}
+
+/*****************************************************************************
+ *                                vblk_io
+ *****************************************************************************/
+/**
+ * Transfer `bytes' bytes starting at absolute sector `sect'. Requests are
+ * posted in batches of NR_VBLK_REQS; the device is kicked once per batch
+ * and we sleep until the whole batch is back.
+ *
+ * @param io_type  DEV_READ or DEV_WRITE.
+ * @param sect     Absolute sector nr.
+ * @param pid      Whose buffer.
+ * @param buf      The buffer, as seen by `pid'.
+ * @param bytes    How many bytes, a multiple of SECTOR_SIZE.
+ *
+ * @return Zero if successful, -1 if the device failed a request.
+ *****************************************************************************/
+PRIVATE int vblk_io(int io_type, u32 sect, int pid, u8 * buf, int bytes)
+{
+	int type = (io_type == DEV_READ) ? VIRTIO_BLK_T_IN : VIRTIO_BLK_T_OUT;
+	int err = 0;
+	int i;
+
+	assert(bytes % SECTOR_SIZE == 0);
+
+	while (bytes) {
+		int nr_reqs = 0;
+		while (bytes && nr_reqs < NR_VBLK_REQS) {
+			struct vblk_req * req = &vblk_reqs[nr_reqs];
+			int len = vblk_prep(req, type, sect, pid, buf, bytes);
+
+			vq_desc[nr_reqs].addr  = (u32)va2la(TASK_VBLK, req->tbl);
+			vq_desc[nr_reqs].len   = sizeof(struct vring_desc) *
+						 req->nr_desc;
+			vq_desc[nr_reqs].flags = VRING_DESC_F_INDIRECT;
+			vq_desc[nr_reqs].next  = 0;
+			vq_avail->ring[(vq_avail->idx + nr_reqs) % vblk_qsize] =
+				nr_reqs;
+
+			sect  += len >> SECTOR_SIZE_SHIFT;
+			buf   += len;
+			bytes -= len;
+			nr_reqs++;
+		}
+
+		/* publish the whole batch once it is all written, then kick
+		 * the device once */
+		barrier();
+		vq_avail->idx += nr_reqs;
+		barrier();
+		if (!(vq_used->flags & VRING_USED_F_NO_NOTIFY))
+			out_word(vblk_iobase + VIRTIO_PCI_QUEUE_NOTIFY, 0);
+
+		int done = 0;
+		while (1) {
+			while (vblk_last_used != vq_used->idx) {
+				vblk_last_used++;
+				done++;
+			}
+			if (done == nr_reqs)
+				break;
+			interrupt_wait();
+		}
+
+		barrier();
+		for (i = 0; i < nr_reqs; i++)
+			if (vblk_reqs[i].status != VIRTIO_BLK_S_OK)
+				err = 1;
+	}
+
+	return err ? -1 : 0;
+}
+
+PRIVATE void get_part_table(int drive, int sect_nr, struct part_ent * entry)
+{
+	if (vblk_io(DEV_READ, sect_nr, TASK_VBLK, vblkbuf, SECTOR_SIZE) != 0)
+		memset(vblkbuf, 0, SECTOR_SIZE);	/* no partitions */
+	memcpy(entry,
+	       vblkbuf + PARTITION_TABLE_OFFSET,
+	       sizeof(struct part_ent) * NR_PART_PER_DRIVE);
+}
+
+PRIVATE int vblk_open(int device)
+{
+	if (!vblk_iobase || !valid_minor(device) ||
+	    DRV_OF_DEV(device) != 0) /* only one drive */
+		return -1;
+
+	int drive = DRV_OF_DEV(device);
+
+	if (vblk_info[drive].open_cnt == 0) {
+		partition(&vblk_info[drive], drive * (NR_PART_PER_DRIVE + 1),
+			  P_PRIMARY, get_part_table);
+	}
+	if (get_part_info(&vblk_info[drive], device)->size == 0)
+		return -1;	/* no such partition */
+	vblk_info[drive].open_cnt++;
+
+	return 0;
+}
+
+PRIVATE void vblk_close(int device)
+{
+	int drive = DRV_OF_DEV(device);
+	assert(drive == 0);	/* only one drive */
+
+	vblk_info[drive].open_cnt--;
+}
+
+/*****************************************************************************
+ *                                vblk_rdwt
+ *****************************************************************************/
+/**
+ * Serve DEV_READ/DEV_WRITE. The caller's buffer stays pinned until the
+ * device is done with it.
+ *
+ * @param p  The message.
+ *
+ * @return Zero if successful, -1 if the buffer could not be brought in or
+ *         the device reported an error.
+ *****************************************************************************/
+PRIVATE int vblk_rdwt(MESSAGE * p)
+{
+	int drive = DRV_OF_DEV(p->DEVICE);
+
+	u64 pos = p->POSITION;
+	assert((pos >> SECTOR_SIZE_SHIFT) < (1 << 31));
+	assert((pos & 0x1FF) == 0);
+
+	u32 sect_nr = (u32)(pos >> SECTOR_SIZE_SHIFT); /* pos / SECTOR_SIZE */
+	sect_nr += get_part_info(&vblk_info[drive], p->DEVICE)->base;
+
+	struct io_stamp stamp;
+	io_begin(&stamp);
+
+	u32 la = (u32)va2la(p->PROC_NR, p->BUF);
+	if (pin_pages(la, p->CNT, p->type == DEV_READ) != 0) {
+		io_end(&vblk_stat, p, &stamp, 1);
+		return -1;
+	}
+	int err = vblk_io(p->type, sect_nr, p->PROC_NR, p->BUF, p->CNT);
+	unpin_pages(la, p->CNT);
+
+	io_end(&vblk_stat, p, &stamp, err != 0);
+	return err;
+}
+
+/*****************************************************************************
+ *                                vblk_ioctl
+ *****************************************************************************/
+/**
+ * Serve DEV_IOCTL. The minor may come from a proc, see iostat().
+ *
+ * @param p  The message.
+ *
+ * @return Zero if successful, -1 if there is no such device.
+ *****************************************************************************/
+PRIVATE int vblk_ioctl(MESSAGE * p)
+{
+	int device = p->DEVICE;
+
+	if (!valid_minor(device) || DRV_OF_DEV(device) != 0)
+		return -1;	/* only one drive */
+
+	struct hd_info * hdi = &vblk_info[0];
+
+	void * dst = va2la(p->PROC_NR, p->BUF);
+
+	if (p->REQUEST == DIOCTL_GET_GEO)
+		return pinned_copy(dst,
+				   va2la(TASK_VBLK, get_part_info(hdi, device)),
+				   sizeof(struct part_info));
+	else if (p->REQUEST == DIOCTL_GET_STAT)
+		return pinned_copy(dst, va2la(TASK_VBLK, &vblk_stat),
+				   sizeof(struct io_stat));
+
+	assert(0);
+	return -1;
+}
+
+/*****************************************************************************
+ *                                task_vblk
+ *****************************************************************************/
+/**
+ * Main loop of the virtio-blk driver.
+ *****************************************************************************/
+PUBLIC void task_vblk()
+{
+	MESSAGE msg;
+
+	init_vblk();
+
+	while (1) {
+		send_recv(RECEIVE, ANY, &msg);
+		int src = msg.source;
+
+		switch (msg.type) {
+		case DEV_OPEN: msg.RETVAL = vblk_open(msg.DEVICE); break;
+		case DEV_CLOSE: vblk_close(msg.DEVICE); break;
+		case DEV_READ: case DEV_WRITE: msg.RETVAL = vblk_rdwt(&msg); break;
+		case DEV_IOCTL: msg.RETVAL = vblk_ioctl(&msg); break;
+		default:
+			dump_msg("VBLK driver::unknown msg", &msg);
+			spin("VBLK::main_loop (invalid msg.type)");
+			break;
+		}
+
+		send_recv(SEND, src, &msg);
+	}
+}
+
+/*****************************************************************************
+ *                                vblk_handler
+ *****************************************************************************/
+/**
+ * <Ring 0> Reading the ISR register acks the (level triggered) interrupt.
+ *
+ * @param irq  The IRQ nr.
+ *****************************************************************************/
+PUBLIC void vblk_handler(int irq)
+{
+	if (in_byte(vblk_iobase + VIRTIO_PCI_ISR) & VIRTIO_ISR_QUEUE)
+		defer_int(TASK_VBLK);
+}
@@ -0,0 +1,150 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   kernel/work.c
+ * @brief  Work deferred by interrupt handlers, and how long interrupts
+ *         stay off.
+ *
+ * A handler does what cannot wait, reading the device, and queues the rest
+ * as a struct work. restart() runs what was queued on its CPU before going
+ * back to a proc (see run_work()), with interrupts on and k_reenter 0: the
+ * work is never in the middle of another handler or of a syscall, and may
+ * schedule().
+ *
+ * Telling a task its interrupt came is such work, see defer_int().
+ *
+ * disable_int() and save_int() note when interrupts go off, enable_int()
+ * and restore_int() how long they were (see kliba.asm). The longest time
+ * is in the kernel data page, with where it ended, see irqoff_time().
+ * Interrupt and exception entries are not counted.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+#include "work.h"
+
+PRIVATE void inform_ints(struct work * w);
+
+PRIVATE struct work *	work_list[NR_CPUS];
+PRIVATE struct work	int_work = WORK(inform_ints);
+PRIVATE u32		pending_ints;	/* tasks to inform, a bit each */
+
+PRIVATE u64		irqoff_tsc[NR_CPUS];	/* when they went off, or 0 */
+
+/*****************************************************************************
+ *                                queue_work
+ *****************************************************************************/
+/**
+ * <Ring 0> Have some work done on this CPU before it goes back to a proc.
+ * Nothing happens if it is queued already.
+ *
+ * @param w  The work.
+ *****************************************************************************/
+PUBLIC void queue_work(struct work * w)
+{
+	u32 eflags = save_int();
+	int cpu = cpu_id();
+
+	if (!w->queued) {
+		w->queued = 1;
+		w->next = work_list[cpu];
+		work_list[cpu] = w;
+	}
+	restore_int(eflags);
+}
+
+/*****************************************************************************
+ *                                defer_int
+ *****************************************************************************/
+/**
+ * <Ring 0> inform_int() for interrupt handlers: the task is told once the
+ * handler has returned. A handler may come in the middle of a sendrec().
+ *
+ * @param task_nr  The task.
+ *****************************************************************************/
+PUBLIC void defer_int(int task_nr)
+{
+	u32 eflags = save_int();
+
+	pending_ints |= 1 << task_nr;
+	queue_work(&int_work);
+	restore_int(eflags);
+}
+
+PRIVATE void inform_ints(struct work * w)
+{
+	int i;
+
+	disable_int();
+	u32 pending = pending_ints;
+	pending_ints = 0;
+	enable_int();
+
+	for (i = 0; i < NR_TASKS; i++)
+		if (pending & (1 << i))
+			inform_int(i);
+}
+
+/*****************************************************************************
+ *                                run_work
+ *****************************************************************************/
+/**
+ * <Ring 0> Run what is queued on this CPU, for restart(). Called and
+ * returning with interrupts off, they are on while the work runs, and
+ * more may be queued meanwhile.
+ *****************************************************************************/
+PUBLIC void run_work()
+{
+	int cpu = cpu_id();
+	struct work * w;
+
+	while ((w = work_list[cpu]) != 0) {
+		work_list[cpu] = w->next;
+		w->queued = 0;
+
+		__asm__ __volatile__("sti");
+		w->func(w);
+		__asm__ __volatile__("cli");
+	}
+}
+
+/* <Ring 0~1> interrupts just went off, see disable_int() */
+PUBLIC void irqoff_begin()
+{
+	irqoff_tsc[cpu_id()] = read_tsc();
+}
+
+/*****************************************************************************
+ *                                irqoff_end
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Interrupts go back on, see enable_int(). The time they were
+ * off is kept if it is the longest so far.
+ *
+ * @param eip  Where, the caller of enable_int() or restore_int().
+ *****************************************************************************/
+PUBLIC void irqoff_end(u32 eip)
+{
+	int cpu = cpu_id();
+	u64 start = irqoff_tsc[cpu];
+
+	if (!start)	/* off since an interrupt came, or unpaired */
+		return;
+	irqoff_tsc[cpu] = 0;
+
+	u64 d = read_tsc() - start;
+	u32 cycles = (d >> 32) ? 0xFFFFFFFF : (u32)d;
+	if (cycles > KDATA->irqoff_max) {
+		KDATA->irqoff_max = cycles;
+		KDATA->irqoff_eip = eip;
+	}
+}
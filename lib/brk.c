@@ -0,0 +1,73 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   brk.c
+ * @brief  brk(), sbrk()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+PRIVATE u32 cur_brk;	/* 0 until asked from MM */
+
+/* ask MM to move the break, 0 only asks where it is */
+PRIVATE int send_brk(u32 addr)
+{
+	MESSAGE msg;
+	msg.type = BRK;
+	msg.BUF	 = (void*)addr;
+
+	send_recv(BOTH, TASK_MM, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	if (msg.RETVAL == 0)
+		cur_brk = (u32)msg.BUF;
+	return msg.RETVAL;
+}
+
+/*****************************************************************************
+ *                                brk
+ *****************************************************************************/
+/**
+ * Set the end of the heap. Memory up to it can be used, the pages are
+ * mapped when first touched.
+ *
+ * @param addr  The new end, above the program image.
+ *
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int brk(void * addr)
+{
+	return send_brk((u32)addr);
+}
+
+/*****************************************************************************
+ *                                sbrk
+ *****************************************************************************/
+/**
+ * Grow (or shrink) the heap.
+ *
+ * @param incr  Nr. of bytes to add, may be negative.
+ *
+ * @return The old end of the heap, i.e. the new memory. (void*)-1 if error.
+ *****************************************************************************/
+PUBLIC void * sbrk(int incr)
+{
+	if (!cur_brk && send_brk(0) != 0)
+		return (void*)-1;
+
+	u32 old = cur_brk;
+	if (incr && send_brk(old + incr) != 0)
+		return (void*)-1;
+
+	return (void*)old;
+}
@@ -55,12 +55,19 @@ PUBLIC int execl(const char *path, const char *arg, ...)
 }
 
 /*****************************************************************************
- *                                execv
+ *                                build_arg_stack
  *****************************************************************************/
-PUBLIC int execv(const char *path, char * argv[])
+/**
+ * Lay out argv the way _start wants it, MM moves it to the new stack.
+ * 
+ * @param argv       The args, terminated by a null ptr.
+ * @param arg_stack  Buffer of PROC_ORIGIN_STACK bytes.
+ * 
+ * @return  Bytes used in arg_stack.
+ *****************************************************************************/
+PRIVATE int build_arg_stack(char * argv[], char * arg_stack)
 {
 	char **p = argv;
-	char arg_stack[PROC_ORIGIN_STACK];
 	int stack_len = 0;
 
 	while(*p++) {
@@ -82,12 +89,22 @@ PUBLIC int execv(const char *path, char * argv[])
 		stack_len++;
 	}
 
+	return stack_len;
+}
+
+/*****************************************************************************
+ *                                execv
+ *****************************************************************************/
+PUBLIC int execv(const char *path, char * argv[])
+{
+	char arg_stack[PROC_ORIGIN_STACK];
+
 	MESSAGE msg;
 	msg.type	= EXEC;
 	msg.PATHNAME	= (void*)path;
 	msg.NAME_LEN	= strlen(path);
 	msg.BUF		= (void*)arg_stack;
-	msg.BUF_LEN	= stack_len;
+	msg.BUF_LEN	= build_arg_stack(argv, arg_stack);
 
 	send_recv(BOTH, TASK_MM, &msg);
 	assert(msg.type == SYSCALL_RET);
@@ -95,3 +112,33 @@ PUBLIC int execv(const char *path, char * argv[])
 	return msg.RETVAL;
 }
 
+/*****************************************************************************
+ *                                spawn
+ *****************************************************************************/
+/**
+ * Run a program in a new child proc, like fork() followed by execv() in
+ * the child, but without copying the caller. The child inherits the
+ * caller's open files.
+ * 
+ * @param path  The full path of the file to be executed.
+ * @param argv  The args, terminated by a null ptr.
+ * 
+ * @return  PID of the child if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int spawn(const char *path, char * argv[])
+{
+	char arg_stack[PROC_ORIGIN_STACK];
+
+	MESSAGE msg;
+	msg.type	= SPAWN;
+	msg.PATHNAME	= (void*)path;
+	msg.NAME_LEN	= strlen(path);
+	msg.BUF		= (void*)arg_stack;
+	msg.BUF_LEN	= build_arg_stack(argv, arg_stack);
+
+	send_recv(BOTH, TASK_MM, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL == 0 ? msg.PID : -1;
+}
+
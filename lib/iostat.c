@@ -0,0 +1,46 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   iostat.c
+ * @brief  iostat()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                iostat
+ *****************************************************************************/
+/**
+ * Get the I/O statistics of a block device.
+ * 
+ * @param dev  Device nr, e.g. MAKE_DEV(DEV_HD, MINOR_hd1a). Every minor of
+ *             a drive shares the drive's counters.
+ * @param buf  Where to put them.
+ * 
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int iostat(int dev, struct io_stat * buf)
+{
+	MESSAGE msg;
+
+	msg.type	= IOSTAT;
+
+	msg.DEVICE	= dev;
+	msg.BUF		= (void*)buf;
+
+	prefault(buf, sizeof(struct io_stat));
+	send_recv(BOTH, TASK_FS, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
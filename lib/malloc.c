@@ -0,0 +1,210 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   malloc.c
+ * @brief  malloc(), free(), calloc(), realloc()
+ *
+ * Small blocks come in size classes of 16 to 2048 bytes, each class with
+ * a free list of its own: allocating or freeing one is a list push or pop,
+ * no syscall. An empty list is refilled with a whole page from sbrk(),
+ * cut into blocks of the class. Bigger blocks are whole pages, kept on a
+ * first-fit list when freed; the one at the end of the heap is given back
+ * to MM.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+#define	NR_CLASSES	8	/* 16, 32, ... 2048 bytes */
+#define	MIN_BLOCK_SHIFT	4
+#define	LARGE		NR_CLASSES
+
+/* in front of every block */
+struct header {
+	int	size;	/* of the block, header included */
+	int	cls;	/* size class, LARGE if none */
+};
+
+/* free blocks are linked through their first bytes after the header */
+#define	NEXT(h)		(*(struct header **)((h) + 1))
+
+PRIVATE struct header *	free_list[NR_CLASSES];
+PRIVATE struct header *	large_list;
+
+/* the smallest class holding `total' bytes, LARGE if too big for any */
+PRIVATE int size_class(int total)
+{
+	int c;
+	for (c = 0; c < NR_CLASSES; c++)
+		if (total <= (1 << (MIN_BLOCK_SHIFT + c)))
+			return c;
+	return LARGE;
+}
+
+/* cut a new page into blocks of class c, 0 if the heap cannot grow */
+PRIVATE int refill(int c)
+{
+	int bsize = 1 << (MIN_BLOCK_SHIFT + c);
+	u8 * p = sbrk(PAGE_SIZE);
+	u8 * q;
+
+	if (p == (u8*)-1)
+		return 0;
+
+	for (q = p; q + bsize <= p + PAGE_SIZE; q += bsize) {
+		struct header * h = (struct header*)q;
+		h->size = bsize;
+		h->cls  = c;
+		NEXT(h) = free_list[c];
+		free_list[c] = h;
+	}
+	return 1;
+}
+
+/* whole pages for a big block, from the free ones if one fits */
+PRIVATE struct header * alloc_large(int total)
+{
+	struct header ** pp;
+	struct header * h;
+
+	total = (total + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+
+	for (pp = &large_list; *pp; pp = &NEXT(*pp))
+		if ((*pp)->size >= total) {
+			h = *pp;
+			*pp = NEXT(h);
+			return h;
+		}
+
+	h = sbrk(total);
+	if (h == (struct header*)-1)
+		return 0;
+	h->size = total;
+	h->cls  = LARGE;
+	return h;
+}
+
+/*****************************************************************************
+ *                                malloc
+ *****************************************************************************/
+/**
+ * Allocate memory from the heap.
+ *
+ * @param size  Nr. of bytes.
+ *
+ * @return The memory, 8-byte aligned. 0 if out of memory.
+ *****************************************************************************/
+PUBLIC void * malloc(int size)
+{
+	struct header * h;
+
+	/* the header and the page rounding of alloc_large() must fit an int */
+	if (size <= 0 ||
+	    size > 0x7FFFFFFF - (int)sizeof(struct header) - PAGE_SIZE)
+		return 0;
+
+	int total = size + sizeof(struct header);
+	int c = size_class(total);
+
+	if (c == LARGE)
+		h = alloc_large(total);
+	else if (free_list[c] || refill(c)) {
+		h = free_list[c];
+		free_list[c] = NEXT(h);
+	}
+	else
+		h = 0;
+
+	return h ? h + 1 : 0;
+}
+
+/*****************************************************************************
+ *                                free
+ *****************************************************************************/
+/**
+ * Give back memory got from malloc(), calloc() or realloc().
+ *
+ * @param ptr  The memory, may be 0.
+ *****************************************************************************/
+PUBLIC void free(void * ptr)
+{
+	if (!ptr)
+		return;
+
+	struct header * h = (struct header*)ptr - 1;
+
+	if (h->cls != LARGE) {
+		assert(h->cls >= 0 && h->cls < NR_CLASSES);
+		NEXT(h) = free_list[h->cls];
+		free_list[h->cls] = h;
+	}
+	else if ((u8*)h + h->size == sbrk(0)) {
+		sbrk(-h->size);
+	}
+	else {
+		NEXT(h) = large_list;
+		large_list = h;
+	}
+}
+
+/*****************************************************************************
+ *                                calloc
+ *****************************************************************************/
+/**
+ * Allocate zeroed memory for an array.
+ *
+ * @param nmemb  Nr. of elements.
+ * @param size   Size of an element.
+ *
+ * @return The memory, 0 if out of memory.
+ *****************************************************************************/
+PUBLIC void * calloc(int nmemb, int size)
+{
+	if (nmemb <= 0 || size <= 0 || nmemb > 0x7FFFFFFF / size)
+		return 0;
+
+	void * p = malloc(nmemb * size);
+	if (p)
+		memset(p, 0, nmemb * size);
+	return p;
+}
+
+/*****************************************************************************
+ *                                realloc
+ *****************************************************************************/
+/**
+ * Resize memory got from malloc(). The contents are kept up to the
+ * smaller of the two sizes.
+ *
+ * @param ptr   The memory, 0 to just allocate.
+ * @param size  New nr. of bytes.
+ *
+ * @return The memory, maybe moved. 0 if out of memory, `ptr' is left
+ *         alone then.
+ *****************************************************************************/
+PUBLIC void * realloc(void * ptr, int size)
+{
+	if (!ptr)
+		return malloc(size);
+
+	struct header * h = (struct header*)ptr - 1;
+	int room = h->size - sizeof(struct header);
+	if (size <= room)
+		return ptr;
+
+	void * p = malloc(size);
+	if (p) {
+		memcpy(p, ptr, room);
+		free(ptr);
+	}
+	return p;
+}
@@ -61,6 +61,27 @@ PUBLIC int send_recv(int function, int src_dest, MESSAGE* msg)
 	return ret;
 }
 
+/*****************************************************************************
+ *                                prefault
+ *****************************************************************************/
+/**
+ * <Ring 1~3> Touch every page of a buffer before handing it to a task.
+ *
+ * A page of the program file is read in only when the proc itself faults
+ * on it, a task copying to or from the buffer could not wait for that.
+ *
+ * @param buf  The buffer.
+ * @param len  Its size in bytes.
+ *****************************************************************************/
+PUBLIC void prefault(const void * buf, int len)
+{
+	const volatile char * p = buf;
+	const volatile char * end = p + len;
+
+	for (; p < end; p = (char*)(((u32)p + PAGE_SIZE) & ~(PAGE_SIZE - 1)))
+		(void)*p;
+}
+
 /*****************************************************************************
  *                                memcmp
  *****************************************************************************/
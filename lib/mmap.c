@@ -0,0 +1,95 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   mmap.c
+ * @brief  mmap(), munmap(), msync()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                mmap
+ *****************************************************************************/
+/**
+ * Map a range of an open regular file into the caller. Pages are read
+ * when first touched.
+ *
+ * @param addr    Where to put it: page aligned, from 12 MB on. 0 lets MM
+ *                choose.
+ * @param len     Nr. of bytes.
+ * @param flags   MAP_SHARED: writes go to the file (see msync()).
+ *                MAP_PRIVATE: writes stay in the caller.
+ * @param fd      The file.
+ * @param offset  Where the range starts in the file, page aligned.
+ *
+ * @return Address of the mapping, (void*)-1 if error.
+ *****************************************************************************/
+PUBLIC void * mmap(void * addr, int len, int flags, int fd, int offset)
+{
+	MESSAGE msg;
+	msg.type	= MMAP;
+	msg.BUF		= addr;
+	msg.CNT		= len;
+	msg.MAP_FLAGS	= flags;
+	msg.FD		= fd;
+	msg.POSITION	= offset;
+
+	send_recv(BOTH, TASK_MM, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL == 0 ? msg.BUF : (void*)-1;
+}
+
+/*****************************************************************************
+ *                                munmap
+ *****************************************************************************/
+/**
+ * Unmap a mapping made by mmap(), writing it back if it is shared.
+ *
+ * @param addr  Address of the mapping, as returned by mmap().
+ *
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int munmap(void * addr)
+{
+	MESSAGE msg;
+	msg.type	= MUNMAP;
+	msg.BUF		= addr;
+
+	send_recv(BOTH, TASK_MM, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
+
+/*****************************************************************************
+ *                                msync
+ *****************************************************************************/
+/**
+ * Write the pages of a shared mapping the caller changed back to the file.
+ *
+ * @param addr  Address of the mapping, as returned by mmap().
+ *
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int msync(void * addr)
+{
+	MESSAGE msg;
+	msg.type	= MSYNC;
+	msg.BUF		= addr;
+
+	send_recv(BOTH, TASK_MM, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
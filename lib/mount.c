@@ -0,0 +1,44 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   mount.c
+ * @brief  mount()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                mount
+ *****************************************************************************/
+/**
+ * Mount the file system on a block device. Its files are then reached
+ * as "/dir/filename". A device without a file system gets a fresh one.
+ * 
+ * @param dev  Device nr, e.g. MAKE_DEV(DEV_HD2, MINOR_hd1a).
+ * @param dir  Name of the mount point, without any '/'.
+ * 
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int mount(int dev, const char * dir)
+{
+	MESSAGE msg;
+	msg.type   = MOUNT;
+
+	msg.DEVICE	= dev;
+	msg.PATHNAME	= (void*)dir;
+	msg.NAME_LEN	= strlen(dir);
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.RETVAL;
+}
@@ -40,6 +40,7 @@ PUBLIC int read(int fd, void *buf, int count)
 	msg.BUF  = buf;
 	msg.CNT  = count;
 
+	prefault(buf, count);
 	send_recv(BOTH, TASK_FS, &msg);
 
 	return msg.CNT;
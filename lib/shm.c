@@ -0,0 +1,113 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   shm.c
+ * @brief  shmget(), shmat(), shmdt(), shmrm()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                shmget
+ *****************************************************************************/
+/**
+ * Get a shared memory segment.
+ *
+ * @param key   Procs using the same key get the same segment. 0 for a new
+ *              one nobody else can find (children inherit it though).
+ * @param size  Nr. of bytes, up to 4 MB.
+ *
+ * @return Id of the segment, -1 if error.
+ *****************************************************************************/
+PUBLIC int shmget(int key, int size)
+{
+	MESSAGE msg;
+	msg.type	= SHMGET;
+	msg.SHM_KEY	= key;
+	msg.CNT		= size;
+
+	send_recv(BOTH, TASK_MM, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
+
+/*****************************************************************************
+ *                                shmat
+ *****************************************************************************/
+/**
+ * Map a shared memory segment into the caller.
+ *
+ * @param id    Id of the segment, see shmget().
+ * @param addr  Where to put it: page aligned, between 8 MB and 12 MB. 0
+ *              lets MM choose.
+ *
+ * @return Address of the segment, (void*)-1 if error.
+ *****************************************************************************/
+PUBLIC void * shmat(int id, void * addr)
+{
+	MESSAGE msg;
+	msg.type	= SHMAT;
+	msg.SHM_ID	= id;
+	msg.BUF		= addr;
+
+	send_recv(BOTH, TASK_MM, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL == 0 ? msg.BUF : (void*)-1;
+}
+
+/*****************************************************************************
+ *                                shmdt
+ *****************************************************************************/
+/**
+ * Unmap a shared memory segment from the caller.
+ *
+ * @param addr  Address of the segment, as returned by shmat().
+ *
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int shmdt(void * addr)
+{
+	MESSAGE msg;
+	msg.type	= SHMDT;
+	msg.BUF		= addr;
+
+	send_recv(BOTH, TASK_MM, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
+
+/*****************************************************************************
+ *                                shmrm
+ *****************************************************************************/
+/**
+ * Remove a shared memory segment. shmget() does not find it any more, and
+ * its memory is freed once no proc has it attached.
+ *
+ * @param id  Id of the segment, see shmget().
+ *
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int shmrm(int id)
+{
+	MESSAGE msg;
+	msg.type	= SHMRM;
+	msg.SHM_ID	= id;
+
+	send_recv(BOTH, TASK_MM, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
@@ -40,6 +40,7 @@ PUBLIC int stat(const char *path, struct stat *buf)
 	msg.BUF		= (void*)buf;
 	msg.NAME_LEN	= strlen(path);
 
+	prefault(buf, sizeof(struct stat));
 	send_recv(BOTH, TASK_FS, &msg);
 	assert(msg.type == SYSCALL_RET);
 
@@ -10,12 +10,19 @@
 INT_VECTOR_SYS_CALL equ 0x90
 _NR_printx	    equ 0
 _NR_sendrec	    equ 1
+_NR_flush_tlb	    equ 2
+_NR_save_fpu	    equ 3
 
 ; 导出符号
 global	printx
 global	sendrec
+global	flush_tlb
+global	save_fpu
 
 bits 32
+[section .data]
+sysenter_ok	dd	0	; 1 if the CPU has SYSENTER, -1 if not, 0: unknown
+
 [section .text]
 
 ; ====================================================================================
@@ -31,7 +38,7 @@ sendrec:
 	mov	ebx, [esp + 12 +  4]	; function
 	mov	ecx, [esp + 12 +  8]	; src_dest
 	mov	edx, [esp + 12 + 12]	; msg
-	int	INT_VECTOR_SYS_CALL
+	call	syscall
 
 	pop	edx
 	pop	ecx
@@ -47,9 +54,93 @@ printx:
 
 	mov	eax, _NR_printx
 	mov	edx, [esp + 4 + 4]	; s
-	int	INT_VECTOR_SYS_CALL
+	call	syscall
 
 	pop	edx
 
 	ret
 
+; ====================================================================================
+;                          void flush_tlb();
+; ====================================================================================
+flush_tlb:
+	mov	eax, _NR_flush_tlb
+	int	INT_VECTOR_SYS_CALL
+	ret
+
+; ====================================================================================
+;                          void save_fpu();
+; ====================================================================================
+save_fpu:
+	mov	eax, _NR_save_fpu
+	int	INT_VECTOR_SYS_CALL
+	ret
+
+; ====================================================================================
+;                                    syscall
+; ====================================================================================
+; eax: syscall nr, ebx, ecx, edx: its args. Returns what it returns in eax.
+; Procs in ring 3 use SYSENTER if the CPU has it (SYSEXIT only goes back to
+; ring 3), the tasks always int.
+syscall:
+	push	esi
+	push	edi
+
+	mov	esi, cs
+	and	esi, 3
+	cmp	esi, 3
+	jne	.int
+	cmp	dword [sysenter_ok], 0
+	jne	.known
+	call	check_sysenter
+.known:
+	cmp	dword [sysenter_ok], 1
+	jne	.int
+
+	mov	esi, esp
+	mov	edi, .back
+	sysenter
+.back:	; right after sysenter: a restarted call backs up 2 bytes, see sys_enter
+	; cs and ss are flat and esp linear if we came back by SYSEXIT
+	mov	di, ds
+	mov	ss, di
+	mov	esp, esi
+	jmp	SELECTOR_LDT_C3:.done
+.int:
+	int	INT_VECTOR_SYS_CALL
+.done:
+	pop	edi
+	pop	esi
+	ret
+
+; set sysenter_ok, as init_sysenter() in kernel/protect.c decides
+check_sysenter:
+	push	eax
+	push	ebx
+	push	ecx
+	push	edx
+
+	mov	dword [sysenter_ok], -1
+	mov	eax, 1
+	cpuid
+	test	edx, 1 << 11		; SEP
+	jz	.no
+	mov	ebx, eax
+	and	ebx, 0F00h		; family
+	cmp	ebx, 600h
+	jne	.yes
+	mov	ebx, eax
+	and	ebx, 0F0h		; model
+	cmp	ebx, 30h
+	jae	.yes
+	and	eax, 0Fh		; stepping
+	cmp	eax, 3
+	jb	.no			; an early Pentium Pro
+.yes:
+	mov	dword [sysenter_ok], 1
+.no:
+	pop	edx
+	pop	ecx
+	pop	ebx
+	pop	eax
+	ret
@@ -0,0 +1,159 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   time.c
+ * @brief  clock_gettime(), gettimeofday(), get_time(), irqoff_time()
+ *
+ * No syscall: the time is the TSC cycles since boot, scaled by the rate
+ * the kernel measured, plus the wall clock it read from the RTC at boot.
+ * Both are in the kernel data page, see struct kdata.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/* n /= d, returns n % d; there is no libgcc for a 64-bit division */
+PRIVATE u32 div64(u64 * n, u32 d)
+{
+	u32 hi = (u32)(*n >> 32);
+	u32 lo = (u32)*n;
+	u32 rem;
+
+	u32 q_hi = hi / d;
+	hi %= d;
+	__asm__("divl %4" : "=a"(lo), "=d"(rem) : "a"(lo), "d"(hi), "rm"(d));
+
+	*n = ((u64)q_hi << 32) | lo;
+	return rem;
+}
+
+/* time since boot */
+PRIVATE void since_boot(u32 * sec, u32 * nsec)
+{
+	u32 khz = KDATA->tsc_khz;
+	u64 c;
+
+	if (!khz) {	/* not calibrated, the clock ticks will do */
+		int t = KDATA->ticks;
+		*sec  = t / HZ;
+		*nsec = (t % HZ) * (1000000000 / HZ);
+		return;
+	}
+
+	__asm__ __volatile__("rdtsc" : "=A"(c));
+	c -= KDATA->boot_tsc;
+
+	u64 ns = (u64)div64(&c, khz) * 1000000;	/* c: ms */
+	div64(&ns, khz);
+	u32 ms = div64(&c, 1000);		/* c: s */
+
+	*sec  = (u32)c;
+	*nsec = ms * 1000000 + (u32)ns;
+}
+
+/*****************************************************************************
+ *                                clock_gettime
+ *****************************************************************************/
+/**
+ * Get the time of a clock, to the nanosecond.
+ *
+ * @param clock  CLOCK_REALTIME or CLOCK_MONOTONIC.
+ * @param ts     Where to put it.
+ *
+ * @return Zero if successful, -1 if there is no such clock.
+ *****************************************************************************/
+PUBLIC int clock_gettime(int clock, struct timespec * ts)
+{
+	if (clock != CLOCK_REALTIME && clock != CLOCK_MONOTONIC)
+		return -1;
+
+	since_boot(&ts->tv_sec, &ts->tv_nsec);
+	if (clock == CLOCK_REALTIME)
+		ts->tv_sec += KDATA->boot_time;
+	return 0;
+}
+
+/*****************************************************************************
+ *                                gettimeofday
+ *****************************************************************************/
+/**
+ * Get the wall clock time, to the microsecond.
+ *
+ * @param tv  Where to put it.
+ *
+ * @return Zero.
+ *****************************************************************************/
+PUBLIC int gettimeofday(struct timeval * tv)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	tv->tv_sec  = ts.tv_sec;
+	tv->tv_usec = ts.tv_nsec / 1000;
+	return 0;
+}
+
+/*****************************************************************************
+ *                                get_time
+ *****************************************************************************/
+/**
+ * Get the wall clock time as a date.
+ *
+ * @param t  Where to put it.
+ *****************************************************************************/
+PUBLIC void get_time(struct time * t)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	int s = ts.tv_sec % 86400;
+	t->hour   = s / 3600;
+	t->minute = s / 60 % 60;
+	t->second = s % 60;
+
+	/* the inverse of days_since_epoch() in kernel/clock.c */
+	int z   = ts.tv_sec / 86400 + 719468;
+	int era = z / 146097;
+	int doe = z - era * 146097;
+	int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	int mp  = (5 * doy + 2) / 153;
+
+	t->day   = doy - (153 * mp + 2) / 5 + 1;
+	t->month = mp < 10 ? mp + 3 : mp - 9;
+	t->year  = yoe + era * 400 + (t->month <= 2);
+}
+
+/*****************************************************************************
+ *                                irqoff_time
+ *****************************************************************************/
+/**
+ * Get the longest time the kernel or a task kept interrupts off, since
+ * boot. See kernel/work.c.
+ *
+ * @param eip  Where to put the address they went back on at.
+ *
+ * @return The time in microseconds, -1 if the TSC rate is not known.
+ *****************************************************************************/
+PUBLIC int irqoff_time(u32 * eip)
+{
+	u32 khz = KDATA->tsc_khz;
+	u64 us = (u64)KDATA->irqoff_max * 1000;
+
+	*eip = KDATA->irqoff_eip;
+	if (!khz)
+		return -1;
+
+	div64(&us, khz);
+	return (int)us;
+}
@@ -40,6 +40,7 @@ PUBLIC int write(int fd, const void *buf, int count)
 	msg.BUF  = (void*)buf;
 	msg.CNT  = count;
 
+	prefault(buf, count);
 	send_recv(BOTH, TASK_FS, &msg);
 
 	return msg.CNT;
@@ -31,57 +31,56 @@
  * @return  Zero if successful, otherwise -1.
  *****************************************************************************/
 PUBLIC int do_exec()
+{
+	return exec_proc(mm_msg.source, mm_msg.source);
+}
+
+/*****************************************************************************
+ *                                exec_proc
+ *****************************************************************************/
+/**
+ * Replace the image of a proc with the program named in mm_msg.
+ * 
+ * @param caller  Whose memory holds the path and the arg stack.
+ * @param src     The proc to run the program: the caller for exec(), a
+ *                new child for spawn().
+ * 
+ * @return  Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int exec_proc(int caller, int src)
 {
 	/* get parameters from the message */
 	int name_len = mm_msg.NAME_LEN;	/* length of filename */
-	int src = mm_msg.source;	/* caller proc nr. */
 	assert(name_len < MAX_PATH);
 
 	char pathname[MAX_PATH];
 	phys_copy((void*)va2la(TASK_MM, pathname),
-		  (void*)va2la(src, mm_msg.PATHNAME),
+		  (void*)va2la(caller, mm_msg.PATHNAME),
 		  name_len);
 	pathname[name_len] = 0;	/* terminate the string */
 
-	/* get the file size */
-	struct stat s;
-	int ret = stat(pathname, &s);
-	if (ret != 0) {
-		printl("{MM} MM::do_exec()::stat() returns error. %s", pathname);
-		return -1;
-	}
-
-	/* read the file */
-	int fd = open(pathname, O_RDWR);
-	if (fd == -1)
-		return -1;
-	assert(s.st_size < MMBUF_SIZE);
-	read(fd, mmbuf, s.st_size);
-	close(fd);
-
-	/* overwrite the current proc image with the new one */
-	Elf32_Ehdr* elf_hdr = (Elf32_Ehdr*)(mmbuf);
-	int i;
-	for (i = 0; i < elf_hdr->e_phnum; i++) {
-		Elf32_Phdr* prog_hdr = (Elf32_Phdr*)(mmbuf + elf_hdr->e_phoff +
-			 			(i * elf_hdr->e_phentsize));
-		if (prog_hdr->p_type == PT_LOAD) {
-			assert(prog_hdr->p_vaddr + prog_hdr->p_memsz <
-				PROC_IMAGE_SIZE_DEFAULT);
-			phys_copy((void*)va2la(src, (void*)prog_hdr->p_vaddr),
-				  (void*)va2la(TASK_MM,
-						 mmbuf + prog_hdr->p_offset),
-				  prog_hdr->p_filesz);
-		}
-	}
+	/* the program, cached if it was run before */
+	int img = get_image(pathname);
+	if (img == -1)
+		return -1;	/* quietly: the shell tries every line */
 
-	/* setup the arg stack */
+	/* save the arg stack before the old image goes away */
 	int orig_stack_len = mm_msg.BUF_LEN;
 	char stackcopy[PROC_ORIGIN_STACK];
 	phys_copy((void*)va2la(TASK_MM, stackcopy),
-		  (void*)va2la(src, mm_msg.BUF),
+		  (void*)va2la(caller, mm_msg.BUF),
 		  orig_stack_len);
 
+	/**
+	 * Drop the old image and map the new one: nothing is read here,
+	 * pages come in when touched (bss, past p_filesz, comes up zeroed).
+	 */
+	assert(proc_table[src].p_cr3 != PAGE_DIR_BASE);
+	clear_vm(src);
+	fpu_free(src);		/* the new program starts with a clean FPU */
+	u32 entry = map_image(img, src);
+
+	/* setup the arg stack */
 	u8 * orig_stack = (u8*)(PROC_IMAGE_SIZE_DEFAULT - PROC_ORIGIN_STACK);
 
 	int delta = (int)orig_stack - (int)mm_msg.BUF;
@@ -101,7 +100,7 @@ PUBLIC int do_exec()
 	proc_table[src].regs.eax = (u32)orig_stack; /* argv */
 
 	/* setup eip & esp */
-	proc_table[src].regs.eip = elf_hdr->e_entry; /* @see _start.asm */
+	proc_table[src].regs.eip = entry; /* @see _start.asm */
 	proc_table[src].regs.esp = PROC_IMAGE_SIZE_DEFAULT - PROC_ORIGIN_STACK;
 
 	strcpy(proc_table[src].name, pathname);
@@ -24,14 +24,15 @@
 PRIVATE void cleanup(struct proc * proc);
 
 /*****************************************************************************
- *                                do_fork
+ *                                new_proc
  *****************************************************************************/
 /**
- * Perform the fork() syscall.
+ * Make a child of the caller: a copy of its proc_table[] entry with an
+ * empty address space.
  * 
- * @return  Zero if success, otherwise -1.
+ * @return  PID of the child, -1 if no slot or memory is free.
  *****************************************************************************/
-PUBLIC int do_fork()
+PRIVATE int new_proc()
 {
 	/* find a free slot in proc_table */
 	struct proc* p = proc_table;
@@ -55,68 +56,62 @@ PUBLIC int do_fork()
 	p->p_parent = pid;
 	sprintf(p->name, "%s_%d", proc_table[pid].name, child_pid);
 
-	/* duplicate the process: T, D & S */
-	struct descriptor * ppd;
-
-	/* Text segment */
-	ppd = &proc_table[pid].ldts[INDEX_LDT_C];
-	/* base of T-seg, in bytes */
-	int caller_T_base  = reassembly(ppd->base_high, 24,
-					ppd->base_mid,  16,
-					ppd->base_low);
-	/* limit of T-seg, in 1 or 4096 bytes,
-	   depending on the G bit of descriptor */
-	int caller_T_limit = reassembly(0, 0,
-					(ppd->limit_high_attr2 & 0xF), 16,
-					ppd->limit_low);
-	/* size of T-seg, in bytes */
-	int caller_T_size  = ((caller_T_limit + 1) *
-			      ((ppd->limit_high_attr2 & (DA_LIMIT_4K >> 8)) ?
-			       4096 : 1));
-
-	/* Data & Stack segments */
-	ppd = &proc_table[pid].ldts[INDEX_LDT_RW];
-	/* base of D&S-seg, in bytes */
-	int caller_D_S_base  = reassembly(ppd->base_high, 24,
-					  ppd->base_mid,  16,
-					  ppd->base_low);
-	/* limit of D&S-seg, in 1 or 4096 bytes,
-	   depending on the G bit of descriptor */
-	int caller_D_S_limit = reassembly((ppd->limit_high_attr2 & 0xF), 16,
-					  0, 0,
-					  ppd->limit_low);
-	/* size of D&S-seg, in bytes */
-	int caller_D_S_size  = ((caller_T_limit + 1) *
-				((ppd->limit_high_attr2 & (DA_LIMIT_4K >> 8)) ?
-				 4096 : 1));
-
-	/* we don't separate T, D & S segments, so we have: */
-	assert((caller_T_base  == caller_D_S_base ) &&
-	       (caller_T_limit == caller_D_S_limit) &&
-	       (caller_T_size  == caller_D_S_size ));
-
-	/* base of child proc, T, D & S segments share the same space,
-	   so we allocate memory just once */
-	int child_base = alloc_mem(child_pid, caller_T_size);
-
-	/* child is a copy of the parent */
-	phys_copy((void*)child_base, (void*)caller_T_base, caller_T_size);
-
-	/* child's LDT */
-	init_desc(&p->ldts[INDEX_LDT_C],
-		  child_base,
-		  (PROC_IMAGE_SIZE_DEFAULT - 1) >> LIMIT_4K_SHIFT,
-		  DA_LIMIT_4K | DA_32 | DA_C | PRIVILEGE_USER << 5);
-	init_desc(&p->ldts[INDEX_LDT_RW],
-		  child_base,
-		  (PROC_IMAGE_SIZE_DEFAULT - 1) >> LIMIT_4K_SHIFT,
-		  DA_LIMIT_4K | DA_32 | DA_DRW | PRIVILEGE_USER << 5);
-
-	/* tell FS, see fs_fork() */
+	/* the child gets an address space of its own */
+	p->p_cr3 = PAGE_DIR_BASE;
+	p->p_image = -1;
+	memset(p->p_shm, 0, sizeof(p->p_shm));	/* see dup_shm() */
+	memset(p->p_mmap, 0, sizeof(p->p_mmap));
+	p->p_fpu = 0;				/* see fpu_fork() */
+	if (new_vm(child_pid) != 0) {
+		p->p_flags = FREE_SLOT;
+		return -1;
+	}
+
+	return child_pid;
+}
+
+/* the child goes away before it ever ran */
+PRIVATE void del_proc(int child_pid)
+{
+	free_vm(child_pid);
+	fpu_free(child_pid);
+	proc_table[child_pid].p_flags = FREE_SLOT;
+}
+
+/* tell FS, see fs_fork(). Zero if successful. */
+PRIVATE int fs_fork_child(int child_pid)
+{
 	MESSAGE msg2fs;
 	msg2fs.type = FORK;
 	msg2fs.PID = child_pid;
 	send_recv(BOTH, TASK_FS, &msg2fs);
+	return msg2fs.RETVAL;
+}
+
+/*****************************************************************************
+ *                                do_fork
+ *****************************************************************************/
+/**
+ * Perform the fork() syscall.
+ * 
+ * @return  Zero if success, otherwise -1.
+ *****************************************************************************/
+PUBLIC int do_fork()
+{
+	int pid = mm_msg.source;
+	int child_pid = new_proc();
+	if (child_pid == -1)
+		return -1;
+
+	if (dup_vm(pid, child_pid) != 0 || fpu_fork(pid, child_pid) != 0) {
+		del_proc(child_pid);
+		return -1;
+	}
+
+	if (fs_fork_child(child_pid) != 0) {
+		del_proc(child_pid);
+		return -1;
+	}
 
 	/* child PID will be returned to the parent proc */
 	mm_msg.PID = child_pid;
@@ -131,6 +126,51 @@ PUBLIC int do_fork()
 	return 0;
 }
 
+/*****************************************************************************
+ *                                do_spawn
+ *****************************************************************************/
+/**
+ * Perform the spawn() syscall: a new child runs the program, the caller
+ * is neither copied nor stopped for long.
+ * 
+ * @return  Zero if success, otherwise -1.
+ *****************************************************************************/
+PUBLIC int do_spawn()
+{
+	int pid = mm_msg.source;
+	int child_pid = new_proc();
+	if (child_pid == -1)
+		return -1;
+
+	if (exec_proc(pid, child_pid) != 0) {
+		del_proc(child_pid);
+		return -1;
+	}
+
+	if (fs_fork_child(child_pid) != 0) {
+		del_proc(child_pid);
+		return -1;
+	}
+
+	mm_msg.PID = child_pid;
+
+	/**
+	 * Birth of the child. It is still waiting for the reply of the
+	 * parent's syscall, and that message has no place in the new image:
+	 * start it at the entry point instead of sending it one.
+	 */
+	struct proc * p = &proc_table[child_pid];
+	p->p_msg = 0;
+	p->p_recvfrom = NO_TASK;
+	p->p_sendto = NO_TASK;
+	p->has_int_msg = 0;
+	p->q_sending = 0;
+	p->next_sending = 0;
+	p->p_flags = 0;
+
+	return 0;
+}
+
 /*****************************************************************************
  *                                do_exit
  *****************************************************************************/
@@ -185,7 +225,8 @@ PUBLIC void do_exit(int status)
 	msg2fs.PID = pid;
 	send_recv(BOTH, TASK_FS, &msg2fs);
 
-	free_mem(pid);
+	free_vm(pid);
+	fpu_free(pid);
 
 	p->exit_status = status;
 
@@ -0,0 +1,375 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   mm/image.c
+ * @brief  Program images: the files procs are paged in from.
+ *
+ * An image is a program file as exec() found it: its segments, its entry
+ * point and the pages read from it so far. Images outlive the procs
+ * running them, so running the same command again costs a stat() of the
+ * file but no read of it: its pages are mapped copy-on-write from the
+ * cache, found by device and inode nr. FS calls inval_image() when a file
+ * is written or removed.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "keyboard.h"
+#include "proto.h"
+#include "elf.h"
+
+#define	NR_IMAGES	NR_VM_SLOTS	/* enough for every proc to differ */
+#define	NR_IMAGE_PAGES	(PROC_IMAGE_SIZE_DEFAULT / PAGE_SIZE)
+
+PRIVATE struct image {
+	char	path[MAX_PATH];	/* "" if the slot is unused */
+	int	dev;
+	int	ino;
+	int	fd;		/* MM's fd of the file, -1 if closed */
+	int	refs;		/* nr of procs running it */
+	int	stale;		/* the file has changed, don't reuse */
+	u32	last_use;
+	u32	entry;
+	struct vm_area vm[NR_VM_AREAS];
+	u32 *	pages;		/* frames read so far, by page; in a frame */
+} images[NR_IMAGES];
+
+PRIVATE u32 image_clock;
+
+/**
+ * Files written or removed, posted by FS and applied by MM. FS writes
+ * only these and MM only reads them, all else here belongs to MM. Both
+ * run on CPU 0, so volatile is ordering enough.
+ */
+#define	NR_INVALS	16
+PRIVATE volatile struct {
+	int	dev;
+	int	ino;
+} invals[NR_INVALS];
+PRIVATE volatile u32	inval_head;	/* nr posted, by FS */
+PRIVATE u32		inval_tail;	/* nr applied, by MM */
+
+/* forget an unused image and give its pages back */
+PRIVATE void drop_image(struct image * im)
+{
+	int i;
+
+	assert(im->refs == 0 && im->fd == -1);
+	for (i = 0; im->pages && i < NR_IMAGE_PAGES; i++)
+		if (im->pages[i])
+			free_frame(im->pages[i]);
+	if (im->pages)
+		free_frame((u32)im->pages);
+	memset(im, 0, sizeof(struct image));
+}
+
+/* drop every unused image, to get memory back */
+PRIVATE int shrink_images()
+{
+	int i, n = 0;
+
+	for (i = 0; i < NR_IMAGES; i++)
+		if (images[i].path[0] && images[i].refs == 0) {
+			drop_image(&images[i]);
+			n++;
+		}
+	return n;
+}
+
+/* a free slot, the least recently used image is dropped if needed */
+PRIVATE struct image * alloc_image()
+{
+	struct image * im;
+	struct image * lru = 0;
+
+	for (im = images; im < images + NR_IMAGES; im++) {
+		if (!im->path[0])
+			return im;
+		if (im->refs == 0 && (!lru || im->last_use < lru->last_use))
+			lru = im;
+	}
+	if (lru)
+		drop_image(lru);
+	return lru;
+}
+
+/* read the ELF headers, 0 if the file is no program we can run */
+PRIVATE int load_headers(struct image * im)
+{
+	int n = read(im->fd, mmbuf, PAGE_SIZE);
+	Elf32_Ehdr* elf_hdr = (Elf32_Ehdr*)(mmbuf);
+	int i, k = 0;
+
+	if (n < sizeof(Elf32_Ehdr) ||
+	    memcmp(elf_hdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+	    elf_hdr->e_phoff + elf_hdr->e_phnum * elf_hdr->e_phentsize > n)
+		return 0;
+
+	for (i = 0; i < elf_hdr->e_phnum; i++) {
+		Elf32_Phdr* prog_hdr = (Elf32_Phdr*)(mmbuf + elf_hdr->e_phoff +
+						(i * elf_hdr->e_phentsize));
+		if (prog_hdr->p_type != PT_LOAD)
+			continue;
+		if (k == NR_VM_AREAS || prog_hdr->p_vaddr + prog_hdr->p_memsz >=
+		    PROC_IMAGE_SIZE_DEFAULT)
+			return 0;
+		im->vm[k].vaddr  = prog_hdr->p_vaddr;
+		im->vm[k].filesz = prog_hdr->p_filesz;
+		im->vm[k].memsz  = prog_hdr->p_memsz;
+		im->vm[k].offset = prog_hdr->p_offset;
+		k++;
+	}
+	im->entry = elf_hdr->e_entry;
+
+	return 1;
+}
+
+/*****************************************************************************
+ *                                get_image
+ *****************************************************************************/
+/**
+ * Find the image of a program file, loading its headers if it is not
+ * cached.
+ *
+ * @param pathname  The file.
+ *
+ * @return Handle of the image, with a reference taken. -1 if error.
+ *****************************************************************************/
+PUBLIC int get_image(const char * pathname)
+{
+	struct image * im;
+	struct stat s;
+
+	/* a path may name another file after a mount, the inode may not */
+	if (stat(pathname, &s) != 0)
+		return -1;
+
+	for (im = images; im < images + NR_IMAGES; im++)
+		if (im->path[0] && !im->stale &&
+		    im->dev == s.st_dev && im->ino == s.st_ino)
+			break;
+
+	if (im == images + NR_IMAGES) {
+		if (!(im = alloc_image()))
+			return -1;
+		int fd = open(pathname, O_RDWR);
+		if (fd == -1)
+			return -1;
+
+		/* a write from now on is applied by the next apply_invals() */
+		im->stale = 0;
+		im->dev = s.st_dev;
+		im->ino = s.st_ino;
+		im->fd  = fd;
+		strcpy(im->path, pathname);
+
+		im->pages = (u32*)alloc_frame();
+		if (im->pages)
+			memset(im->pages, 0, PAGE_SIZE);
+
+		if (!im->pages || !load_headers(im)) {
+			close(fd);
+			im->fd = -1;
+			drop_image(im);
+			return -1;
+		}
+	}
+
+	im->refs++;
+	im->last_use = ++image_clock;
+	return im - images;
+}
+
+/* another proc runs the image, see dup_vm() */
+PUBLIC void dup_image(int i)
+{
+	assert(images[i].refs > 0);
+	images[i].refs++;
+}
+
+/*****************************************************************************
+ *                                put_image
+ *****************************************************************************/
+/**
+ * Drop a reference to an image. With the last one the file is closed (so
+ * that it can be removed), the pages stay cached unless it is stale.
+ *
+ * @param i  Handle of the image.
+ *****************************************************************************/
+PUBLIC void put_image(int i)
+{
+	struct image * im = &images[i];
+
+	assert(im->refs > 0);
+	if (--im->refs)
+		return;
+
+	if (im->fd != -1) {
+		close(im->fd);
+		im->fd = -1;
+	}
+	if (im->stale)
+		drop_image(im);
+}
+
+/*****************************************************************************
+ *                                map_image
+ *****************************************************************************/
+/**
+ * Make a proc (just cleared by clear_vm()) run an image.
+ *
+ * @param i    Handle of the image, the reference goes to the proc.
+ * @param pid  The proc.
+ *
+ * @return The entry point.
+ *****************************************************************************/
+PUBLIC u32 map_image(int i, int pid)
+{
+	struct proc * p = &proc_table[pid];
+
+	assert(p->p_image == -1);
+	memcpy(p->p_vm, images[i].vm, sizeof(p->p_vm));
+	p->p_image = i;
+
+	return images[i].entry;
+}
+
+/*****************************************************************************
+ *                                inval_image
+ *****************************************************************************/
+/**
+ * <Ring 1, TASK_FS> A file has been written or removed, its image (and
+ * its pages cached for mmap()) must not be reused. MM may be running at
+ * the same time, so this only posts the file, apply_invals() does the
+ * rest.
+ *
+ * @param dev  Device of the file, NO_DEV for all images.
+ * @param ino  Inode nr. of the file.
+ *****************************************************************************/
+PUBLIC void inval_image(int dev, int ino)
+{
+	invals[inval_head % NR_INVALS].dev = dev;
+	invals[inval_head % NR_INVALS].ino = ino;
+	inval_head++;
+}
+
+/* mark the images and mapped files of a file stale */
+PRIVATE void mark_stale(int dev, int ino)
+{
+	int i;
+
+	for (i = 0; i < NR_IMAGES; i++)
+		if (dev == NO_DEV ||
+		    (images[i].dev == dev && images[i].ino == ino))
+			images[i].stale = 1;
+	inval_mfile(dev, ino);
+}
+
+/*****************************************************************************
+ *                                apply_invals
+ *****************************************************************************/
+/**
+ * <Ring 1, TASK_MM> Mark stale what FS has posted by inval_image() since
+ * the last call. If FS got more than NR_INVALS ahead, some posts were
+ * overwritten and everything is marked.
+ *****************************************************************************/
+PUBLIC void apply_invals()
+{
+	while (inval_tail != inval_head) {
+		int dev = invals[inval_tail % NR_INVALS].dev;
+		int ino = invals[inval_tail % NR_INVALS].ino;
+
+		if (inval_head - inval_tail > NR_INVALS) {
+			mark_stale(NO_DEV, 0);
+			inval_tail = inval_head;
+			break;
+		}
+		mark_stale(dev, ino);
+		inval_tail++;
+	}
+}
+
+/*****************************************************************************
+ *                                page_in
+ *****************************************************************************/
+/**
+ * Map the page a proc is waiting for, and let the proc go on. A cached
+ * page is shared copy-on-write, otherwise it is read from the file (and
+ * cached).
+ *
+ * @param p  The proc, PAGING.
+ *****************************************************************************/
+PRIVATE void page_in(struct proc * p)
+{
+	struct image * im = &images[p->p_image];
+	u32 la = PG_FRAME(p->p_fault_la);
+	u32 va = la - PROC_VM_BASE(proc2pid(p));
+	u32 * cached = &im->pages[va >> PAGE_SHIFT];
+	u32 pa = *cached;
+	int share = 1;
+	int i;
+
+	assert(va < PROC_IMAGE_SIZE_DEFAULT);
+
+	if (im->stale || !pa) {
+		while (!(pa = alloc_frame()))
+			if (!shrink_images() && !reclaim_frames())
+				panic("MM: no memory to page in 0x%x of %s",
+				      va, p->name);
+		memset((void*)pa, 0, PAGE_SIZE);
+
+		if (im->fd == -1)	/* reused from the cache */
+			im->fd = open(im->path, O_RDWR);
+		assert(im->fd != -1);
+
+		/* the page may hold the bytes of more than one segment */
+		for (i = 0; i < NR_VM_AREAS; i++) {
+			struct vm_area * a = &p->p_vm[i];
+			u32 s = max(va, a->vaddr);
+			u32 e = min(va + PAGE_SIZE, a->vaddr + a->filesz);
+			if (s >= e)
+				continue;
+
+			lseek(im->fd, a->offset + (s - a->vaddr), SEEK_SET);
+			read(im->fd, (void*)(pa + (s - va)), e - s);
+		}
+
+		if (im->stale)
+			share = 0;
+		else
+			*cached = pa;	/* the cache keeps this reference */
+	}
+
+	if (share)
+		ref_frame(pa);
+	if (set_page(la, pa | PG_P | PG_USU | (share ? PG_COW : PG_RWW)) != 0)
+		panic("MM: no memory to page in 0x%x of %s", va, p->name);
+
+	p->p_fault_la = 0;
+	p->p_flags &= ~PAGING;
+}
+
+/*****************************************************************************
+ *                                do_page_in
+ *****************************************************************************/
+/**
+ * Serve the procs blocked on a page of their program file or of a mapped
+ * file. The kernel wakes MM with a HARD_INT when there are some.
+ *****************************************************************************/
+PUBLIC void do_page_in()
+{
+	struct proc * p;
+
+	for (p = &FIRST_PROC; p <= &LAST_PROC; p++)
+		if ((p->p_flags & PAGING) && !mmap_page_in(p))
+			page_in(p);
+}
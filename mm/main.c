@@ -41,6 +41,8 @@ PUBLIC void task_mm()
 		int src = mm_msg.source;
 		int reply = 1;
 
+		apply_invals();	/* before any cached file is used */
+
 		int msgtype = mm_msg.type;
 
 		switch (msgtype) {
@@ -54,10 +56,41 @@ PUBLIC void task_mm()
 		case EXEC:
 			mm_msg.RETVAL = do_exec();
 			break;
+		case SPAWN:
+			mm_msg.RETVAL = do_spawn();
+			break;
+		case BRK:
+			mm_msg.RETVAL = do_brk();
+			break;
+		case SHMGET:
+			mm_msg.RETVAL = do_shmget();
+			break;
+		case SHMAT:
+			mm_msg.RETVAL = do_shmat();
+			break;
+		case SHMDT:
+			mm_msg.RETVAL = do_shmdt();
+			break;
+		case SHMRM:
+			mm_msg.RETVAL = do_shmrm();
+			break;
+		case MMAP:
+			mm_msg.RETVAL = do_mmap();
+			break;
+		case MUNMAP:
+			mm_msg.RETVAL = do_munmap();
+			break;
+		case MSYNC:
+			mm_msg.RETVAL = do_msync();
+			break;
 		case WAIT:
 			do_wait();
 			reply = 0;
 			break;
+		case HARD_INT:
+			do_page_in();
+			reply = 0;
+			break;
 		default:
 			dump_msg("MM::unknown msg", &mm_msg);
 			assert(0);
@@ -83,56 +116,10 @@ PRIVATE void init_mm()
 	struct boot_params bp;
 	get_boot_params(&bp);
 
-	memory_size = bp.mem_size;
+	/* the top of memory belongs to the RAM disk */
+	memory_size = bp.mem_size - RAMDISK_SIZE(bp.mem_size);
 
 	/* print memory size */
-	printl("{MM} memsize:%dMB\n", memory_size / (1024 * 1024));
-}
-
-/*****************************************************************************
- *                                alloc_mem
- *****************************************************************************/
-/**
- * Allocate a memory block for a proc.
- * 
- * @param pid  Which proc the memory is for.
- * @param memsize  How many bytes is needed.
- * 
- * @return  The base of the memory just allocated.
- *****************************************************************************/
-PUBLIC int alloc_mem(int pid, int memsize)
-{
-	assert(pid >= (NR_TASKS + NR_NATIVE_PROCS));
-	if (memsize > PROC_IMAGE_SIZE_DEFAULT) {
-		panic("unsupported memory request: %d. "
-		      "(should be less than %d)",
-		      memsize,
-		      PROC_IMAGE_SIZE_DEFAULT);
-	}
-
-	int base = PROCS_BASE +
-		(pid - (NR_TASKS + NR_NATIVE_PROCS)) * PROC_IMAGE_SIZE_DEFAULT;
-
-	if (base + memsize >= memory_size)
-		panic("memory allocation failed. pid:%d", pid);
-
-	return base;
-}
-
-/*****************************************************************************
- *                                free_mem
- *****************************************************************************/
-/**
- * Free a memory block. Because a memory block is corresponding with a PID, so
- * we don't need to really `free' anything. In another word, a memory block is
- * dedicated to one and only one PID, no matter what proc actually uses this
- * PID.
- * 
- * @param pid  Whose memory is to be freed.
- * 
- * @return  Zero if success.
- *****************************************************************************/
-PUBLIC int free_mem(int pid)
-{
-	return 0;
+	printl("{MM} memsize:%dMB, free pages:%d\n",
+	       memory_size / (1024 * 1024), free_frame_cnt());
 }
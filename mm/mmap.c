@@ -0,0 +1,387 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   mm/mmap.c
+ * @brief  Files mapped into procs.
+ *
+ * mmap() maps a range of a regular file from PROC_MMAP_BASE on. Pages are
+ * read in when touched, like those of a program (see image.c), and MM
+ * keeps them cached by file: every proc mapping a file gets the same
+ * frames. MAP_SHARED pages are PG_SHARED and written, those the proc
+ * dirtied go back to the file on msync(), munmap() and exit. MAP_PRIVATE
+ * pages are copy-on-write and never written back.
+ *
+ * There is no buffer cache in FS, this page cache is MM's own.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "keyboard.h"
+#include "proto.h"
+
+#define	NR_MFILES	8
+#define	MFILE_MAX_PAGES	(PAGE_SIZE / sizeof(u32))	/* 4 MB */
+
+PRIVATE struct mfile {
+	int	dev;
+	int	ino;		/* 0 if the slot is unused */
+	int	fd;		/* MM's fd of the file, -1 if closed */
+	int	size;		/* of the file when it was opened */
+	int	refs;		/* nr of areas mapping it */
+	int	stale;		/* written through FS, don't reuse */
+	u32 *	pages;		/* frames read so far, by page; in a frame */
+} mfiles[NR_MFILES];
+
+/* forget an unused file and give its pages back */
+PRIVATE void drop_mfile(struct mfile * f)
+{
+	int i;
+
+	assert(f->refs == 0 && f->fd == -1);
+	for (i = 0; f->pages && i < MFILE_MAX_PAGES; i++)
+		if (f->pages[i])
+			free_frame(f->pages[i]);
+	if (f->pages)
+		free_frame((u32)f->pages);
+	memset(f, 0, sizeof(struct mfile));
+}
+
+/* drop every unused file, to get memory back */
+PRIVATE int shrink_mfiles()
+{
+	int i, n = 0;
+
+	for (i = 0; i < NR_MFILES; i++)
+		if (mfiles[i].ino && mfiles[i].refs == 0) {
+			drop_mfile(&mfiles[i]);
+			n++;
+		}
+	return n;
+}
+
+/* the cached file opened as fd by proc pid, -1 if error */
+PRIVATE int get_mfile(int pid, int fd)
+{
+	MESSAGE msg;
+	struct mfile * f;
+	struct mfile * spare = 0;
+
+	msg.type    = DUP_FD;
+	msg.PROC_NR = pid;
+	msg.FD	    = fd;
+	send_recv(BOTH, TASK_FS, &msg);
+	if (msg.FD == -1)
+		return -1;
+
+	for (f = mfiles; f < mfiles + NR_MFILES; f++) {
+		if (f->ino && !f->stale &&
+		    f->dev == msg.DEVICE && f->ino == msg.INODE_NR)
+			break;
+		if (!spare && (!f->ino || f->refs == 0))
+			spare = f;
+	}
+
+	if (f == mfiles + NR_MFILES) {
+		if (!spare) {
+			close(msg.FD);
+			return -1;
+		}
+		f = spare;
+		if (f->ino)
+			drop_mfile(f);
+		f->pages = (u32*)alloc_frame();
+		if (!f->pages) {
+			close(msg.FD);
+			return -1;
+		}
+		memset(f->pages, 0, PAGE_SIZE);
+		f->dev = msg.DEVICE;
+		f->ino = msg.INODE_NR;
+		f->fd  = -1;
+	}
+
+	if (f->fd == -1) {
+		f->fd = msg.FD;
+		f->size = (int)msg.POSITION;
+	}
+	else {
+		close(msg.FD);
+	}
+	f->refs++;
+	return f - mfiles;
+}
+
+/* an area no longer maps the file */
+PRIVATE void put_mfile(int i)
+{
+	struct mfile * f = &mfiles[i];
+
+	assert(f->refs > 0);
+	if (--f->refs)
+		return;
+
+	close(f->fd);
+	f->fd = -1;
+	if (f->stale)
+		drop_mfile(f);
+}
+
+/* zero if [va, va + len) overlaps no area of p */
+PRIVATE int mmap_range_used(struct proc * p, u32 va, u32 len)
+{
+	int i;
+
+	for (i = 0; i < NR_MMAP_AREAS; i++) {
+		struct mmap_area * a = &p->p_mmap[i];
+		if (a->va && va < a->va + a->len && a->va < va + len)
+			return 1;
+	}
+	return 0;
+}
+
+/* write the pages of a MAP_SHARED area the proc dirtied back to the file */
+PRIVATE void write_back(int pid, struct mmap_area * a)
+{
+	struct mfile * f = &mfiles[a->file];
+	u32 base = PROC_VM_BASE(pid) + a->va;
+	u32 off;
+
+	if (a->flags != MAP_SHARED)
+		return;
+
+	for (off = 0; off < a->len; off += PAGE_SIZE) {
+		u32 pte = get_page(base + off);
+		int pos = a->offset + off;
+		if (!(pte & PG_P) || !(pte & PG_DIRTY) || pos >= f->size)
+			continue;
+
+		/* the file does not grow, bytes past its end are lost */
+		lseek(f->fd, pos, SEEK_SET);
+		write(f->fd, (void*)PG_FRAME(pte),
+		      min(PAGE_SIZE, f->size - pos));
+		set_page(base + off, pte & ~PG_DIRTY);
+	}
+	flush_tlb();
+}
+
+/* unmap an area of proc pid */
+PRIVATE void unmap_area(int pid, struct mmap_area * a)
+{
+	u32 base = PROC_VM_BASE(pid) + a->va;
+	u32 off;
+
+	write_back(pid, a);
+
+	for (off = 0; off < a->len; off += PAGE_SIZE)
+		drop_page(base + off);
+	flush_tlb();
+
+	put_mfile(a->file);
+	a->va = 0;
+}
+
+/* the area of proc pid starting at va */
+PRIVATE struct mmap_area * find_area(int pid, u32 va)
+{
+	struct mmap_area * a;
+
+	for (a = proc_table[pid].p_mmap;
+	     a < proc_table[pid].p_mmap + NR_MMAP_AREAS; a++)
+		if (va && a->va == va)
+			return a;
+	return 0;
+}
+
+/*****************************************************************************
+ *                                do_mmap
+ *****************************************************************************/
+/**
+ * Perform the mmap() syscall: map FD from POSITION on, CNT bytes, at BUF
+ * (or where there is room if BUF is 0). Nothing is read here.
+ *
+ * @return Zero if successful, -1 if error. The address of the mapping is
+ *         returned in BUF.
+ *****************************************************************************/
+PUBLIC int do_mmap()
+{
+	int pid = mm_msg.source;
+	struct proc * p = &proc_table[pid];
+	u32 va = (u32)mm_msg.BUF;
+	u32 len = (mm_msg.CNT + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+	u64 position = mm_msg.POSITION;	/* negative offsets come huge */
+	u32 offset = (u32)position;
+	int flags = mm_msg.MAP_FLAGS;
+	struct mmap_area * a;
+
+	if (p->p_cr3 == PAGE_DIR_BASE)
+		return -1;	/* native procs have no window */
+	if (mm_msg.CNT <= 0 || len > PROC_KDATA_VA - PROC_MMAP_BASE ||
+	    (offset & (PAGE_SIZE - 1)) ||
+	    position > MFILE_MAX_PAGES * PAGE_SIZE ||
+	    len > MFILE_MAX_PAGES * PAGE_SIZE - offset ||
+	    (flags != MAP_SHARED && flags != MAP_PRIVATE))
+		return -1;
+
+	if (va) {
+		if ((va & (PAGE_SIZE - 1)) || va < PROC_MMAP_BASE ||
+		    va > PROC_KDATA_VA - len || mmap_range_used(p, va, len))
+			return -1;
+	}
+	else {
+		for (va = PROC_MMAP_BASE; va <= PROC_KDATA_VA - len;
+		     va += PAGE_SIZE)
+			if (!mmap_range_used(p, va, len))
+				break;
+		if (va > PROC_KDATA_VA - len)
+			return -1;
+	}
+
+	for (a = p->p_mmap; a < p->p_mmap + NR_MMAP_AREAS; a++)
+		if (!a->va)
+			break;
+	if (a == p->p_mmap + NR_MMAP_AREAS)
+		return -1;
+
+	int file = get_mfile(pid, mm_msg.FD);
+	if (file == -1)
+		return -1;
+
+	a->va	  = va;
+	a->len	  = len;
+	a->offset = offset;
+	a->flags  = flags;
+	a->file	  = file;
+
+	mm_msg.BUF = (void*)va;
+	return 0;
+}
+
+/*****************************************************************************
+ *                                do_munmap
+ *****************************************************************************/
+/**
+ * Perform the munmap() syscall: unmap the area starting at BUF, after
+ * writing it back if it is shared. Areas are unmapped whole.
+ *
+ * @return Zero if successful, -1 if no area starts at BUF.
+ *****************************************************************************/
+PUBLIC int do_munmap()
+{
+	struct mmap_area * a = find_area(mm_msg.source, (u32)mm_msg.BUF);
+
+	if (!a)
+		return -1;
+	unmap_area(mm_msg.source, a);
+	return 0;
+}
+
+/*****************************************************************************
+ *                                do_msync
+ *****************************************************************************/
+/**
+ * Perform the msync() syscall: write the area starting at BUF back.
+ *
+ * @return Zero if successful, -1 if no area starts at BUF.
+ *****************************************************************************/
+PUBLIC int do_msync()
+{
+	struct mmap_area * a = find_area(mm_msg.source, (u32)mm_msg.BUF);
+
+	if (!a)
+		return -1;
+	write_back(mm_msg.source, a);
+	return 0;
+}
+
+/*****************************************************************************
+ *                                mmap_page_in
+ *****************************************************************************/
+/**
+ * Map the page of a mapped file a proc is waiting for, see do_page_in().
+ *
+ * @param p  The proc, PAGING.
+ *
+ * @return Zero if the page is in no area of the proc.
+ *****************************************************************************/
+PUBLIC int mmap_page_in(struct proc * p)
+{
+	u32 va = PG_FRAME(p->p_fault_la) - PROC_VM_BASE(proc2pid(p));
+	struct mmap_area * a;
+
+	for (a = p->p_mmap; a < p->p_mmap + NR_MMAP_AREAS; a++)
+		if (a->va && va >= a->va && va < a->va + a->len)
+			break;
+	if (a == p->p_mmap + NR_MMAP_AREAS)
+		return 0;
+
+	struct mfile * f = &mfiles[a->file];
+	u32 pos = a->offset + (va - a->va);
+	assert(pos / PAGE_SIZE < MFILE_MAX_PAGES);	/* see do_mmap() */
+	u32 * cached = &f->pages[pos / PAGE_SIZE];
+
+	if (!*cached) {
+		u32 pa;
+		while (!(pa = alloc_frame()))
+			if (!shrink_mfiles() && !reclaim_frames())
+				panic("MM: no memory to page in 0x%x of %s",
+				      va, p->name);
+		memset((void*)pa, 0, PAGE_SIZE);
+		if (pos < (u32)f->size) {
+			lseek(f->fd, pos, SEEK_SET);
+			read(f->fd, (void*)pa, min(PAGE_SIZE, (u32)f->size - pos));
+		}
+		*cached = pa;	/* the cache keeps this reference */
+	}
+
+	ref_frame(*cached);
+	u32 pte = *cached | PG_P | PG_USU |
+		(a->flags == MAP_SHARED ? PG_RWW | PG_SHARED : PG_COW);
+	if (set_page(PG_FRAME(p->p_fault_la), pte) != 0)
+		panic("MM: no memory to page in 0x%x of %s", va, p->name);
+
+	p->p_fault_la = 0;
+	p->p_flags &= ~PAGING;
+	return 1;
+}
+
+/* a file has been written through FS, see apply_invals() */
+PUBLIC void inval_mfile(int dev, int ino)
+{
+	int i;
+
+	for (i = 0; i < NR_MFILES; i++)
+		if (dev == NO_DEV ||
+		    (mfiles[i].dev == dev && mfiles[i].ino == ino))
+			mfiles[i].stale = 1;
+}
+
+/* the child of a fork maps the parent's files too, see dup_vm() */
+PUBLIC void dup_mmap(int parent, int child)
+{
+	int i;
+
+	memcpy(proc_table[child].p_mmap, proc_table[parent].p_mmap,
+	       sizeof(proc_table[child].p_mmap));
+	for (i = 0; i < NR_MMAP_AREAS; i++)
+		if (proc_table[child].p_mmap[i].va)
+			mfiles[proc_table[child].p_mmap[i].file].refs++;
+}
+
+/* unmap every area of a proc, on exec and exit */
+PUBLIC void unmap_all_mmap(int pid)
+{
+	int i;
+
+	for (i = 0; i < NR_MMAP_AREAS; i++)
+		if (proc_table[pid].p_mmap[i].va)
+			unmap_area(pid, &proc_table[pid].p_mmap[i]);
+}
@@ -0,0 +1,271 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   mm/shm.c
+ * @brief  Shared memory: frames mapped into several procs at once.
+ *
+ * A segment is made by shmget() and mapped by shmat() into a proc window,
+ * between PROC_SHM_BASE and PROC_MMAP_BASE. Every window has the same
+ * layout, so procs may attach a segment at the same address and pass
+ * pointers into it. The pages are PG_SHARED: fork gives the child the same frames, not
+ * copy-on-write ones. A segment lives until shmrm() removes it and its
+ * last attachment is gone, so one may be made and attached later, by
+ * another proc.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "keyboard.h"
+#include "proto.h"
+
+#define	NR_SHM_SEGS	16
+#define	SHM_MAX_PAGES	(PAGE_SIZE / sizeof(u32))	/* 4 MB */
+
+PRIVATE struct shm_seg {
+	int	key;		/* 0: private, never found by shmget() */
+	int	nr_pages;	/* 0 if the slot is unused */
+	int	nattch;		/* nr of procs it is attached to */
+	int	removed;	/* by shmrm(), freed at the last detach */
+	u32 *	frames;		/* of the pages, in a frame */
+} segs[NR_SHM_SEGS];
+
+/* give the pages of a segment back and free its slot */
+PRIVATE void free_seg(struct shm_seg * s)
+{
+	int i;
+
+	for (i = 0; i < s->nr_pages; i++)
+		if (s->frames[i])
+			free_frame(s->frames[i]);
+	if (s->frames)
+		free_frame((u32)s->frames);
+	memset(s, 0, sizeof(struct shm_seg));
+}
+
+/* zero if [va, va + len) overlaps no segment attached to p */
+PRIVATE int shm_range_used(struct proc * p, u32 va, u32 len)
+{
+	int i;
+
+	for (i = 0; i < NR_SHM_ATTACH; i++) {
+		struct shm_attach * a = &p->p_shm[i];
+		if (!a->va)
+			continue;
+		u32 end = a->va + segs[a->id].nr_pages * PAGE_SIZE;
+		if (va < end && a->va < va + len)
+			return 1;
+	}
+	return 0;
+}
+
+/* unmap an attachment of proc pid, a removed segment goes with the last */
+PRIVATE void detach(int pid, struct shm_attach * a)
+{
+	struct shm_seg * s = &segs[a->id];
+	u32 base = PROC_VM_BASE(pid) + a->va;
+	int i;
+
+	for (i = 0; i < s->nr_pages; i++)
+		drop_page(base + i * PAGE_SIZE);
+	flush_tlb();
+
+	a->va = 0;
+	if (--s->nattch == 0 && s->removed)
+		free_seg(s);
+}
+
+/*****************************************************************************
+ *                                do_shmget
+ *****************************************************************************/
+/**
+ * Perform the shmget() syscall: find the segment of a key, or make one.
+ * A new segment is zeroed.
+ *
+ * @return The id of the segment, -1 if error.
+ *****************************************************************************/
+PUBLIC int do_shmget()
+{
+	int key = mm_msg.SHM_KEY;
+	int size = mm_msg.CNT;
+	int nr_pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+	struct shm_seg * s;
+	int i;
+
+	if (size <= 0 || nr_pages > SHM_MAX_PAGES)
+		return -1;
+
+	if (key) {
+		for (s = segs; s < segs + NR_SHM_SEGS; s++)
+			if (s->nr_pages && !s->removed && s->key == key)
+				return nr_pages <= s->nr_pages ? s - segs : -1;
+	}
+
+	for (s = segs; s < segs + NR_SHM_SEGS; s++)
+		if (!s->nr_pages)
+			break;
+	if (s == segs + NR_SHM_SEGS)
+		return -1;
+
+	s->frames = (u32*)alloc_frame();
+	if (!s->frames)
+		return -1;
+	memset(s->frames, 0, PAGE_SIZE);
+	s->key = key;
+	s->nr_pages = nr_pages;
+
+	for (i = 0; i < nr_pages; i++) {
+		u32 pa = alloc_frame();
+		if (!pa) {
+			free_seg(s);
+			return -1;
+		}
+		memset((void*)pa, 0, PAGE_SIZE);
+		s->frames[i] = pa;
+	}
+
+	return s - segs;
+}
+
+/*****************************************************************************
+ *                                do_shmat
+ *****************************************************************************/
+/**
+ * Perform the shmat() syscall: map a segment into the caller.
+ *
+ * @return Zero if successful, -1 if error. The address of the segment is
+ *         returned in BUF, which holds the one wanted (or 0) on the way in.
+ *****************************************************************************/
+PUBLIC int do_shmat()
+{
+	int pid = mm_msg.source;
+	struct proc * p = &proc_table[pid];
+	int id = mm_msg.SHM_ID;
+	u32 va = (u32)mm_msg.BUF;
+	struct shm_attach * a;
+	int i;
+
+	if (p->p_cr3 == PAGE_DIR_BASE)
+		return -1;	/* native procs have no window */
+	if (id < 0 || id >= NR_SHM_SEGS || !segs[id].nr_pages ||
+	    segs[id].removed)
+		return -1;
+
+	struct shm_seg * s = &segs[id];
+	u32 len = s->nr_pages * PAGE_SIZE;
+
+	if (va) {
+		if ((va & (PAGE_SIZE - 1)) || va < PROC_SHM_BASE ||
+		    va > PROC_MMAP_BASE - len || shm_range_used(p, va, len))
+			return -1;
+	}
+	else {
+		for (va = PROC_SHM_BASE; va <= PROC_MMAP_BASE - len;
+		     va += PAGE_SIZE)
+			if (!shm_range_used(p, va, len))
+				break;
+		if (va > PROC_MMAP_BASE - len)
+			return -1;
+	}
+
+	for (a = p->p_shm; a < p->p_shm + NR_SHM_ATTACH; a++)
+		if (!a->va)
+			break;
+	if (a == p->p_shm + NR_SHM_ATTACH)
+		return -1;
+
+	a->va = va;
+	a->id = id;
+	s->nattch++;
+
+	u32 base = PROC_VM_BASE(pid) + va;
+	for (i = 0; i < s->nr_pages; i++) {
+		ref_frame(s->frames[i]);
+		if (set_page(base + i * PAGE_SIZE, s->frames[i] | PG_P | PG_RWW |
+			     PG_USU | PG_SHARED) != 0) {
+			free_frame(s->frames[i]);
+			detach(pid, a);
+			return -1;
+		}
+	}
+
+	mm_msg.BUF = (void*)va;
+	return 0;
+}
+
+/*****************************************************************************
+ *                                do_shmdt
+ *****************************************************************************/
+/**
+ * Perform the shmdt() syscall: unmap a segment from the caller.
+ *
+ * @return Zero if successful, -1 if nothing is attached at BUF.
+ *****************************************************************************/
+PUBLIC int do_shmdt()
+{
+	int pid = mm_msg.source;
+	u32 va = (u32)mm_msg.BUF;
+	struct shm_attach * a;
+
+	for (a = proc_table[pid].p_shm; a < proc_table[pid].p_shm + NR_SHM_ATTACH;
+	     a++)
+		if (va && a->va == va) {
+			detach(pid, a);
+			return 0;
+		}
+	return -1;
+}
+
+/*****************************************************************************
+ *                                do_shmrm
+ *****************************************************************************/
+/**
+ * Perform the shmrm() syscall: remove a segment, at once if nobody has it
+ * attached, otherwise at its last detach.
+ *
+ * @return Zero if successful, -1 if there is no such segment.
+ *****************************************************************************/
+PUBLIC int do_shmrm()
+{
+	int id = mm_msg.SHM_ID;
+
+	if (id < 0 || id >= NR_SHM_SEGS || !segs[id].nr_pages ||
+	    segs[id].removed)
+		return -1;
+
+	if (segs[id].nattch)
+		segs[id].removed = 1;
+	else
+		free_seg(&segs[id]);
+	return 0;
+}
+
+/* the child of a fork has the parent's segments, see dup_vm() */
+PUBLIC void dup_shm(int parent, int child)
+{
+	int i;
+
+	memcpy(proc_table[child].p_shm, proc_table[parent].p_shm,
+	       sizeof(proc_table[child].p_shm));
+	for (i = 0; i < NR_SHM_ATTACH; i++)
+		if (proc_table[child].p_shm[i].va)
+			segs[proc_table[child].p_shm[i].id].nattch++;
+}
+
+/* detach every segment of a proc, on exec and exit */
+PUBLIC void detach_all_shm(int pid)
+{
+	int i;
+
+	for (i = 0; i < NR_SHM_ATTACH; i++)
+		if (proc_table[pid].p_shm[i].va)
+			detach(pid, &proc_table[pid].p_shm[i]);
+}
@@ -0,0 +1,245 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   mm/swap.c
+ * @brief  TASK_SWAP: pages written out to the swap partition and back.
+ *
+ * When free frames run low, pages of the procs are written to SWAP_DEV
+ * and their frames freed. They are picked by a clock: a hand goes round
+ * the windows, a page used since the hand last passed gets a second
+ * chance (see evict_page()). A proc touching a page in swap, or faulting
+ * with no memory left, waits for this task to read it back or to free
+ * some frames (see page_fault_handler()).
+ *
+ * This is a task of its own, not part of MM: FS may fault on a page in
+ * swap while copying a user buffer, and MM may be waiting for FS.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "keyboard.h"
+#include "proto.h"
+#include "hd.h"
+
+#define	SWAP_BATCH	16	/* pages written out at a time */
+
+PRIVATE int	swap_driver = INVALID_DRIVER;
+PRIVATE u32	hand = PROC_LINEAR_BASE;	/* of the clock */
+
+PRIVATE void init_swap_dev();
+PRIVATE int  swap_out(int n);
+PRIVATE void swap_in_waiting();
+
+/*****************************************************************************
+ *                                task_swap
+ *****************************************************************************/
+/**
+ * <Ring 1> The main loop of TASK SWAP.
+ *****************************************************************************/
+PUBLIC void task_swap()
+{
+	MESSAGE msg;
+
+	init_swap_dev();
+
+	while (1) {
+		send_recv(RECEIVE, ANY, &msg);
+		int src = msg.source;
+
+		switch (msg.type) {
+		case HARD_INT:	/* a proc waits, or memory is low */
+			while (free_frame_cnt() < SWAP_LOW_FRAMES &&
+			       swap_out(SWAP_BATCH))
+				;
+			swap_in_waiting();
+			break;
+		case SWAP_OUT:
+			msg.RETVAL = swap_out(msg.CNT);
+			msg.type = SYSCALL_RET;
+			send_recv(SEND, src, &msg);
+			break;
+		default:
+			dump_msg("SWAP::unknown msg", &msg);
+			assert(0);
+			break;
+		}
+	}
+}
+
+/*****************************************************************************
+ *                                reclaim_frames
+ *****************************************************************************/
+/**
+ * <Ring 1, TASK_MM> Have some pages written out when MM finds no frame.
+ *
+ * @return Nr. of frames freed, 0 if none could be.
+ *****************************************************************************/
+PUBLIC int reclaim_frames()
+{
+	MESSAGE msg;
+	msg.type = SWAP_OUT;
+	msg.CNT	 = SWAP_BATCH;
+
+	send_recv(BOTH, TASK_SWAP, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
+
+/* read or write a page of the swap partition */
+PRIVATE void rw_swap(int io_type, int slot, u32 pa)
+{
+	MESSAGE msg;
+	msg.type	= io_type;
+	msg.DEVICE	= MINOR(SWAP_DEV);
+	msg.POSITION	= (u64)slot * PAGE_SIZE;
+	msg.BUF		= (void*)pa;
+	msg.CNT		= PAGE_SIZE;
+	msg.PROC_NR	= TASK_SWAP;
+
+	send_recv(BOTH, swap_driver, &msg);
+	if (msg.RETVAL != 0)
+		panic("SWAP: cannot %s slot %d",
+		      io_type == DEV_READ ? "read" : "write", slot);
+}
+
+/* open the swap partition and make the slot map, no swap if it is absent */
+PRIVATE void init_swap_dev()
+{
+	MESSAGE msg;
+	struct part_info geo;
+
+	if (SWAP_DEV == NO_DEV ||
+	    dd_map[MAJOR(SWAP_DEV)].driver_nr == INVALID_DRIVER)
+		return;
+
+	msg.type   = DEV_OPEN;
+	msg.DEVICE = MINOR(SWAP_DEV);
+	msg.RETVAL = 0;
+	send_recv(BOTH, dd_map[MAJOR(SWAP_DEV)].driver_nr, &msg);
+	if (msg.RETVAL != 0)
+		return;
+
+	geo.size    = 0;
+	msg.type    = DEV_IOCTL;
+	msg.DEVICE  = MINOR(SWAP_DEV);
+	msg.REQUEST = DIOCTL_GET_GEO;
+	msg.BUF	    = &geo;
+	msg.PROC_NR = TASK_SWAP;
+	send_recv(BOTH, dd_map[MAJOR(SWAP_DEV)].driver_nr, &msg);
+
+	int n = init_swap(geo.size / (PAGE_SIZE / SECTOR_SIZE));
+	if (n)
+		swap_driver = dd_map[MAJOR(SWAP_DEV)].driver_nr;
+
+	printl("{SWAP} %d pages of swap\n", n);
+}
+
+/* where the hand goes from `la': the next page that may be mapped */
+PRIVATE u32 next_page(u32 la)
+{
+	int i;
+
+	la += PAGE_SIZE;
+	for (i = 0; i <= NR_VM_SLOTS; i++) {
+		if (la >= PROC_VM_END)
+			la = PROC_LINEAR_BASE;
+
+		int pid = (la - PROC_LINEAR_BASE) / PROC_VM_SIZE +
+			NR_TASKS + NR_NATIVE_PROCS;
+		struct proc * p = &proc_table[pid];
+		u32 va = la - PROC_VM_BASE(pid);
+
+		if (p->p_cr3 == PAGE_DIR_BASE)		/* window not in use */
+			la = PROC_VM_BASE(pid) + PROC_VM_SIZE;
+		else if (va >= p->p_brk && va < PROC_MMAP_BASE)
+			la = PROC_VM_BASE(pid) + PROC_MMAP_BASE;
+		else
+			break;
+	}
+	return la;
+}
+
+/*****************************************************************************
+ *                                swap_out
+ *****************************************************************************/
+/**
+ * Move the hand until `n' pages are taken or it has gone round twice, and
+ * write the pages taken out.
+ *
+ * @param n  Nr. of pages wanted, up to SWAP_BATCH.
+ *
+ * @return Nr. of frames freed.
+ *****************************************************************************/
+PRIVATE int swap_out(int n)
+{
+	u32 frames[SWAP_BATCH];
+	int slots[SWAP_BATCH];
+	int nr = 0;
+	int i;
+
+	if (swap_driver == INVALID_DRIVER)
+		return 0;
+
+	n = min(n, SWAP_BATCH);
+	for (i = 0; nr < n && i < 2 * NR_VM_SLOTS * (PROC_VM_SIZE / PAGE_SIZE);
+	     i++) {
+		frames[nr] = evict_page(hand, &slots[nr]);
+		if (frames[nr])
+			nr++;
+		hand = next_page(hand);
+	}
+
+	/* no stale TLB entry may point at the frames any more */
+	flush_tlb();
+
+	for (i = 0; i < nr; i++) {
+		rw_swap(DEV_WRITE, slots[i], frames[i]);
+		free_frame(frames[i]);
+	}
+	return nr;
+}
+
+/*****************************************************************************
+ *                                swap_in_waiting
+ *****************************************************************************/
+/**
+ * Let the SWAPPING procs go on, after reading back the pages they wait
+ * for. Those out of memory fault again and get a frame now.
+ *****************************************************************************/
+PRIVATE void swap_in_waiting()
+{
+	struct proc * p;
+
+	for (p = &FIRST_PROC; p <= &LAST_PROC; p++) {
+		if (!(p->p_flags & SWAPPING))
+			continue;
+
+		u32 la = PG_FRAME(p->p_fault_la);
+		u32 pte = get_page(la);
+		if (pte & PG_SWAP) {
+			u32 pa;
+			while (!(pa = alloc_frame()))
+				if (!swap_out(SWAP_BATCH))
+					panic("SWAP: out of memory and swap");
+			rw_swap(DEV_READ, pte >> PAGE_SHIFT, pa);
+			if (unswap_page(la, pte, pa) != 0)
+				free_frame(pa);
+		}
+		else if (!free_frame_cnt()) {
+			panic("SWAP: out of memory and swap");
+		}
+
+		p->p_fault_la = 0;
+		p->p_flags &= ~SWAPPING;
+	}
+}
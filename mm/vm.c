@@ -0,0 +1,201 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   mm/vm.c
+ * @brief  Address spaces of the paged procs.
+ *
+ * A proc sees its window (PROC_VM_BASE) from address 0 through its LDT
+ * segments. Pages are mapped when first touched, see page_fault_handler().
+ * Those holding bytes of the program file are read in by MM, see image.c.
+ * Above the image lies the heap, the proc moves its end with brk(). The
+ * top half of the window is for shared memory (shm.c) and mapped files
+ * (mmap.c).
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "config.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "keyboard.h"
+#include "proto.h"
+
+/*****************************************************************************
+ *                                new_vm
+ *****************************************************************************/
+/**
+ * Give a proc an empty address space: a page directory and LDT segments
+ * covering its window.
+ *
+ * @param pid  The proc.
+ *
+ * @return Zero if successful, -1 if out of memory.
+ *****************************************************************************/
+PUBLIC int new_vm(int pid)
+{
+	struct proc * p = &proc_table[pid];
+
+	if (new_pgdir(pid) != 0)
+		return -1;
+
+	init_desc(&p->ldts[INDEX_LDT_C],
+		  PROC_VM_BASE(pid),
+		  (PROC_VM_SIZE - 1) >> LIMIT_4K_SHIFT,
+		  DA_LIMIT_4K | DA_32 | DA_C | PRIVILEGE_USER << 5);
+	init_desc(&p->ldts[INDEX_LDT_RW],
+		  PROC_VM_BASE(pid),
+		  (PROC_VM_SIZE - 1) >> LIMIT_4K_SHIFT,
+		  DA_LIMIT_4K | DA_32 | DA_DRW | PRIVILEGE_USER << 5);
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                dup_vm
+ *****************************************************************************/
+/**
+ * Copy the memory of a proc into the (empty) address space of another.
+ * Pages of a paged proc are shared copy-on-write (those in swap by their
+ * slot), the image too.
+ *
+ * @param parent  The proc to be copied.
+ * @param child   The new proc, see new_vm().
+ *
+ * @return Zero if successful, -1 if out of memory.
+ *****************************************************************************/
+PUBLIC int dup_vm(int parent, int child)
+{
+	u32 dst = PROC_VM_BASE(child);
+	u32 off;
+
+	if (proc_table[parent].p_cr3 == PAGE_DIR_BASE) {
+		/* a native proc (INIT): copy its segment, pages get mapped
+		 * as they are written */
+		struct descriptor * d = &proc_table[parent].ldts[INDEX_LDT_RW];
+		int base  = reassembly(d->base_high, 24,
+				       d->base_mid,  16,
+				       d->base_low);
+		int limit = reassembly((d->limit_high_attr2 & 0xF), 16,
+				       0, 0,
+				       d->limit_low);
+		int size  = (limit + 1) *
+			((d->limit_high_attr2 & (DA_LIMIT_4K >> 8)) ? 4096 : 1);
+
+		assert(size <= PROC_HEAP_BASE);
+		phys_copy((void*)dst, (void*)base, size);
+		proc_table[child].p_brk = PROC_HEAP_BASE;
+		return 0;
+	}
+
+	struct proc * c = &proc_table[child];
+	c->p_image = proc_table[parent].p_image;
+	memcpy(c->p_vm, proc_table[parent].p_vm, sizeof(c->p_vm));
+	if (c->p_image >= 0)
+		dup_image(c->p_image);
+	dup_shm(parent, child);
+	dup_mmap(parent, child);
+
+	u32 src = PROC_VM_BASE(parent);
+	int ret = 0;
+	for (off = 0; off < PROC_VM_SIZE && ret == 0; off += PAGE_SIZE)
+		if (get_page(src + off) & (PG_P | PG_SWAP))
+			ret = share_page(src + off, dst + off);
+
+	/* the parent's pages are read-only now */
+	flush_tlb();
+
+	return ret;
+}
+
+/* unmap and free the pages of [from, to) in the window of a proc */
+PRIVATE void unmap_range(int pid, u32 from, u32 to)
+{
+	u32 base = PROC_VM_BASE(pid);
+	u32 off;
+
+	for (off = from; off < to; off += PAGE_SIZE)
+		drop_page(base + off);
+
+	flush_tlb();
+}
+
+/*****************************************************************************
+ *                                clear_vm
+ *****************************************************************************/
+/**
+ * Unmap and free every page of a proc and forget its image. The page
+ * tables stay with the window, the next proc in this slot will use them.
+ *
+ * @param pid  The proc.
+ *****************************************************************************/
+PUBLIC void clear_vm(int pid)
+{
+	struct proc * p = &proc_table[pid];
+
+	if (p->p_image >= 0)
+		put_image(p->p_image);
+	p->p_image = -1;
+	memset(p->p_vm, 0, sizeof(p->p_vm));
+	p->p_brk = PROC_HEAP_BASE;
+	detach_all_shm(pid);
+	unmap_all_mmap(pid);
+
+	unmap_range(pid, 0, PROC_VM_SIZE);
+}
+
+/*****************************************************************************
+ *                                free_vm
+ *****************************************************************************/
+/**
+ * Release the whole address space of a proc.
+ *
+ * @param pid  The proc.
+ *****************************************************************************/
+PUBLIC void free_vm(int pid)
+{
+	if (proc_table[pid].p_cr3 == PAGE_DIR_BASE)
+		return;		/* native procs have none */
+
+	clear_vm(pid);
+	free_pgdir(pid);
+}
+
+/*****************************************************************************
+ *                                do_brk
+ *****************************************************************************/
+/**
+ * Perform the brk() syscall: move the end of the caller's heap. Pages
+ * below the break are mapped when touched, those above a lowered break
+ * are freed.
+ *
+ * @return Zero if successful, -1 if the break is out of the heap or the
+ *         caller is a native proc. The break is returned in BUF, a BUF
+ *         of 0 only asks for it.
+ *****************************************************************************/
+PUBLIC int do_brk()
+{
+	int pid = mm_msg.source;
+	struct proc * p = &proc_table[pid];
+	u32 addr = (u32)mm_msg.BUF;
+
+	if (p->p_cr3 == PAGE_DIR_BASE)
+		return -1;	/* native procs have no window */
+
+	if (addr) {
+		if (addr < PROC_HEAP_BASE || addr > PROC_SHM_BASE)
+			return -1;
+		if (addr < p->p_brk)
+			unmap_range(pid, PG_FRAME(addr + PAGE_SIZE - 1),
+				    PG_FRAME(p->p_brk + PAGE_SIZE - 1));
+		p->p_brk = addr;
+	}
+
+	mm_msg.BUF = (void*)p->p_brk;
+	return 0;
+}